@@ -0,0 +1,636 @@
+/*
+ * bench.c
+ * Headless benchmarks for the core library. Results are written as JSON, and can be compared
+ * against a stored baseline run.
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <core/jet.h>
+#include <core/regex.h>
+
+#include "corpus.h"
+
+#define MAX_RESULTS 64
+
+/* quick benchmarks are repeated until they have run for at least this long (seconds) */
+#define MIN_TIME 0.02
+
+/* timing of one benchmark, in seconds */
+typedef struct result {
+    char name[64];
+    double median, min;
+    size_t bytes;
+} result;
+
+static result results[MAX_RESULTS];
+static int nresults;
+
+/* options */
+static int reps = 5;
+static int scale = 1;
+static const char *syntaxdir = NULL;
+
+/* scratch files the corpus is written to */
+static char dir[64];
+static char c_path[128], log_path[128], min_path[128], out_path[128];
+static size_t c_len, log_len, min_len;
+
+/* the core expects the front end to provide this */
+void die(const char *error, int code) {
+    fprintf(stderr, "Error: %s\n", error);
+    exit(code);
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/* run a benchmark reps times. fn does its own setup and returns the time of the measured part */
+static void bench(const char *name, double (*fn)(const char*), const char *arg, size_t bytes) {
+    double times[reps];
+
+    for (int i = 0; i < reps; i++) {
+        double total = 0;
+        int runs = 0;
+        do {
+            total += fn(arg);
+            runs++;
+        } while (total < MIN_TIME);
+        times[i] = total / runs;
+    }
+    qsort(times, reps, sizeof(double), cmp_double);
+
+    result *r = &results[nresults++];
+    snprintf(r->name, sizeof(r->name), "%s", name);
+    r->median = times[reps / 2];
+    r->min = times[0];
+    r->bytes = bytes;
+
+    fprintf(stderr, "%-24s %10.3f ms (min %.3f ms)\n", name, r->median * 1e3, r->min * 1e3);
+}
+
+/* write a generated corpus out to the scratch directory */
+static void write_corpus(char *path, const char *name, char *data, size_t len) {
+    snprintf(path, 128, "%s/%s", dir, name);
+    FILE *f = fopen(path, "w");
+    if (f == NULL || fwrite(data, 1, len, f) != len) {
+        die("Failed to write corpus", 1);
+    }
+    fclose(f);
+    free(data);
+}
+
+/* benchmarks */
+
+static double bench_readbuf(const char *path) {
+    double t = now();
+    buffer *b = readbuf(path);
+    t = now() - t;
+    delbuf(b);
+    return t;
+}
+
+static double bench_writebufto(const char *path) {
+    buffer *b = readbuf(path);
+    double t = now();
+    writebufto(b, out_path);
+    t = now() - t;
+    delbuf(b);
+    return t;
+}
+
+static double bench_gen_syntax(const char *path) {
+    buffer *b = readbuf(path);
+    syntax_init(b);
+
+    double t = now();
+    gen_syntax(b, b->len, INT_MAX);
+    t = now() - t;
+
+    delbuf(b);
+    return t;
+}
+
+/* highlight the screen after a fold hiding nearly the whole file, which is skipped */
+static double bench_folded(const char *path) {
+    buffer *b = readbuf(path);
+    syntax_init(b);
+    fold_close(b, 10, b->len - 50);
+
+    double t = now();
+    gen_syntax(b, fold_line(b, 60), INT_MAX);
+    t = now() - t;
+
+    delbuf(b);
+    return t;
+}
+
+/* type some text near the top of the file, highlighting after every keystroke */
+static double typing(const char *path, const char *text) {
+    buffer *b = readbuf(path);
+    syntax_init(b);
+    gen_syntax(b, b->len, INT_MAX);
+
+    double t = now();
+    for (int i = 0; text[i] != '\0'; i++) {
+        baddch(b, text[i], 10, i);
+        gen_syntax(b, b->len, INT_MAX);
+    }
+    t = now() - t;
+
+    delbuf(b);
+    return t;
+}
+
+static double bench_typing(const char *path) {
+    return typing(path, "int x;");
+}
+
+/* opening a comment changes the highlighting of everything after it */
+static double bench_typing_comment(const char *path) {
+    return typing(path, "/*");
+}
+
+/* type into the middle of a long line, highlighting only what a screen of it shows */
+static double bench_typing_long(const char *path) {
+    buffer *b = readbuf(path);
+    syntax_init(b);
+    int x = b->lines[0]->len / 2;
+    b->sx = x - 40;
+    gen_syntax(b, 40, b->sx + 160);
+
+    const char *text = "int x;";
+    double t = now();
+    for (int i = 0; text[i] != '\0'; i++) {
+        baddch(b, text[i], 0, x + i);
+        gen_syntax(b, 40, b->sx + 160);
+    }
+    t = now() - t;
+
+    delbuf(b);
+    return t;
+}
+
+/* replace a long line with other text of the same length and highlight it again, which has to
+ * come out as if the new text had been highlighted from scratch */
+static double bench_replaced(const char *path) {
+    buffer *b = readbuf(path);
+    syntax_init(b);
+    gen_syntax(b, b->len, INT_MAX);
+
+    // every letter moved on one, so the keywords aren't and other words become them
+    line *l = b->lines[0];
+    char *text = malloc(l->len);
+    for (int x = 0; x < l->len; x++) {
+        char c = l->s[x];
+        text[x] = c >= 'a' && c < 'z' ? c + 1 : c;
+    }
+    int len = l->len;
+
+    double t = now();
+    breplace(b, 0, 1, text, len);
+    gen_syntax(b, b->len, INT_MAX);
+    t = now() - t;
+
+    buffer *fresh = readbuf(path);
+    breplace(fresh, 0, 1, text, len);
+    syntax_init(fresh);
+    gen_syntax(fresh, fresh->len, INT_MAX);
+    line *m = fresh->lines[0];
+    for (int x = 0; x < len; x++) {
+        attribute p = b->lines[0]->attrs[x], q = m->attrs[x];
+        if (p.type != q.type || p.enabled != q.enabled) {
+            die("A replaced line kept some of its old highlighting", 1);
+        }
+    }
+
+    free(text);
+    delbuf(fresh);
+    delbuf(b);
+    return t;
+}
+
+static double bench_regex(const char *path) {
+    static const char *patterns[] = { "\\d+:\\d+:\\d+", "ERROR.*$", "10\\.\\d+\\.\\d+", "[a-z]+\\[" };
+    buffer *b = readbuf(path);
+    long matches = 0;
+
+    // try every pattern at every position of the first lines, the way the highlighter does
+    double t = now();
+    for (int y = 0; y < b->len && y < 10000 * scale; y++) {
+        line *l = b->lines[y];
+        for (int x = 0; x < l->len; x++) {
+            for (int p = 0; p < 4; p++) {
+                matches += re_match(patterns[p], l->s + x) != -1;
+            }
+        }
+    }
+    t = now() - t;
+
+    delbuf(b);
+    return matches >= 0 ? t : 0;
+}
+
+/* a mix of insertions, deletions and line breaks at random positions, journaled if asked to */
+static double edits(const char *path, bool journaled) {
+    buffer *b = readbuf(path);
+    if (journaled) {
+        journal_start(b);
+    }
+    corpus_seed(42);
+
+    double t = now();
+    for (int i = 0; i < 100000 * scale; i++) {
+        int y = corpus_rand() % b->len;
+        int x = b->lines[y]->len > 0 ? corpus_rand() % b->lines[y]->len : 0;
+        int op = corpus_rand() % 20;
+
+        if (op < 12) {
+            baddch(b, 'a' + op, y, x);
+        } else if (op < 17) {
+            if (b->lines[y]->len > 0) {
+                bdelch(b, y, x);
+            }
+        } else if (op < 19) {
+            baddbreak(b, y, x);
+        } else if (b->len > 1) {
+            bdelbreak(b, y > 0 ? y : 1);
+        }
+    }
+    journal_flush(b, true);
+    t = now() - t;
+
+    delbuf(b);
+    return t;
+}
+
+static double bench_edits(const char *path) {
+    return edits(path, false);
+}
+
+/* the same edits, written to a journal and synced once at the end */
+static double bench_journal(const char *path) {
+    return edits(path, true);
+}
+
+/* move a cursor about a long line that isn't all ASCII, typing into it now and then */
+static double bench_columns(const char *path) {
+    buffer *b = readbuf(path);
+    line *l = b->lines[0];
+    baddstr(b, "\xc3\xa9\t", 3, 0, l->len / 2);
+    corpus_seed(7);
+    long sum = 0;
+
+    double t = now();
+    for (int i = 0; i < 100000 * scale; i++) {
+        int x = corpus_rand() % l->len;
+        if (i % 1000 == 0) {
+            baddch(b, 'a', 0, x);
+        }
+        sum += lbyte(l, lcolumn(l, x) + 1);
+    }
+    t = now() - t;
+
+    delbuf(b);
+    return sum >= 0 ? t : 0;
+}
+
+/* find the brackets around random places of a highlighted file, typing into it now and then */
+static double bench_nest(const char *path) {
+    buffer *b = readbuf(path);
+    syntax_init(b);
+    gen_syntax(b, b->len, INT_MAX);
+    corpus_seed(11);
+    long sum = 0;
+
+    double t = now();
+    for (int i = 0; i < 10000 * scale; i++) {
+        int y = corpus_rand() % b->len;
+        int x = b->lines[y]->len > 0 ? corpus_rand() % b->lines[y]->len : 0;
+        if (i % 100 == 0) {
+            baddch(b, 'a', y, x);
+        }
+
+        int oy, ox, cy, cx;
+        if (nest_around(b, y, x, INT_MAX, &oy, &ox, &cy, &cx)) {
+            sum += oy + cy;
+        }
+    }
+    t = now() - t;
+
+    delbuf(b);
+    return sum >= 0 ? t : 0;
+}
+
+/* complete the start of words at random places, typing into the file between completions */
+static double bench_words(const char *path) {
+    buffer *b = readbuf(path);
+    const word *found[16];
+    words_complete(b, "", 0, found, 16);
+    corpus_seed(13);
+    long sum = 0;
+
+    double t = now();
+    for (int i = 0; i < 10000 * scale; i++) {
+        int y = corpus_rand() % b->len;
+        int x = b->lines[y]->len > 0 ? corpus_rand() % b->lines[y]->len : 0;
+        if (i % 10 == 0) {
+            baddch(b, 'a' + i % 26, y, x);
+        }
+
+        line *l = b->lines[y];
+        int start = words_start(l, x);
+        int len = x - start < 3 ? x - start : 3;
+        if (len > 0) {
+            sum += words_complete(b, l->s + start, len, found, 16);
+        }
+    }
+    t = now() - t;
+
+    delbuf(b);
+    return sum >= 0 ? t : 0;
+}
+
+/* hash every line of a file, as is done when it is opened */
+static double bench_digest(const char *path) {
+    buffer *b = readbuf(path);
+
+    double t = now();
+    digest_save(b);
+    t = now() - t;
+
+    delbuf(b);
+    return t;
+}
+
+/* type characters and take them away again, asking whether the file still differs each time */
+static double bench_dirty(const char *path) {
+    buffer *b = readbuf(path);
+    digest_save(b);
+    corpus_seed(17);
+    long sum = 0;
+
+    double t = now();
+    for (int i = 0; i < 1000 * scale; i++) {
+        int y = corpus_rand() % b->len;
+        int x = b->lines[y]->len > 0 ? corpus_rand() % b->lines[y]->len : 0;
+        baddch(b, 'a', y, x);
+        sum += digest_dirty(b);
+        bdelch(b, y, x);
+        sum += digest_dirty(b);
+    }
+    t = now() - t;
+
+    delbuf(b);
+    return sum >= 0 ? t : 0;
+}
+
+/* edit lines all over the file, then read it back in as just the lines that differ */
+static double bench_reload(const char *path) {
+    buffer *b = readbuf(path);
+    digest_save(b);
+    corpus_seed(19);
+    for (int i = 0; i < 100 * scale; i++) {
+        int y = corpus_rand() % b->len;
+        baddch(b, 'a', y, 0);
+    }
+
+    double t = now();
+    int changed = diff_reload(b);
+    t = now() - t;
+
+    delbuf(b);
+    return changed >= 0 ? t : 0;
+}
+
+/* type at random places while diffing against the file, working out the hunks after each key */
+static double bench_difftyping(const char *path) {
+    buffer *b = readbuf(path);
+    digest_save(b);
+    diff_start(b);
+    corpus_seed(23);
+    long sum = 0;
+
+    double t = now();
+    for (int i = 0; i < 1000 * scale; i++) {
+        int y = corpus_rand() % b->len;
+        int x = b->lines[y]->len > 0 ? corpus_rand() % b->lines[y]->len : 0;
+        baddch(b, 'a', y, x);
+        int n;
+        diff_hunks(b, &n);
+        sum += n;
+    }
+    t = now() - t;
+
+    delbuf(b);
+    return sum >= 0 ? t : 0;
+}
+
+/* add lines to the end of a copy of the file, taking each batch in as it is noticed */
+static double bench_tail(const char *path) {
+    buffer *b = readbuf(path);
+    writebufto(b, out_path);
+    delbuf(b);
+    b = readbuf(out_path);
+    digest_save(b);
+    watch_start(b);
+    long sum = 0;
+
+    double t = now();
+    for (int i = 0; i < 100 * scale; i++) {
+        FILE *f = fopen(out_path, "a");
+        for (int j = 0; j < 10; j++) {
+            fprintf(f, "Jan  1 00:00:%02d host app[%d]: appended line %d\n", j, i, j);
+        }
+        fclose(f);
+
+        int lines;
+        watch_events(&b, 1);
+        sum += watch_update(b, &lines) == WATCH_APPENDED ? lines : 0;
+    }
+    t = now() - t;
+
+    delbuf(b);
+    return sum == 1000 * scale ? t : 0;
+}
+
+/* run the whole file through a command, as with Ctrl-P, putting its output back in place */
+static double bench_filter(const char *path, const char *command) {
+    buffer *b = readbuf(path);
+    char error[128];
+
+    double t = now();
+    int lines = filter_lines(b, 0, b->len, command, NULL, NULL, error, sizeof(error));
+    t = now() - t;
+
+    delbuf(b);
+    return lines >= 0 ? t : 0;
+}
+
+static double bench_filter_cat(const char *path) {
+    return bench_filter(path, "cat");
+}
+
+static double bench_filter_sort(const char *path) {
+    return bench_filter(path, "sort");
+}
+
+/* output */
+
+static void write_json(FILE *f) {
+    fprintf(f, "{\n  \"version\": 1,\n  \"scale\": %d,\n  \"reps\": %d,\n  \"results\": [\n", scale, reps);
+    for (int i = 0; i < nresults; i++) {
+        result *r = &results[i];
+        fprintf(f, "    { \"name\": \"%s\", \"median\": %.9f, \"min\": %.9f, \"bytes\": %zu }%s\n",
+                r->name, r->median, r->min, r->bytes, i < nresults - 1 ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+}
+
+/* compare against a previous run, returns the number of benchmarks slower than the threshold */
+static int compare(const char *filename, double threshold) {
+    FILE *f = fopen(filename, "r");
+    if (f == NULL) {
+        die("Failed to open baseline", 1);
+    }
+
+    int regressions = 0;
+    char line[512];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char name[64];
+        double median;
+        char *entry = strstr(line, "\"name\":");
+        if (entry == NULL || sscanf(entry, "\"name\": \"%63[^\"]\", \"median\": %lf", name, &median) != 2) {
+            continue;
+        }
+
+        for (int i = 0; i < nresults; i++) {
+            if (strcmp(results[i].name, name) != 0) {
+                continue;
+            }
+
+            double change = median > 0 ? (results[i].median / median - 1) * 100 : 0;
+            bool slower = change > threshold;
+            regressions += slower;
+            fprintf(stderr, "%-24s %10.3f ms -> %10.3f ms %+7.1f%%%s\n", name, median * 1e3,
+                    results[i].median * 1e3, change, slower ? "  REGRESSION" : "");
+        }
+    }
+    fclose(f);
+
+    return regressions;
+}
+
+static void usage() {
+    fprintf(stderr, "usage: jet_bench [-o out.json] [-b baseline.json] [-t percent] [-r reps] [-s scale] [-d syntaxdir]\n");
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    const char *output = NULL, *baseline = NULL;
+    double threshold = 10;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:b:t:r:s:d:h")) != -1) {
+        switch (opt) {
+            case 'o': output = optarg; break;
+            case 'b': baseline = optarg; break;
+            case 't': threshold = atof(optarg); break;
+            case 'r': reps = atoi(optarg); break;
+            case 's': scale = atoi(optarg); break;
+            case 'd': syntaxdir = optarg; break;
+            default: usage();
+        }
+    }
+    if (reps < 1 || scale < 1) {
+        usage();
+    }
+
+    // generate the corpus
+    strcpy(dir, "/tmp/jet_bench_XXXXXX");
+    if (mkdtemp(dir) == NULL) {
+        die("Failed to create scratch directory", 1);
+    }
+    corpus_seed(1);
+    char *c = corpus_c(20000 * scale, &c_len);
+    char *log = corpus_log(50000 * scale, &log_len);
+    char *min = corpus_minified(1000000 * scale, &min_len);
+    write_corpus(c_path, "source.c", c, c_len);
+    write_corpus(log_path, "system.log", log, log_len);
+    write_corpus(min_path, "bundle_min.c", min, min_len);
+    snprintf(out_path, sizeof(out_path), "%s/out", dir);
+
+    // the built in rules are used unless a directory of rule files is given
+    if (syntaxdir != NULL) {
+        syntax_readdir(syntaxdir);
+    }
+
+    bench("readbuf/c", bench_readbuf, c_path, c_len);
+    bench("readbuf/log", bench_readbuf, log_path, log_len);
+    bench("readbuf/minified", bench_readbuf, min_path, min_len);
+    bench("writebufto/c", bench_writebufto, c_path, c_len);
+    bench("writebufto/log", bench_writebufto, log_path, log_len);
+    bench("writebufto/minified", bench_writebufto, min_path, min_len);
+    bench("gen_syntax/c", bench_gen_syntax, c_path, c_len);
+    bench("gen_syntax/minified", bench_gen_syntax, min_path, min_len);
+    bench("gen_syntax/typing", bench_typing, c_path, c_len);
+    bench("gen_syntax/comment", bench_typing_comment, c_path, c_len);
+    bench("gen_syntax/longline", bench_typing_long, min_path, min_len);
+    bench("gen_syntax/replaced", bench_replaced, min_path, min_len);
+    bench("gen_syntax/folded", bench_folded, c_path, c_len);
+    bench("regex/log", bench_regex, log_path, log_len);
+    bench("edits/random", bench_edits, c_path, c_len);
+    bench("edits/journaled", bench_journal, c_path, c_len);
+    bench("digest/log", bench_digest, log_path, log_len);
+    bench("digest/dirty", bench_dirty, log_path, log_len);
+    bench("diff/reload", bench_reload, log_path, log_len);
+    bench("diff/typing", bench_difftyping, c_path, c_len);
+    bench("watch/tail", bench_tail, log_path, log_len);
+    bench("filter/cat", bench_filter_cat, log_path, log_len);
+    bench("filter/sort", bench_filter_sort, log_path, log_len);
+    bench("columns/longline", bench_columns, min_path, min_len);
+    bench("nest/c", bench_nest, c_path, c_len);
+    bench("nest/minified", bench_nest, min_path, min_len);
+    bench("words/c", bench_words, c_path, c_len);
+    bench("words/log", bench_words, log_path, log_len);
+
+    syntax_clearfiles();
+
+    // clean up the scratch files
+    unlink(c_path);
+    unlink(log_path);
+    unlink(min_path);
+    unlink(out_path);
+    rmdir(dir);
+
+    // report
+    if (output != NULL) {
+        FILE *f = fopen(output, "w");
+        if (f == NULL) {
+            die("Failed to open output file", 1);
+        }
+        write_json(f);
+        fclose(f);
+    } else {
+        write_json(stdout);
+    }
+
+    if (baseline != NULL && compare(baseline, threshold) > 0) {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,138 @@
+/*
+ * corpus.c
+ * Synthetic benchmark input
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "corpus.h"
+
+static unsigned long state = 1;
+
+/* xorshift, good enough for picking words */
+unsigned long corpus_rand() {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+void corpus_seed(unsigned long seed) {
+    state = seed != 0 ? seed : 1;
+}
+
+/* growable output string */
+typedef struct text {
+    char *s;
+    size_t len, cap;
+} text;
+
+static void tputs(text *t, const char *s) {
+    size_t n = strlen(s);
+    if (t->len + n + 1 > t->cap) {
+        t->cap = (t->len + n + 1) * 2;
+        t->s = realloc(t->s, t->cap);
+    }
+    memcpy(t->s + t->len, s, n + 1);
+    t->len += n;
+}
+
+#define PICK(a) (a[corpus_rand() % (sizeof(a) / sizeof(a[0]))])
+
+static const char *types[] = { "int", "char *", "unsigned long", "double", "struct node *", "bool" };
+static const char *names[] = { "count", "buf", "node", "len", "result", "next", "i", "offset", "value" };
+static const char *ops[] = { " + ", " - ", " * ", " == ", " < ", " != ", " & " };
+
+char *corpus_c(int lines, size_t *len) {
+    text t = { NULL, 0, 0 };
+    char line[256];
+    int fn = 0;
+
+    tputs(&t, "/*\n * generated.c\n * Synthetic source for benchmarking\n */\n\n");
+    tputs(&t, "#include <stdio.h>\n#include <stdlib.h>\n\n");
+
+    for (int y = 0; y < lines; ) {
+        // a function header
+        snprintf(line, sizeof(line), "/* computes the %s of the %s */\nstatic %s fn_%d(%s%s, int %s) {\n",
+                 PICK(names), PICK(names), PICK(types), fn++, PICK(types), PICK(names), PICK(names));
+        tputs(&t, line);
+        y += 2;
+
+        // and a body of statements
+        int body = 3 + corpus_rand() % 20;
+        for (int i = 0; i < body; i++, y++) {
+            switch (corpus_rand() % 6) {
+                case 0:
+                    snprintf(line, sizeof(line), "    %s %s = %s%s%lu;\n", PICK(types), PICK(names), PICK(names), PICK(ops), corpus_rand() % 1000);
+                    break;
+                case 1:
+                    snprintf(line, sizeof(line), "    if (%s%s%s) {\n        return %s;\n    }\n", PICK(names), PICK(ops), PICK(names), PICK(names));
+                    y += 2;
+                    break;
+                case 2:
+                    snprintf(line, sizeof(line), "    printf(\"%s is %%d\\n\", %s); // report the %s\n", PICK(names), PICK(names), PICK(names));
+                    break;
+                case 3:
+                    snprintf(line, sizeof(line), "    for (int %s = 0; %s < %lu; %s++) {\n        %s += sizeof(%s);\n    }\n", PICK(names), PICK(names), corpus_rand() % 64, PICK(names), PICK(names), PICK(types));
+                    y += 2;
+                    break;
+                case 4:
+                    snprintf(line, sizeof(line), "    /* %s and %s\n       are updated together */\n", PICK(names), PICK(names));
+                    y++;
+                    break;
+                default:
+                    snprintf(line, sizeof(line), "    %s = %s(%s, %s);\n", PICK(names), PICK(names), PICK(names), PICK(names));
+                    break;
+            }
+            tputs(&t, line);
+        }
+        tputs(&t, "}\n\n");
+        y += 2;
+    }
+
+    *len = t.len;
+    return t.s;
+}
+
+static const char *levels[] = { "INFO", "INFO", "INFO", "DEBUG", "WARN", "ERROR" };
+static const char *services[] = { "sshd", "kernel", "systemd", "nginx", "cron", "postgres" };
+static const char *events[] = {
+    "connection accepted from", "request completed for", "session opened for user",
+    "retrying upload to", "cache miss on", "failed to resolve"
+};
+
+char *corpus_log(int lines, size_t *len) {
+    text t = { NULL, 0, 0 };
+    char line[256];
+
+    for (int y = 0; y < lines; y++) {
+        snprintf(line, sizeof(line), "2018-%02lu-%02lu %02lu:%02lu:%02lu.%03lu %s %s[%lu]: %s 10.%lu.%lu.%lu port %lu\n",
+                 1 + corpus_rand() % 12, 1 + corpus_rand() % 28, corpus_rand() % 24, corpus_rand() % 60,
+                 corpus_rand() % 60, corpus_rand() % 1000, PICK(levels), PICK(services), corpus_rand() % 32768,
+                 PICK(events), corpus_rand() % 256, corpus_rand() % 256, corpus_rand() % 256, corpus_rand() % 65536);
+        tputs(&t, line);
+    }
+
+    *len = t.len;
+    return t.s;
+}
+
+char *corpus_minified(size_t bytes, size_t *len) {
+    text t = { NULL, 0, 0 };
+    char item[256];
+
+    tputs(&t, "var data={\"items\":[");
+    while (t.len < bytes) {
+        snprintf(item, sizeof(item), "{\"id\":%lu,\"%s\":\"%s\",\"tags\":[%lu,%lu],\"ok\":%s},",
+                 corpus_rand() % 100000, PICK(names), PICK(events), corpus_rand() % 10, corpus_rand() % 10,
+                 corpus_rand() % 2 ? "true" : "false");
+        tputs(&t, item);
+    }
+    tputs(&t, "{}]};function f(a){return a.items.length/*count*/;}");
+
+    *len = t.len;
+    return t.s;
+}
@@ -0,0 +1,28 @@
+/*
+ * corpus.h
+ * Generates synthetic, reproducible input for the benchmarks
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <stddef.h>
+
+/* small deterministic random number generator, so every run sees the same input */
+unsigned long corpus_rand();
+
+/* reset the generator */
+void corpus_seed(unsigned long seed);
+
+/* C source with functions, comments, strings and preprocessor lines. returns a malloc'd string
+ * and its length */
+char *corpus_c(int lines, size_t *len);
+
+/* log file lines with timestamps, levels and messages */
+char *corpus_log(int lines, size_t *len);
+
+/* minified JSON/JS with no line breaks at all */
+char *corpus_minified(size_t bytes, size_t *len);
+
+#endif
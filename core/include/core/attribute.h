@@ -21,9 +21,9 @@ enum attr_type {
     COLOR4
 };
 
-/* contains attribute type, whether it is turned on/off, and location in line */
+/* contains attribute type (an attr_type, kept small since lines hold one per character) and whether it is turned on/off */
 typedef struct attribute {
-    enum attr_type type;
+    unsigned char type;
     bool enabled;
 } attribute;
 
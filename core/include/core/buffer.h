@@ -9,16 +9,71 @@
 #include <stdbool.h>
 
 #include <core/line.h>
+#include <core/index.h>
+
+/* the highlighting state of a buffer, see syntax.h */
+struct syntax;
+
+/* the lines folded away, see fold.h */
+struct folds;
+
+/* how the lines nest, for matching brackets, see nest.h */
+struct nest;
+
+/* the words in the buffer, for completing them, see words.h */
+struct words;
+
+/* where edits are journaled until they are saved, see journal.h */
+struct journal;
+
+/* hashes of the lines, to tell whether they differ from the file's, see digest.h */
+struct digest;
+
+/* the hunks the buffer differs from its file in, see diff.h */
+struct diff;
+
+/* the watch kept on the file for changes made by something else, see watch.h */
+struct watch;
+
+/* something told about edits to a buffer as they happen, see bobserve */
+struct observer;
 
 typedef struct buffer {
     int y, x;
     int sy, sx;
-    int len;
+    int len, cap;
     line **lines;
     char *name;
     bool dirty;
+    int fd;
+    lineindex *index;
+    pool *pool;
+    struct syntax *syntax;
+    struct folds *folds;
+    struct nest *nest;
+    struct words *words;
+    struct journal *journal;
+    struct digest *digest;
+    struct diff *diff;
+    struct watch *watch;
+
+    // lines changed (text or attributes) since the damage was last cleared, none while dfirst > dlast
+    int dfirst, dlast;
+
+    struct observer *observers;
+    int nobservers;
 } buffer;
 
+/* called as n lines are added at y (or -n removed from there), or with n of 0 when line y's text changes */
+typedef void (*bobserver)(buffer *b, int y, int n, void *data);
+
+/* lines an index kept over a buffer (of hashes, words, ...) needs to look at again, in the order they
+ * were marked. bstale_note keeps them in step with the lines being added and removed */
+typedef struct bstale {
+    int *lines;
+    int n, cap;
+} bstale;
+
 /* used for movement */
 enum direction {
     UP, DOWN, LEFT, RIGHT
@@ -30,6 +85,18 @@ buffer *newbuf();
 /* clean up the buffer */
 void delbuf(buffer *b);
 
+/* returns line y of the buffer. lines of indexed (view) buffers are only valid until more lines
+ * are requested, so don't hold on to them */
+line *bline(buffer *b, int y);
+
+/* make the first len lines available, if the buffer has that many. indexed buffers discover their
+ * length lazily, everything else is always fully loaded */
+void bensure(buffer *b, int len);
+
+/* returns whether the buffer can be edited. indexed buffers are read-only, and the editing
+ * functions below do nothing for them */
+bool beditable(buffer *b);
+
 /* insert an empty line into the buffer */
 void baddline(buffer *b, int y);
 
@@ -42,7 +109,7 @@ void baddch(buffer *b, const char c, int y, int x);
 /* insert a string at the given location */
 void baddstr(buffer *b, const char *s, int len, int y, int x);
 
-/* insert an existing line at the end of the buffer */
+/* insert an existing line at the end of the buffer. the line must come from the buffer's pool */
 void bappendline(buffer *b, line *l);
 
 /* remove the character at the given location */
@@ -54,12 +121,48 @@ void baddbreak(buffer *b, int y, int x);
 /* remove a line break */
 void bdelbreak(buffer *b, int y);
 
-/* move to the nearest valid location to the given coordinates */
+/* replace n lines at y with the lines of text, len bytes of them split at each newline (a newline
+ * at the end doesn't start another). lines on both sides keep their place and have their text set,
+ * and the rest are added or removed all at once */
+void breplace(buffer *b, int y, int n, const char *text, int len);
+
+/* move to the nearest valid location to the given coordinates, x being a byte along the line. a
+ * line folded away moves the cursor to the line it is shown as */
 void bmoveto(buffer *b, int y, int x);
 
-/* move in the given direction */
+/* move to the nearest valid line to y, at the character drawn at column col */
+void bmovetocol(buffer *b, int y, int col);
+
+/* move in the given direction, a whole character at a time and over folded lines */
 void bmove(buffer *b, enum direction dir);
 
+/* note that lines first to last changed and need drawing again. adding or removing lines damages
+ * everything after them, as they all move */
+void bdamage(buffer *b, int first, int last);
+
+/* forget the damage, once everything showing the buffer has been redrawn */
+void bclrdamage(buffer *b);
+
+/* start or stop telling fn about every edit. unlike the damage, which is merged into one range,
+ * observers hear exactly which lines moved and changed */
+void bobserve(buffer *b, bobserver fn, void *data);
+void bunobserve(buffer *b, bobserver fn, void *data);
+
+/* tell the observers about an edit, the editing functions here do this themselves */
+void bnotify(buffer *b, int y, int n);
+
+/* line y needs looking at again */
+void bstale_mark(bstale *s, int y);
+
+/* follow a notification (see bobserve) to an index of len lines: a line changed is marked, those
+ * added are marked and those removed dropped, the lines after moving along. returns how many lines
+ * the index has to add at y (or remove, if negative), a removal running past its end only taking
+ * those it has. 0 for a change, or for an edit past its end, which it reads once it catches up */
+int bstale_note(bstale *s, int y, int n, int len);
+
+/* forget the lines marked, and free them */
+void bstale_free(bstale *s);
+
 /* name the buffer */
 void bname(buffer *b, const char *name);
 
@@ -0,0 +1,73 @@
+/*
+ * diff.h
+ * Diffing a buffer against its file on disk, and reloading it as just the lines that differ
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#ifndef DIFF_H
+#define DIFF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <core/buffer.h>
+
+/* lines y..y+n-1 of the buffer are in place of lines fy..fy+fn-1 of the file */
+typedef struct diffhunk {
+    int y, n;
+    int fy, fn;
+} diffhunk;
+
+/* how a line of the buffer compares with the file, as marked next to its number */
+enum diff_mark {
+    DIFF_SAME,
+    DIFF_CHANGED,
+    DIFF_ADDED,
+    DIFF_REMOVED  // the file has lines before this one the buffer doesn't, or after it if it's the last
+};
+
+/*
+ * The file is read as the hashes of its lines (see digest_line) rather than
+ * as lines, and diffed against the hashes the buffer keeps of its own, so a
+ * diff costs a pass over the file and none over the buffer. Lines only one
+ * side has are taken out first, then what is left is diffed with Myers'
+ * algorithm, after the lines both start and end with. After edits, only the
+ * lines edited and the hunks touching them are diffed again, between the
+ * lines around them that were the same, so typing costs as much as the hunks
+ * it's in whatever the size of the file.
+ */
+typedef struct diff {
+    // the hashes of the file's lines when it was last read
+    uint64_t *lines;
+    int len;
+
+    // the hunks turning the file into the buffer, worked out again after edits
+    diffhunk *hunks;
+    int nhunks;
+
+    // the lines edited since, from..to-1, and how many were added less those removed. while whole,
+    // the hunks are worked out again from scratch
+    bool stale, whole;
+    int from, to, shift;
+} diff;
+
+/* start diffing a buffer against its file, or read the file again if it already is. returns how
+ * many hunks differ, -1 if the file can't be read */
+int diff_start(buffer *b);
+
+/* stop diffing a buffer */
+void diff_end(buffer *b);
+
+/* work out the hunks again if the buffer was edited since, damaging the lines whose marks
+ * changed. returns the hunks, n of them */
+const diffhunk *diff_hunks(buffer *b, int *n);
+
+/* how line y compares with the file, DIFF_SAME if the buffer isn't being diffed */
+enum diff_mark diff_mark(buffer *b, int y);
+
+/* read the buffer's file again, making only the edits that turn the buffer into it so the lines
+ * that didn't change keep their highlighting, folds and so on. returns how many lines changed, -1
+ * if the file can't be read */
+int diff_reload(buffer *b);
+
+#endif
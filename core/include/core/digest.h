@@ -0,0 +1,59 @@
+/*
+ * digest.h
+ * Hashes of every line of a buffer, to tell whether it really differs from its file
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#ifndef DIGEST_H
+#define DIGEST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <core/buffer.h>
+
+/*
+ * Each line is hashed (see hash_block) and the hashes summed, which lines
+ * moving doesn't change, so a buffer whose sum or length differs from the
+ * saved version's is told apart in O(1). Only when they agree are the hashes
+ * compared line by line, once after each edit, to be sure. A line is hashed
+ * again only after it is edited, and the lines of the saved version are kept
+ * as hashes as well, for diffing against without reading the text again.
+ */
+typedef struct digest {
+    // the hash of each line so far, and their sum
+    int len, cap;
+    uint64_t *lines;
+    uint64_t sum;
+
+    // lines whose text changed since their hash was taken
+    bstale stale;
+
+    // the hashes of the lines as they were last saved, and their sum
+    uint64_t *saved;
+    int nsaved;
+    uint64_t savedsum;
+
+    // whether the lines were the saved ones when last compared, -1 if they have changed since
+    int same;
+} digest;
+
+/* the hash of a line of text */
+uint64_t digest_line(const char *s, int len);
+
+/* take the buffer's lines as they are now as the saved version, starting to hash them if this is
+ * the first time. viewed files, never being changed, aren't */
+void digest_save(buffer *b);
+
+/* stop hashing a buffer's lines */
+void digest_end(buffer *b);
+
+/* whether the buffer's text differs from the version last saved. b->dirty is only whether it was
+ * edited since, and is cleared if it turns out not to differ */
+bool digest_dirty(buffer *b);
+
+/* the hashes of the buffer's lines as they are now, len of them, and of those saved in nsaved.
+ * false if the buffer isn't being hashed */
+bool digest_lines(buffer *b, const uint64_t **lines, int *len, const uint64_t **saved, int *nsaved);
+
+#endif
@@ -12,6 +12,18 @@
 /* opens a file using the given filename, and parses it into a buffer */
 buffer *readbuf(const char *filename);
 
+/* maps a file for read-only viewing. only a sparse line index is kept, so arbitrarily large files
+ * can be opened in constant time and memory. returns NULL if the file cannot be mapped */
+buffer *viewbuf(const char *filename);
+
+/* wraps an open, non-seekable descriptor (pipe, fifo, stdin) in a new buffer. the descriptor is
+ * switched to non-blocking mode and owned by the buffer from then on */
+buffer *openstream(int fd);
+
+/* appends whatever input is currently available on the buffer's stream without blocking. returns
+ * the number of bytes read (possibly 0), or -1 once the stream has ended and been closed */
+long readstream(buffer *b);
+
 /* attempts to write a buffer to the given file. returns -1 if it fails, otherwise the number of
  * bytes written */
 int writebufto(buffer *b, const char *filename);
@@ -0,0 +1,43 @@
+/*
+ * filter.h
+ * Running lines of a buffer through an external command, and putting back what it outputs
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <core/buffer.h>
+
+/* bytes of lines gathered into each write to the command, what a pipe holds. copying them together
+ * costs less than handing writev an iovec for each line */
+#define FILTER_BLOCK 65536
+
+/* most bytes of output taken from a command, which is killed once it writes more. its errors are
+ * only kept up to FILTER_BLOCK, the first line of them being all that is shown */
+#define FILTER_MAX (256 << 20)
+
+/* how often (ms) the caller is asked whether to give up on a command still running */
+#define FILTER_TICK 100
+
+/* asked every FILTER_TICK ms while a command runs, which is killed once it returns true */
+typedef bool (*filter_stopfn)(void *data);
+
+/*
+ * The lines are written to the command's input a pipe's worth at a time,
+ * and its output and errors are read at the same time, so a command with
+ * more to say than a pipe holds doesn't stall waiting for the editor to
+ * finish writing. Once it exits, the lines it gave back as they were are
+ * left alone, and the rest are replaced in one breplace. Only lines that
+ * actually changed are highlighted again. A command that never finishes, or
+ * never stops writing, is killed (with anything it started) when stop says
+ * so or its output passes FILTER_MAX, and the buffer is left as it was.
+ */
+
+/* run command with sh, its input lines y..y+n-1 of the buffer, and replace them with its output.
+ * returns how many lines that was, or -1 if it couldn't be run, didn't exit with 0 or was stopped,
+ * the buffer being left as it was and error set to the first line it wrote to stderr (or why it
+ * failed). stop(data) is asked whether to give up on it, unless stop is NULL */
+int filter_lines(buffer *b, int y, int n, const char *command, filter_stopfn stop, void *data, char *error, int size);
+
+#endif
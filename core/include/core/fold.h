@@ -0,0 +1,77 @@
+/*
+ * fold.h
+ * Folding ranges of lines away behind the first of them
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#ifndef FOLD_H
+#define FOLD_H
+
+#include <stdbool.h>
+
+#include <core/buffer.h>
+
+/* lines start + 1 to end, hidden behind line start */
+typedef struct fold {
+    int start, end;
+} fold;
+
+/*
+ * The folds closed in a buffer. A fold can hold others, which stay closed
+ * inside it and show again as they were once it is opened, so they form a
+ * tree. Only the outermost folds hide anything, and those are kept apart in
+ * order with the lines hidden before each, so the row a line is shown on and
+ * the line on a row are both a binary search over them: O(log folds).
+ */
+typedef struct folds {
+    // every closed fold in order of start, one holding others coming before them
+    fold *f;
+    int len, cap;
+
+    // the outermost, and how many lines the ones before each hide
+    fold *top;
+    int *before;
+    int ntop, topcap;
+
+    // counts every change to what is hidden, for anything laying lines out to notice
+    int version;
+} folds;
+
+/* close a fold hiding lines start + 1 to end. folds inside it stay closed within it, but one
+ * crossing its edge means it can't be. returns whether it closed */
+bool fold_close(buffer *b, int start, int end);
+
+/* open the fold shown as line y, whatever was closed inside it showing again. returns whether
+ * there was one */
+bool fold_open(buffer *b, int y);
+
+/* open every fold hiding line y */
+void fold_reveal(buffer *b, int y);
+
+/* open every fold and stop following the buffer's edits */
+void fold_clear(buffer *b);
+
+/* the changes to what is hidden so far, to tell when lines have to be laid out again */
+int fold_version(buffer *b);
+
+/* the line y is shown as, the first line of the outermost fold hiding it if it is hidden */
+int fold_shown(buffer *b, int y);
+
+/* the last line shown as line y, the end of its fold if it is the first line of one */
+int fold_last(buffer *b, int y);
+
+/* the row of line y among the lines shown, a hidden line being on the row of its fold */
+int fold_row(buffer *b, int y);
+
+/* the line shown on a row, rows past the end of the buffer taking a line each */
+int fold_line(buffer *b, int row);
+
+/*
+ * work out what to fold at line y: the block opened by a brace on it, otherwise
+ * an encapsulation (such as a block comment) it opens, otherwise the innermost
+ * block around it, braces being matched as nest.h does. returns whether there
+ * was anything
+ */
+bool fold_find(buffer *b, int y, int *start, int *end);
+
+#endif
@@ -0,0 +1,23 @@
+/*
+ * hash.h
+ * Non-cryptographic hashing of byte strings
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* starting value for a hash, also what hashing nothing gives */
+#define HASH_SEED 0xcbf29ce484222325ULL
+
+/* hash len bytes, continuing from h (pass HASH_SEED to start a new hash) */
+uint64_t hash_bytes(uint64_t h, const void *data, size_t len);
+
+/* hash len bytes eight at a time, several times quicker than hash_bytes for long strings. the
+ * hashes aren't the same as hash_bytes gives */
+uint64_t hash_block(const void *data, size_t len);
+
+#endif
@@ -0,0 +1,64 @@
+/*
+ * index.h
+ * Sparse line index over a read-only, memory mapped file
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <core/line.h>
+
+/* lines between two checkpoints */
+#define INDEX_STRIDE 1024
+
+/* number of materialized lines kept around at once */
+#define INDEX_CACHE 256
+
+/*
+ * only the offset of every INDEX_STRIDE-th line is remembered, and the index is extended lazily
+ * as lines further into the file are requested. lines in between are found by scanning forward
+ * from the closest checkpoint (or the last lookup), so memory stays O(lines / INDEX_STRIDE)
+ */
+typedef struct lineindex {
+    int fd;
+    const char *map;
+    size_t size;
+
+    // checkpoints, marks[i] is the offset of line i * INDEX_STRIDE
+    size_t *marks;
+    int nmarks, cap;
+
+    // how far the file has been counted so far
+    int known;
+    size_t scanned;
+    bool complete;
+
+    // most recent lookup, makes walking through consecutive lines cheap
+    int lasty;
+    size_t lastoff;
+
+    // materialized lines, line y in slot y % INDEX_CACHE. a slot is reused as is when line y is
+    // asked for again, and evicted (its line overwritten) when another line mapping to it is
+    // asked for. extending the index leaves them alone
+    line *cache[INDEX_CACHE];
+    int cachey[INDEX_CACHE];
+} lineindex;
+
+/* maps the given file and creates an empty index for it. returns NULL on failure */
+lineindex *newindex(const char *filename);
+
+/* unmaps the file and frees the index */
+void delindex(lineindex *ix);
+
+/* counts lines until at least len of them are known, or the end of the file is reached */
+void ixextend(lineindex *ix, int len);
+
+/* returns line y, which must already be known. the line is owned by the index and is overwritten
+ * by the next request for a line in the same slot, y +/- a multiple of INDEX_CACHE, however soon */
+line *ixline(lineindex *ix, int y);
+
+#endif
@@ -7,6 +7,15 @@
 #include <core/buffer.h>
 #include <core/file.h>
 #include <core/syntax.h>
+#include <core/fold.h>
+#include <core/nest.h>
+#include <core/words.h>
+#include <core/journal.h>
+#include <core/digest.h>
+#include <core/diff.h>
+#include <core/watch.h>
+#include <core/filter.h>
+#include <core/mem.h>
 
 /* fatal error, print a message and terminate the program */
 void die(const char *error, int code);
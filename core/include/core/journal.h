@@ -0,0 +1,84 @@
+/*
+ * journal.h
+ * Journaling edits to a file next to it, so unsaved changes survive a crash
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <core/buffer.h>
+
+/* how long (ms) edits wait to be written to the journal, so they go in batches */
+#define JOURNAL_DELAY 1000
+
+/* what journal_flush returns when the journal couldn't be written */
+#define JOURNAL_FAILED -2
+
+/* the edits a journal holds */
+enum journal_op {
+    JOURNAL_ADDLINE,
+    JOURNAL_DELLINE,
+    JOURNAL_ADDSTR,
+    JOURNAL_DELCH,
+    JOURNAL_ADDBREAK,
+    JOURNAL_DELBREAK,
+    JOURNAL_REPLACE  // the column being how many lines the text replaces
+};
+
+/* which version of a file a journal's edits are to */
+typedef struct journal_file {
+    int64_t size, sec, nsec, ino;
+} journal_file;
+
+/*
+ * Every edit is added to the journal as a record of a byte for the edit and
+ * the line, column and text it was made with, so writing the journal costs as
+ * much as what was typed whatever the size of the file. Records wait in memory
+ * to be written and synced in batches, at most JOURNAL_DELAY apart. The journal
+ * is only made once there's something to write, and goes once the buffer is
+ * saved or closed. A journal left by a crash starts with the size, time and
+ * inode of the file it was kept for, and is only replayed over that file. One
+ * that couldn't be written to is kept as it is, the edits in it still being
+ * recoverable, and nothing more goes in it until the buffer is saved.
+ */
+typedef struct journal {
+    // .name.journal next to the file, its descriptor (-1 until it is made) and what it is of
+    char *path;
+    int fd;
+    journal_file of;
+
+    // records waiting to be written, and when the first of them was added
+    char *pending;
+    int len, cap;
+    double since;
+
+    // whether a write failed, edits not being added until the journal starts again
+    bool failed;
+} journal;
+
+/*
+ * start journaling edits to a buffer read from a file, first replaying the
+ * journal a crash left if it is of the file as it is now. returns how many
+ * edits were recovered, or -1 if the journal was of another version of the
+ * file, in which case it is moved aside to .name.journal.old
+ */
+int journal_start(buffer *b);
+
+/* stop journaling a buffer, its journal going, as the edits were saved or given up */
+void journal_end(buffer *b);
+
+/* note an edit, from the editing functions in buffer.c */
+void journal_edit(buffer *b, enum journal_op op, int y, int x, const char *s, int len);
+
+/* write the edits waiting for JOURNAL_DELAY, or all of them if now. returns how long (ms) until
+ * the rest are due, -1 if none are waiting, or JOURNAL_FAILED if they couldn't be written */
+int journal_flush(buffer *b, bool now);
+
+/* the buffer was written to its file, which has every edit so far, so the journal starts again */
+void journal_saved(buffer *b);
+
+#endif
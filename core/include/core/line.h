@@ -10,16 +10,59 @@
 #include <stdbool.h>
 
 #include <core/attribute.h>
+#include <core/pool.h>
 
+/* a point along a long line that highlighting can pick up from, instead of the start of the line */
+typedef struct lmark {
+    int x;
+    signed char enc;    // the encapsulation open there, -1 for none
+    attribute attr;     // the attribute in effect there
+} lmark;
+
+/* the column a byte along a line is drawn at, see lcolumn */
+typedef struct lstop {
+    int x, col;
+} lstop;
+
+/* stops are kept every LCOL_STEP bytes or so along lines that aren't plain ASCII */
+#define LCOL_STEP 64
+
+/*
+ * what only some lines need, allocated the first time they do. it is kept apart
+ * so the line itself stays small, there being one for every line of a file
+ */
+typedef struct lside {
+    // marks in order of x, none before the first chunk of the line
+    lmark *marks;
+    int nmarks, markcap;
+
+    // the line is measured up to byte x, at column col, with stops along the way (see line.c)
+    lstop *stops;
+    int nstops, stopcap;
+    int x, col;
+} lside;
+
+/* s and attrs (once highlighted) both have room for cap characters, including the terminator */
 typedef struct line {
-    int len;
+    int len, cap;
     char *s;
     attribute *attrs;
-    bool needs_update;
+    pool *pool;
+
+    // highlighting (see syntax.c): attributes are worked out up to hlvalid, given the line starts in
+    // encapsulation hlstart, though hldirty..hldirtyend changed since. hlend is what's open at the end
+    int hlvalid, hldirty, hldirtyend;
+    signed char hlstart, hlend;
+
+    // whether every byte is printable ASCII, and so a column of its own (-1 until checked)
+    signed char plain;
+
+    // highlighting marks and columns measured, NULL until there are any
+    lside *side;
 } line;
 
-/* create a new empty line */
-line *newline();
+/* create a new empty line, allocated from the given pool or the heap if it is NULL */
+line *newline(pool *p);
 
 /* free a line */
 void delline(line *l);
@@ -30,8 +73,44 @@ void lresize(line *l, int len);
 /* add an attribute to the line */
 void laddattr(line *l, attribute a, int i);
 
-/* clear the attributes from the line */
-void lclrattrs(line *l);
+/* clear the attributes of characters from..to-1 */
+void lclrattrs(line *l, int from, int to);
+
+/* the attribute in effect just before x, worked out from the nearest mark */
+attribute lattrat(line *l, int x);
+
+/* how many highlighting marks the line has */
+int lnmarks(line *l);
+
+/* insert a mark at index i of the marks, or remove n of them from there */
+void laddmark(line *l, lmark m, int i);
+void ldelmarks(line *l, int i, int n);
+
+/* the line's highlighting is clean again, up to hlvalid */
+void lclrdirty(line *l);
+
+/* replace the whole text of a line, forgetting how it was highlighted */
+void lset(line *l, const char *s, int len);
+
+/* whether the line is all printable ASCII, every byte then being a column */
+bool lplain(line *l);
+
+/* the column the character at (or around) byte x starts at */
+int lcolumn(line *l, int x);
+
+/* the byte the character drawn at column col starts at, combining marks going with the character
+ * before them. the end of the line if it is narrower */
+int lbyte(line *l, int col);
+
+/* how many columns the whole line takes */
+int lwidth(line *l);
+
+/* the start of the character byte x is in */
+int lstart(line *l, int x);
+
+/* the start of the character after the one at x, or before it */
+int lnext(line *l, int x);
+int lprev(line *l, int x);
 
 /* add a character to the line */
 void laddch(line *l, const char c, int i);
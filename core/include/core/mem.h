@@ -0,0 +1,53 @@
+/*
+ * mem.h
+ * Allocator interface used by the core, with optional per-subsystem accounting
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#ifndef MEM_H
+#define MEM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* subsystems allocations are attributed to */
+enum mem_tag {
+    MEM_BUFFER,
+    MEM_LINE,
+    MEM_SYNTAX,
+    MEM_FILE,
+    MEM_TAGS
+};
+
+/* a pluggable allocator. ctx is passed through untouched */
+typedef struct allocator {
+    void *(*alloc)(size_t size, void *ctx);
+    void *(*realloc)(void *ptr, size_t size, void *ctx);
+    void (*free)(void *ptr, void *ctx);
+    void *ctx;
+} allocator;
+
+/* counters for one subsystem. only maintained when built with JET_MEM_STATS */
+typedef struct mem_stats {
+    unsigned long calls;
+    size_t bytes;
+    size_t peak;
+} mem_stats;
+
+/* route all core allocations through the given allocator, or back to libc if NULL. must be
+ * called before anything has been allocated */
+void mem_sethooks(const allocator *a);
+
+/* returns the counters for the given subsystem */
+mem_stats mem_stat(enum mem_tag tag);
+
+/* returns a printable name for the subsystem */
+const char *mem_name(enum mem_tag tag);
+
+/* allocation functions, these behave like their libc counterparts */
+void *mem_alloc(enum mem_tag tag, size_t size);
+void *mem_calloc(enum mem_tag tag, size_t n, size_t size);
+void *mem_realloc(enum mem_tag tag, void *ptr, size_t size);
+void mem_free(enum mem_tag tag, void *ptr);
+
+#endif
@@ -0,0 +1,102 @@
+/*
+ * nest.h
+ * Matching brackets through a summary of how every line nests, kept up to date with edits
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#ifndef NEST_H
+#define NEST_H
+
+#include <stdbool.h>
+
+#include <core/buffer.h>
+
+/* the kinds of bracket, each matched on its own */
+enum nest_kind {
+    NEST_PAREN,
+    NEST_SQUARE,
+    NEST_BRACE,
+    NEST_KINDS
+};
+
+/* lines summed together at the bottom of the tree, groups being split in two past twice as many */
+#define NEST_GROUP 32
+
+/* lines longer than this many bytes are summed a chunk of this many at a time as well */
+#define NEST_CHUNK 1024
+
+/* how a stretch of text nests: brackets of each kind it closes that were open before it, and
+ * those it leaves open after it */
+typedef struct nestsum {
+    int close[NEST_KINDS], open[NEST_KINDS];
+} nestsum;
+
+/* a chunk of a long line, with the attribute in effect where it starts */
+typedef struct nestchunk {
+    nestsum sum;
+    attribute attr;
+} nestchunk;
+
+/* the chunks of a long line, and the characters from to to - 1 changed since they were summed */
+typedef struct nestlong {
+    int y;
+    nestchunk *chunks;
+    int nchunks;
+    int from, to;
+} nestlong;
+
+/*
+ * Every line of a buffer is summed up, and groups of about NEST_GROUP lines
+ * are summed in a tree above them, so the line where a bracket is closed (or
+ * the one still open around a place) is found by walking the tree: O(log
+ * lines), plus a chunk or a group of lines at the bottom. The tree counts the
+ * lines of each group as well, so lines added or removed only change the
+ * groups they are in and the path above them. A group grown too big is split
+ * into an empty one next to it, the lines only being laid out again when there
+ * isn't one nearby. Brackets are told apart from text the way the highlighter
+ * tokenized it, those in strings and comments not counting, and a line is
+ * summed again when it is edited or highlighted again. Viewed files (see
+ * index.h) aren't summed, being walked a line at a time.
+ */
+typedef struct nest {
+    // a summary of each line so far, and the chunks of those that are long, in order of line
+    int len, cap;
+    nestsum *lines;
+    nestlong *longs;
+    int nlongs, longcap;
+
+    // lines changed since the last sync
+    bstale stale;
+
+    // tree[size + g] sums group g, a run of counts[size + g] lines (none for a group left empty),
+    // the groups being in order of line. tree[i] sums tree[2i] and tree[2i + 1] and counts[i] their
+    // lines, tree[1] being everything
+    nestsum *tree;
+    int *counts;
+    int size;
+
+    // whether the lines are to be laid out in groups again on the next sync
+    bool relayout;
+} nest;
+
+/* stop summing a buffer's lines */
+void nest_end(buffer *b);
+
+/* characters from to to - 1 of line y were highlighted again, which may have changed which of its
+ * brackets count */
+void nest_stale(buffer *b, int y, int from, int to);
+
+/* the bracket matching the one at (y, x), in my and mx (my of -1 if it isn't matched before line
+ * limit, lines from there on not being highlighted to find it). false if there isn't a bracket at
+ * (y, x) */
+bool nest_match(buffer *b, int y, int x, int limit, int *my, int *mx);
+
+/* the innermost bracket of a kind still open at (y, x), just before the character there. false
+ * if there isn't one */
+bool nest_open(buffer *b, enum nest_kind kind, int y, int x, int *oy, int *ox);
+
+/* the innermost brackets of any kind around (y, x): where the block opens, and where it closes (cy
+ * of -1 if it isn't closed before line limit). false if (y, x) isn't in any */
+bool nest_around(buffer *b, int y, int x, int limit, int *oy, int *ox, int *cy, int *cx);
+
+#endif
@@ -0,0 +1,50 @@
+/*
+ * pool.h
+ * Slab allocator for lines and their contents
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+/* number of size classes, requests above the largest one go to the heap */
+#define POOL_CLASSES 16
+
+/* size of each slab carved into objects */
+#define POOL_CHUNK (1 << 20)
+
+/*
+ * objects up to the largest size class are carved out of big chunks and recycled through per
+ * class free lists. larger ones are allocated separately but still tracked by the pool, so
+ * everything it handed out is released in one go by delpool()
+ */
+typedef struct pool {
+    struct poolchunk *chunks;
+    char *next;
+    size_t left;
+
+    void *free[POOL_CLASSES];
+    struct poolbig *big;
+} pool;
+
+/* create a new, empty pool */
+pool *newpool();
+
+/* release the pool along with everything allocated from it */
+void delpool(pool *p);
+
+/* returns the number of bytes actually reserved for a request of the given size */
+size_t psize(size_t size);
+
+/* allocate size bytes */
+void *palloc(pool *p, size_t size);
+
+/* grow or shrink an allocation, keeping its contents. size is what it was allocated with */
+void *prealloc(pool *p, void *ptr, size_t size, size_t newsize);
+
+/* give an allocation of the given size back to the pool */
+void pfree(pool *p, void *ptr, size_t size);
+
+#endif
@@ -33,15 +33,46 @@
  *
  */
 
+#ifndef REGEX_H
+#define REGEX_H
+
+#define MAX_REGEXP_OBJECTS      30    /* Max number of regex symbols in expression. */
+#define MAX_CHAR_CLASS_LEN      40    /* Max length of character-class buffer in.   */
+
+/* One symbol of a compiled pattern. Character classes live in the ccl buffer
+ * of the same re_prog, ccl is the distance in bytes from the symbol to them. */
+typedef struct regex_t
+{
+    unsigned char  type;   /* CHAR, STAR, etc.                      */
+    union
+    {
+        unsigned char  ch;   /*      the character itself             */
+        unsigned char  ccl;  /*  OR  offset of characters in class    */
+    };
+} regex_t;
+
+/* A compiled pattern. It holds no pointers, so it can be copied around or
+ * mapped straight from a file. */
+typedef struct re_prog
+{
+    regex_t        re[MAX_REGEXP_OBJECTS];
+    unsigned char  ccl[MAX_CHAR_CLASS_LEN];
+} re_prog;
+
 /* Typedef'd pointer to get abstract datatype. */
-typedef struct regex_t* re_t;
+typedef const re_prog* re_t;
 
-/* Compile regex string pattern to a regex_t-array. */
+/* Compile regex string pattern into a static re_prog, NULL if it is invalid. */
 re_t re_compile(const char* pattern);
 
-/* Find matches of the compiled pattern inside text. */
+/* Compile regex string pattern into prog. Returns -1 if it is invalid, prog then never matches. */
+int  re_compileto(re_prog* prog, const char* pattern);
+
+/* Find matches of the compiled pattern inside text. Safe to call from several threads at once. */
 int  re_matchp(re_t pattern, const char* text);
 
-/* Find matches of the txt pattern inside text (will compile automatically first). */
+/* Find matches of the txt pattern inside text (will compile automatically first, into the static re_prog). */
 int  re_match(const char* pattern, const char* text);
 
+#endif
+
@@ -0,0 +1,126 @@
+/*
+ * rules.h
+ * Syntax rules compiled from .jsr files into a flat blob that can be cached on disk and mapped back in
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#ifndef RULES_H
+#define RULES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <core/attribute.h>
+#include <core/regex.h>
+
+#define RULES_MAGIC 0x3172736a
+#define RULES_VERSION 2
+
+/*
+ * A blob holds no pointers. Everything is found through 32 bit offsets: from
+ * the start of the blob in the header and file type table, and from the
+ * ruleset itself inside a ruleset, so a ruleset can be used on its own.
+ */
+
+/* a regular expression rule */
+typedef struct rules_re {
+    re_prog prog;
+    uint8_t type;
+} rules_re;
+
+/* an encapsulation, like a block comment: everything from begin up to end */
+typedef struct rules_enc {
+    re_prog begin, end;
+    uint8_t type;
+} rules_enc;
+
+/* a keyword, word is a null terminated string */
+typedef struct rules_key {
+    uint32_t word;
+    uint16_t len;
+    uint8_t type;
+} rules_key;
+
+/* the rules for one language */
+typedef struct ruleset {
+    uint32_t name;
+
+    // open addressed hash table of keymask + 1 slots for keywords that are plain words (empty slots have len 0)
+    uint32_t keys, keymask;
+
+    // any other keywords, tried in order
+    uint32_t others, nothers;
+
+    uint32_t regs, nregs;
+    uint32_t encs, nencs;
+} ruleset;
+
+/* what a file type key is matched against */
+enum rules_kind {
+    RULES_EXT,      // the extension after the last dot of the file name
+    RULES_NAME,     // the whole file name, without its directory
+    RULES_INTERP,   // the interpreter named by a #! line
+    RULES_LANG      // the language itself, as named by a modeline
+};
+
+/* a file type key and the ruleset it uses (empty slots have key 0) */
+typedef struct rules_type {
+    uint32_t key, set;
+    uint8_t kind;
+} rules_type;
+
+/* a file the blob was compiled from, to tell when it is out of date */
+typedef struct rules_source {
+    uint32_t path;
+    int64_t mtime, size;
+    uint64_t hash;
+} rules_source;
+
+typedef struct rules_header {
+    uint32_t magic, version;
+
+    // size of the blob and hash of everything from the header up to the sources, which come last
+    uint64_t size, hash;
+
+    // the directory the rules were compiled from and its modification time
+    uint32_t dir;
+    int64_t mtime;
+
+    uint32_t sources, nsources;
+
+    // open addressed hash table of typemask + 1 slots for file types
+    uint32_t types, typemask;
+} rules_header;
+
+/* the rules bundled in share/jet/syntax, compiled into the library at build time */
+extern const char rules_builtin[];
+extern const size_t rules_builtin_size;
+
+/* compile every rule file in a directory into a new blob (freed with mem_free), NULL if it can't be read */
+char *rules_build(const char *dirpath, size_t *size);
+
+/* check that size bytes look like an intact blob */
+bool rules_check(const char *blob, size_t size);
+
+/*
+ * check that a blob was built from dirpath and nothing there changed since. If
+ * fd isn't -1 it is the file the blob was loaded from, and sources that were
+ * only touched (same contents, new time) are updated there.
+ */
+bool rules_current(const char *blob, const char *dirpath, int fd);
+
+/* the ruleset for len characters of key of the given kind, NULL if there isn't one */
+const ruleset *rules_find(const char *blob, enum rules_kind kind, const char *key, int len);
+
+/* the name of the language a ruleset is for */
+const char *rules_name(const ruleset *r);
+
+/* the regular expression and encapsulation rules of a ruleset */
+const rules_re *rules_regs(const ruleset *r);
+const rules_enc *rules_encs(const ruleset *r);
+
+/* the length and type of a keyword at s[i] of a len character string, -1 if there is none */
+int rules_keyword(const ruleset *r, const char *s, int i, int len, enum attr_type *type);
+
+#endif
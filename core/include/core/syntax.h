@@ -6,20 +6,55 @@
 #pragma once
 
 #include <core/buffer.h>
+#include <core/rules.h>
 
 #include <stdio.h>
 #include <stdbool.h>
 
-/* populates the list of supported file types */
+/* adds the user's rule files (from ~/.config/jet/syntax) on top of the built in ones */
 void syntax_readfiles();
+
+/* adds the file types described by the rule files in the given directory, loaded once a buffer needs them */
+void syntax_readdir(const char *dirpath);
 void syntax_clearfiles();
 
-/* initializes syntax rules based on filetype */
+/*
+ * The highlighting of one buffer. Its ruleset is shared with every other buffer
+ * of the same language and never changes once compiled, so gen_syntax can run on
+ * different buffers at the same time. Adding rules and picking them for a buffer
+ * (syntax_init) still have to happen on one thread.
+ */
+typedef struct syntax {
+    const ruleset *rules;
+
+    // lines before this are highlighted all the way along and agree with each other
+    int clean;
+} syntax;
+
+/*
+ * Long lines are highlighted a chunk at a time. Every SYNTAX_CHUNK or so
+ * characters the highlighter leaves a mark (see line.h) it can pick up from
+ * later, so a line only needs highlighting as far along as it is seen, and an
+ * edit only from the mark before it until the highlighting agrees again with
+ * a mark after it. Rules are matched as though the line started at a mark, so
+ * a match reaching back across one isn't noticed until it is highlighted from
+ * further back.
+ */
+#define SYNTAX_CHUNK 4096
+
+/* picks the syntax rules for a buffer by modeline, file name, extension or "#!" line, replacing any it had */
 void syntax_init(buffer *b);
 
-/* cleans up rules */
-void syntax_end();
+/* stops highlighting a buffer */
+void syntax_end(buffer *b);
 
-/* generate attributes for the given buffer */
-void gen_syntax(buffer *b);
+/* the name of the language a buffer is highlighted as, NULL if it isn't */
+const char *syntax_name(buffer *b);
 
+/*
+ * generate attributes for the first lines lines of a buffer, the last of them
+ * (what it ends in doesn't matter yet) only as far as column cols on screen.
+ * lines folded away (see fold.h) are skipped. returns how many lines were
+ * highlighted
+ */
+int gen_syntax(buffer *b, int lines, int cols);
@@ -0,0 +1,32 @@
+/*
+ * utf8.h
+ * Decoding UTF-8 and working out how many columns characters take on screen
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <stdbool.h>
+
+/* columns between tab stops */
+#define TABSTOP 4
+
+/* what bytes that aren't valid UTF-8 decode to, and are shown as */
+#define UTF8_INVALID 0xfffd
+
+/* decode the character at the start of s (len bytes long) into c, returns how many bytes it took.
+ * a byte that doesn't start a valid sequence is taken on its own as UTF8_INVALID */
+int utf8_decode(const char *s, int len, int *c);
+
+/* encode c into out (room for 4 bytes), returns how many bytes it took */
+int utf8_encode(int c, char *out);
+
+/* columns c takes when drawn at column col: tabs reach the next stop, control characters are
+ * shown as ^X, combining marks take none and East Asian wide characters two */
+int utf8_width(int c, int col);
+
+/* whether len bytes are all printable ASCII, one column per byte. checked 16 bytes at a time with SSE2 */
+bool utf8_plain(const char *s, int len);
+
+#endif
@@ -0,0 +1,68 @@
+/*
+ * watch.h
+ * Noticing when something else changes a buffer's file, and taking the change in
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <core/buffer.h>
+
+/* how many bytes at the end of a file are hashed, to tell lines added to it from it being rewritten */
+#define WATCH_TAIL 4096
+
+/* what became of a watched file, see watch_update */
+enum watch_change {
+    WATCH_NONE,      // it is as it was last seen
+    WATCH_APPENDED,  // lines were added to its end, and to the buffer's
+    WATCH_RELOADED,  // it changed otherwise, and the buffer was reloaded as the lines that differ
+    WATCH_CONFLICT,  // it changed while the buffer has unsaved edits, which are left alone
+    WATCH_GONE       // it was removed, or can't be read any more
+};
+
+/*
+ * The directory a file is in is watched with inotify rather than the file
+ * itself, so a file replaced by renaming another over it (as most editors
+ * save) is still noticed. When it changes, its size, time and inode are
+ * compared with those last seen, then the hash of the WATCH_TAIL bytes it
+ * used to end with. If only those agree, lines were added to the end, and just
+ * the bytes after are read. Anything else reloads the buffer with diff_reload.
+ */
+typedef struct watch {
+    // the directory's watch, and the file's name in it
+    int wd;
+    char *base;
+
+    // the file as last seen, a size of -1 if there wasn't one, and the hash of its last bytes
+    int64_t size, sec, nsec, ino;
+    uint64_t tail;
+    bool newline;
+
+    // whether something happened to the file since it was last looked at
+    bool pending;
+} watch;
+
+/* the descriptor to wait on for changes to any watched file, -1 if none are */
+int watch_fd(void);
+
+/* start watching a buffer's file, taking it as it is now */
+void watch_start(buffer *b);
+
+/* stop watching a buffer's file */
+void watch_end(buffer *b);
+
+/* take the buffer's file as it is now, once the buffer was written to it or read from it again */
+void watch_saved(buffer *b);
+
+/* read the changes waiting on watch_fd, noting which of the n buffers they're to */
+void watch_events(buffer **bufs, int n);
+
+/* take in whatever happened to a buffer's file since it was last seen. lines is set to how many
+ * lines were added or reloaded */
+enum watch_change watch_update(buffer *b, int *lines);
+
+#endif
@@ -0,0 +1,72 @@
+/*
+ * words.h
+ * Counting the words in a buffer as it is edited, for completing them
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#ifndef WORDS_H
+#define WORDS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <core/buffer.h>
+
+/* a word in the buffer, and how many times it is there (none once it's been edited away) */
+typedef struct word {
+    uint64_t hash;
+    int count, len;
+    char s[];
+} word;
+
+/* the words on a line, in order */
+typedef struct wordline {
+    int *ids;
+    int n;
+} wordline;
+
+/*
+ * The words of a buffer are counted in a hash table, and kept sorted as well so
+ * those starting with a prefix are next to each other and found with a binary
+ * search. The words each line holds are remembered, so an edit only has the
+ * lines it changed split into words again, and those words added and taken
+ * away. Words new since the last completion are only sorted in then, and words
+ * nothing holds any more are dropped once they are most of them. A word is a
+ * run of letters, digits, '_' and UTF-8 characters not starting with a digit.
+ */
+typedef struct words {
+    // the words of each line so far
+    int len, cap;
+    wordline *lines;
+
+    // every word seen, words[id], and an open addressed hash table of mask + 1 ids (-1 if empty)
+    word **words;
+    int nwords, wordcap;
+    int *slots;
+    int mask;
+
+    // words there are none of left
+    int dead;
+
+    // the first sorted words in order of text, the rest having been added since
+    word **sorted;
+    int nsorted;
+
+    // lines changed since the last completion
+    bstale stale;
+} words;
+
+/* stop counting a buffer's words */
+void words_end(buffer *b);
+
+/* where the word ending at x of a line starts, x if there isn't one */
+int words_start(line *l, int x);
+
+/*
+ * up to max of the words starting with the len bytes of prefix (and longer than it) in out, most
+ * common first, then in order. returns how many there are. the words are good until the next
+ * completion in the buffer. viewed files have none
+ */
+int words_complete(buffer *b, const char *prefix, int len, const word **out, int max);
+
+#endif
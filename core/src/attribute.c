@@ -7,6 +7,7 @@
 #include <stdlib.h>
 
 #include <core/attribute.h>
+#include <core/mem.h>
 
 /* creates and returns an empty attribute */
 attribute nullattr() {
@@ -16,7 +17,7 @@ attribute nullattr() {
 
 /* create new attribute with default values */
 attribute *newattr() {
-    attribute *a = malloc(sizeof(attribute));
+    attribute *a = mem_alloc(MEM_LINE, sizeof(attribute));
     a->type = NORMAL;
     a->enabled = true;
 
@@ -25,6 +26,6 @@ attribute *newattr() {
 
 /* free the attribute */
 void delattr(attribute *a) {
-    free(a);
+    mem_free(MEM_LINE, a);
 }
 
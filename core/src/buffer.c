@@ -5,42 +5,123 @@
  */
 
 #include <stdlib.h>
+#include <limits.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <core/buffer.h>
 #include <core/syntax.h>
+#include <core/fold.h>
+#include <core/nest.h>
+#include <core/words.h>
+#include <core/journal.h>
+#include <core/digest.h>
+#include <core/diff.h>
+#include <core/watch.h>
+#include <core/mem.h>
+
+struct observer {
+    bobserver fn;
+    void *data;
+};
 
 /* returns a new, empty buffer */
 buffer *newbuf() {
-    buffer *b = malloc(sizeof(buffer));
+    buffer *b = mem_alloc(MEM_BUFFER, sizeof(buffer));
     b->y = b->x = 0;
-    b->len = 0;
+    b->sy = b->sx = 0;
+    b->len = b->cap = 0;
     b->lines = NULL;
     b->name = NULL;
     b->dirty = false;
+    b->fd = -1;
+    b->index = NULL;
+    b->pool = newpool();
+    b->syntax = NULL;
+    b->folds = NULL;
+    b->nest = NULL;
+    b->words = NULL;
+    b->journal = NULL;
+    b->digest = NULL;
+    b->diff = NULL;
+    b->watch = NULL;
+    b->observers = NULL;
+    b->nobservers = 0;
+    bclrdamage(b);
 
     return b;
 }
 
+/* make sure the line array can hold at least len lines, growing geometrically */
+static void bgrow(buffer *b, int len) {
+    if (len <= b->cap) {
+        return;
+    }
+
+    int cap = b->cap > 0 ? b->cap : 64;
+    while (cap < len) {
+        cap *= 2;
+    }
+    b->lines = mem_realloc(MEM_BUFFER, b->lines, sizeof(line*) * cap);
+    b->cap = cap;
+}
+
 /* clean up and free the buffer */
 void delbuf(buffer *b) {
-    // delete the lines
-    for (int i = 0; i < b->len; i++) {
-        delline(b->lines[i]);
+    syntax_end(b);
+    fold_clear(b);
+    nest_end(b);
+    words_end(b);
+    journal_end(b);
+    digest_end(b);
+    diff_end(b);
+    watch_end(b);
+
+    // delete the lines, all of which live in the pool. viewed files keep theirs in the index
+    if (b->index != NULL) {
+        delindex(b->index);
+    }
+    delpool(b->pool);
+    mem_free(MEM_BUFFER, b->lines);
+
+    // close the stream if we were still reading one
+    if (b->fd != -1) {
+        close(b->fd);
     }
-    free(b->lines);
 
     // delete the filename
-    free(b->name);
+    mem_free(MEM_BUFFER, b->name);
+    mem_free(MEM_BUFFER, b->observers);
 
     // free the buffer
-    free(b);
+    mem_free(MEM_BUFFER, b);
 }
 
-/* insert an empty line into the buffer */
-void baddline(buffer *b, int y) {
+/* returns the line at y */
+line *bline(buffer *b, int y) {
+    if (b->index != NULL) {
+        return ixline(b->index, y);
+    }
+    return b->lines[y];
+}
+
+/* make sure the first len lines are available */
+void bensure(buffer *b, int len) {
+    if (b->index != NULL) {
+        ixextend(b->index, len);
+        b->len = b->index->known;
+    }
+}
+
+/* returns whether the buffer can be edited */
+bool beditable(buffer *b) {
+    return b->index == NULL;
+}
+
+/* insert an empty line, without journaling it */
+static void binsertline(buffer *b, int y) {
     // make room for the line
-    b->lines = realloc(b->lines, sizeof(line*) * (b->len + 1));
+    bgrow(b, b->len + 1);
 
     // offset if needed
     if (y < b->len) {
@@ -48,13 +129,15 @@ void baddline(buffer *b, int y) {
     }
 
     // insert the line
-    b->lines[y] = newline();
+    b->lines[y] = newline(b->pool);
     b->len++;
     b->dirty = true;
+    bdamage(b, y, INT_MAX);
+    bnotify(b, y, 1);
 }
 
-/* remove a line */
-void bdelline(buffer *b, int y) {
+/* remove a line, without journaling it */
+static void bremoveline(buffer *b, int y) {
     // remove the line
     delline(b->lines[y]);
     b->len--;
@@ -64,41 +147,95 @@ void bdelline(buffer *b, int y) {
         memmove(&b->lines[y], &b->lines[y + 1], sizeof(line*) * (b->len - y));
     }
     b->dirty = true;
+    bdamage(b, y, INT_MAX);
+    bnotify(b, y, -1);
+}
+
+/* insert an empty line into the buffer */
+void baddline(buffer *b, int y) {
+    if (!beditable(b)) {
+        return;
+    }
 
-    // realloc
-    b->lines = realloc(b->lines, sizeof(line*) * (b->len));
+    journal_edit(b, JOURNAL_ADDLINE, y, 0, NULL, 0);
+    binsertline(b, y);
+}
+
+/* remove a line */
+void bdelline(buffer *b, int y) {
+    if (!beditable(b)) {
+        return;
+    }
+
+    journal_edit(b, JOURNAL_DELLINE, y, 0, NULL, 0);
+    bremoveline(b, y);
 }
 
 /* insert a character */
 void baddch(buffer *b, const char c, int y, int x) {
+    if (!beditable(b)) {
+        return;
+    }
+
+    journal_edit(b, JOURNAL_ADDSTR, y, x, &c, 1);
     laddch(b->lines[y], c, x);
     b->dirty = true;
+    bdamage(b, y, y);
+    bnotify(b, y, 0);
 }
 
 /* insert a string */
 void baddstr(buffer *b, const char *s, int len, int y, int x) {
+    if (!beditable(b)) {
+        return;
+    }
+
+    journal_edit(b, JOURNAL_ADDSTR, y, x, s, len);
     laddstr(b->lines[y], s, len, x);
     b->dirty = true;
+    bdamage(b, y, y);
+    bnotify(b, y, 0);
 }
 
 /* insert an existing line at the end of the buffer */
 void bappendline(buffer *b, line *l) {
-    b->lines = realloc(b->lines, sizeof(line**) * b->len + 1);
+    if (!beditable(b)) {
+        return;
+    }
+
+    journal_edit(b, JOURNAL_ADDLINE, b->len, 0, NULL, 0);
+    journal_edit(b, JOURNAL_ADDSTR, b->len, 0, l->s, l->len);
+    bgrow(b, b->len + 1);
     b->lines[b->len] = l;
     b->len++;
     b->dirty = true;
+    bdamage(b, b->len - 1, INT_MAX);
+    bnotify(b, b->len - 1, 1);
 }
 
 /* remove a character */
 void bdelch(buffer *b, int y, int x) {
+    if (!beditable(b)) {
+        return;
+    }
+
+    journal_edit(b, JOURNAL_DELCH, y, x, NULL, 0);
     ldelch(b->lines[y], x);
     b->dirty = true;
+    bdamage(b, y, y);
+    bnotify(b, y, 0);
 }
 
 /* insert a line break */
 void baddbreak(buffer *b, int y, int x) {
+    if (!beditable(b)) {
+        return;
+    }
+
+    journal_edit(b, JOURNAL_ADDBREAK, y, x, NULL, 0);
+
     // insert blank line
-    baddline(b, y + 1);
+    binsertline(b, y + 1);
 
     // if needed, append string to new line and shorten previous
     if (x < b->lines[y]->len) {
@@ -107,32 +244,92 @@ void baddbreak(buffer *b, int y, int x) {
 
         laddstr(next, &prev->s[x], prev->len - x, 0);
         lresize(prev, x);
+        bnotify(b, y, 0);
+        bnotify(b, y + 1, 0);
     }
     b->dirty = true;
+    bdamage(b, y, y);
 }
 
 /* remove a line break */
 void bdelbreak(buffer *b, int y) {
     // do nothing to top line
-    if (y == 0) {
+    if (y == 0 || !beditable(b)) {
         return;
     }
 
+    journal_edit(b, JOURNAL_DELBREAK, y, 0, NULL, 0);
+
     // if needed, append current to previous
     if (b->lines[y]->len > 0) {
         line *prev = b->lines[y - 1];
         line *curr = b->lines[y];
 
         laddstr(prev, curr->s, curr->len, prev->len);
+        bnotify(b, y - 1, 0);
     }
 
     // remove the current line
-    bdelline(b, y);
+    bremoveline(b, y);
     b->dirty = true;
+    bdamage(b, y - 1, y - 1);
+}
+
+/* replace lines with text */
+void breplace(buffer *b, int y, int n, const char *text, int len) {
+    if (!beditable(b)) {
+        return;
+    }
+
+    journal_edit(b, JOURNAL_REPLACE, y, n, text, len);
+
+    int m = 0;
+    for (const char *p = text, *end = text + len; p < end && (p = memchr(p, '\n', end - p)) != NULL; p++) {
+        m++;
+    }
+    if (len > 0 && text[len - 1] != '\n') {
+        m++;
+    }
+
+    // lines added or removed go in one move of those after them, however many there are
+    if (m > n) {
+        bgrow(b, b->len + m - n);
+        memmove(&b->lines[y + m], &b->lines[y + n], sizeof(line*) * (b->len - y - n));
+        for (int i = y + n; i < y + m; i++) {
+            b->lines[i] = newline(b->pool);
+        }
+    } else if (m < n) {
+        for (int i = y + m; i < y + n; i++) {
+            delline(b->lines[i]);
+        }
+        memmove(&b->lines[y + m], &b->lines[y + n], sizeof(line*) * (b->len - y - n));
+    }
+    b->len += m - n;
+
+    const char *p = text;
+    for (int i = y; i < y + m; i++) {
+        const char *nl = memchr(p, '\n', text + len - p);
+        int linelen = nl != NULL ? nl - p : text + len - p;
+        lset(b->lines[i], p, linelen);
+        p += linelen + 1;
+    }
+
+    // observers hear about the lines kept as changed, then about those added or removed after them
+    for (int i = y; i < y + (m < n ? m : n); i++) {
+        bnotify(b, i, 0);
+    }
+    if (m != n) {
+        bnotify(b, y + (m < n ? m : n), m - n);
+    }
+    b->dirty = true;
+    bdamage(b, y, m != n ? INT_MAX : y + m - 1);
 }
 
 /* move to the given location */
 void bmoveto(buffer *b, int y, int x) {
+    // indexed buffers may not have counted this far yet
+    bensure(b, y + 1);
+
     // first choose y
     if (y < 0) {
         b->y = 0;
@@ -141,41 +338,148 @@ void bmoveto(buffer *b, int y, int x) {
     } else {
         b->y = y;
     }
+    b->y = fold_shown(b, b->y);
 
-    // then choose x
-    line *l = b->lines[b->y];
+    // then choose x, at the start of whichever character it falls in
+    line *l = bline(b, b->y);
     if (x < 0) {
         b->x = 0;
     } else if (x > l->len) {
         b->x = l->len;
     } else {
-        b->x = x;
+        b->x = lstart(l, x);
     }
 }
 
-/* move in the given direction */
+/* move to line y, at the character drawn at column col */
+void bmovetocol(buffer *b, int y, int col) {
+    bmoveto(b, y, 0);
+    b->x = lbyte(bline(b, b->y), col);
+}
+
+/* move in the given direction, a character at a time and staying in the same column between lines.
+ * moving up onto a fold lands on its first line, moving down from there goes past it */
 void bmove(buffer *b, enum direction dir) {
     switch (dir) {
         case UP:
-            bmoveto(b, b->y - 1, b->x);
+            bmovetocol(b, b->y - 1, lcolumn(bline(b, b->y), b->x));
             break;
 
         case DOWN:
-            bmoveto(b, b->y + 1, b->x);
+            bmovetocol(b, fold_last(b, b->y) + 1, lcolumn(bline(b, b->y), b->x));
             break;
 
         case LEFT:
-            bmoveto(b, b->y, b->x - 1);
+            bmoveto(b, b->y, lprev(bline(b, b->y), b->x));
             break;
 
         case RIGHT:
-            bmoveto(b, b->y, b->x + 1);
+            bmoveto(b, b->y, lnext(bline(b, b->y), b->x));
+    }
+}
+
+/* widen the damaged range to cover first to last */
+void bdamage(buffer *b, int first, int last) {
+    if (first < b->dfirst) {
+        b->dfirst = first;
+    }
+    if (last > b->dlast) {
+        b->dlast = last;
+    }
+
+    // the highlighting has to be checked again from there
+    if (b->syntax != NULL && first < b->syntax->clean) {
+        b->syntax->clean = first;
+    }
+}
+
+/* nothing needs drawing again */
+void bclrdamage(buffer *b) {
+    b->dfirst = INT_MAX;
+    b->dlast = -1;
+}
+
+/* call fn(b, y, n, data) on every edit from now on, after the observers already there */
+void bobserve(buffer *b, bobserver fn, void *data) {
+    b->observers = mem_realloc(MEM_BUFFER, b->observers, sizeof(struct observer) * (b->nobservers + 1));
+    b->observers[b->nobservers].fn = fn;
+    b->observers[b->nobservers].data = data;
+    b->nobservers++;
+}
+
+/* stop calling fn with data, nothing if it wasn't being called */
+void bunobserve(buffer *b, bobserver fn, void *data) {
+    for (int i = 0; i < b->nobservers; i++) {
+        if (b->observers[i].fn == fn && b->observers[i].data == data) {
+            b->nobservers--;
+            memmove(&b->observers[i], &b->observers[i + 1], sizeof(struct observer) * (b->nobservers - i));
+            return;
+        }
+    }
+}
+
+/* tell every observer that n lines were added at y (n > 0), -n removed from y on (n < 0), or that
+ * the text of line y changed (n == 0) */
+void bnotify(buffer *b, int y, int n) {
+    for (int i = 0; i < b->nobservers; i++) {
+        b->observers[i].fn(b, y, n, b->observers[i].data);
+    }
+}
+
+/* line y needs looking at again, once however many times it is marked in a row */
+void bstale_mark(bstale *s, int y) {
+    if (s->n > 0 && s->lines[s->n - 1] == y) {
+        return;
+    }
+    if (s->n == s->cap) {
+        s->cap = s->cap > 0 ? s->cap * 2 : 16;
+        s->lines = mem_realloc(MEM_BUFFER, s->lines, sizeof(int) * s->cap);
     }
+    s->lines[s->n++] = y;
+}
+
+/* mark, move or drop the lines an edit touches, returning the lines the index moves by */
+int bstale_note(bstale *s, int y, int n, int len) {
+    // lines past the end are read once the index catches up with the buffer
+    if (y >= len) {
+        return 0;
+    }
+    if (n == 0) {
+        bstale_mark(s, y);
+        return 0;
+    }
+
+    // lines removed past the end were never read
+    if (y - n > len) {
+        n = y - len;
+    }
+
+    int kept = 0;
+    for (int i = 0; i < s->n; i++) {
+        int l = s->lines[i];
+        if (l >= y && l < y - n) {
+            continue;
+        }
+        s->lines[kept++] = l >= y ? l + n : l;
+    }
+    s->n = kept;
+
+    for (int i = y; i < y + n; i++) {
+        bstale_mark(s, i);
+    }
+    return n;
+}
+
+/* free the lines marked */
+void bstale_free(bstale *s) {
+    mem_free(MEM_BUFFER, s->lines);
+    s->lines = NULL;
+    s->n = s->cap = 0;
 }
 
 /* name the buffer */
 void bname(buffer *b, const char *name) {
-    b->name = realloc(b->name, strlen(name) + 1);
+    b->name = mem_realloc(MEM_BUFFER, b->name, strlen(name) + 1);
     strcpy(b->name, name);
 }
 
@@ -0,0 +1,563 @@
+/*
+ * diff.c
+ * Diffing a buffer against its file by the hashes of their lines, and reloading it as the hunks between them
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <core/diff.h>
+#include <core/digest.h>
+#include <core/journal.h>
+#include <core/watch.h>
+#include <core/mem.h>
+
+/* how many edits apart a diff may search for a way through before what is left counts as changed */
+#define DIFF_COST 4096
+
+/* a file mapped in, and its lines */
+typedef struct difffile {
+    char *data;
+    size_t size;
+
+    // the hash of each line, and where each starts, the last start being the end of the file
+    int len;
+    uint64_t *lines;
+    size_t *starts;
+} difffile;
+
+/* a line's hash, and which sides have it: 1 for the file, 2 for the buffer, 0 for an empty slot */
+typedef struct diffslot {
+    uint64_t hash;
+    int sides;
+} diffslot;
+
+/* the lines left to diff on either side, and which of them are changed so far */
+typedef struct diffwork {
+    const uint64_t *a, *b;
+    char *ca, *cb;
+
+    // how far the paths forward and backward reach along each diagonal
+    int *fv, *bv;
+} diffwork;
+
+/* map the file at path in and hash its lines, the way readbuf would split it. false if it can't */
+static bool diff_read(const char *path, difffile *f) {
+    memset(f, 0, sizeof(difffile));
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+        if (fd != -1) {
+            close(fd);
+        }
+        return false;
+    }
+
+    f->size = st.st_size;
+    if (f->size > 0) {
+        f->data = mmap(NULL, f->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (f->data == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+    }
+    close(fd);
+
+    // a trailing newline doesn't start another line, and an empty file is shown as one empty line
+    const char *end = f->data + f->size;
+    int len = 0;
+    for (const char *p = f->data; p < end && (p = memchr(p, '\n', end - p)) != NULL; p++) {
+        len++;
+    }
+    if (f->size == 0 || end[-1] != '\n') {
+        len++;
+    }
+
+    f->lines = mem_alloc(MEM_BUFFER, sizeof(uint64_t) * len);
+    f->starts = mem_alloc(MEM_BUFFER, sizeof(size_t) * (len + 1));
+    size_t at = 0;
+    for (int i = 0; i < len; i++) {
+        const char *nl = at < f->size ? memchr(f->data + at, '\n', f->size - at) : NULL;
+        size_t next = nl != NULL ? (size_t)(nl - f->data) : f->size;
+        f->starts[i] = at;
+        f->lines[i] = digest_line(f->data + at, next - at);
+        at = next + 1;
+    }
+    f->starts[len] = f->size;
+    f->len = len;
+    return true;
+}
+
+static void diff_close(difffile *f) {
+    if (f->size > 0) {
+        munmap(f->data, f->size);
+    }
+    mem_free(MEM_BUFFER, f->lines);
+    mem_free(MEM_BUFFER, f->starts);
+}
+
+/* the slot of hash in a table of mask + 1 slots, empty if it isn't there */
+static diffslot *diff_slot(diffslot *set, int mask, uint64_t hash) {
+    int i = hash & mask;
+    while (set[i].sides != 0 && set[i].hash != hash) {
+        i = (i + 1) & mask;
+    }
+    return &set[i];
+}
+
+/*
+ * find where the middle snake of lines xoff..xlim-1 and yoff..ylim-1 starts,
+ * following the paths forward from the start and backward from the end one
+ * edit at a time until they overlap. false if that takes more than DIFF_COST
+ */
+static bool diff_split(diffwork *w, int xoff, int xlim, int yoff, int ylim, int *sx, int *sy) {
+    const uint64_t *a = w->a + xoff, *b = w->b + yoff;
+    int n = xlim - xoff, m = ylim - yoff;
+    int maxd = (n + m + 1) / 2;
+    int off = maxd, vlen = 2 * maxd + 2;
+    int *fv = w->fv, *bv = w->bv;
+
+    for (int i = 0; i < vlen; i++) {
+        fv[i] = bv[i] = -1;
+    }
+    fv[off + 1] = bv[off + 1] = 0;
+
+    // the paths meet going forward when the lengths differ by an odd number of lines
+    int delta = n - m;
+    bool front = delta % 2 != 0;
+    int fstart = 0, fend = 0, bstart = 0, bend = 0;
+    int limit = maxd < DIFF_COST ? maxd : DIFF_COST;
+    for (int d = 0; d < limit; d++) {
+        for (int k = -d + fstart; k <= d - fend; k += 2) {
+            int i = off + k;
+            int x = k == -d || (k != d && fv[i - 1] < fv[i + 1]) ? fv[i + 1] : fv[i - 1] + 1;
+            int y = x - k;
+            while (x < n && y < m && a[x] == b[y]) {
+                x++;
+                y++;
+            }
+            fv[i] = x;
+
+            if (x > n) {
+                fend += 2;
+            } else if (y > m) {
+                fstart += 2;
+            } else if (front) {
+                int j = off + delta - k;
+                if (j >= 0 && j < vlen && bv[j] != -1 && x >= n - bv[j]) {
+                    *sx = xoff + x;
+                    *sy = yoff + y;
+                    return true;
+                }
+            }
+        }
+
+        for (int k = -d + bstart; k <= d - bend; k += 2) {
+            int i = off + k;
+            int x = k == -d || (k != d && bv[i - 1] < bv[i + 1]) ? bv[i + 1] : bv[i - 1] + 1;
+            int y = x - k;
+            while (x < n && y < m && a[n - x - 1] == b[m - y - 1]) {
+                x++;
+                y++;
+            }
+            bv[i] = x;
+
+            if (x > n) {
+                bend += 2;
+            } else if (y > m) {
+                bstart += 2;
+            } else if (!front) {
+                int j = off + delta - k;
+                if (j >= 0 && j < vlen && fv[j] != -1 && fv[j] >= n - x) {
+                    *sx = xoff + fv[j];
+                    *sy = yoff + fv[j] - (j - off);
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+/* mark the lines of xoff..xlim-1 and yoff..ylim-1 that aren't in the longest run both have in common */
+static void diff_compare(diffwork *w, int xoff, int xlim, int yoff, int ylim) {
+    while (xoff < xlim && yoff < ylim && w->a[xoff] == w->b[yoff]) {
+        xoff++;
+        yoff++;
+    }
+    while (xoff < xlim && yoff < ylim && w->a[xlim - 1] == w->b[ylim - 1]) {
+        xlim--;
+        ylim--;
+    }
+
+    int x, y;
+    if (xoff == xlim || yoff == ylim || !diff_split(w, xoff, xlim, yoff, ylim, &x, &y)) {
+        memset(w->ca + xoff, 1, xlim - xoff);
+        memset(w->cb + yoff, 1, ylim - yoff);
+        return;
+    }
+    diff_compare(w, xoff, x, yoff, y);
+    diff_compare(w, x, xlim, y, ylim);
+}
+
+/* mark the lines of a and b that differ, n and m of them */
+static void diff_lines(const uint64_t *a, int n, const uint64_t *b, int m, char *ca, char *cb) {
+    if (n == 0 || m == 0) {
+        memset(ca, 1, n);
+        memset(cb, 1, m);
+        return;
+    }
+
+    // lines only one side has are changed whatever else is, and leaving them out makes the rest cheaper
+    int size = 16;
+    while (size < 2 * (n + m)) {
+        size *= 2;
+    }
+    diffslot *set = mem_calloc(MEM_BUFFER, size, sizeof(diffslot));
+    for (int i = 0; i < n; i++) {
+        diffslot *s = diff_slot(set, size - 1, a[i]);
+        s->hash = a[i];
+        s->sides |= 1;
+    }
+    for (int i = 0; i < m; i++) {
+        diffslot *s = diff_slot(set, size - 1, b[i]);
+        s->hash = b[i];
+        s->sides |= 2;
+    }
+
+    int *ka = mem_alloc(MEM_BUFFER, sizeof(int) * n), *kb = mem_alloc(MEM_BUFFER, sizeof(int) * m);
+    uint64_t *wa = mem_alloc(MEM_BUFFER, sizeof(uint64_t) * n), *wb = mem_alloc(MEM_BUFFER, sizeof(uint64_t) * m);
+    int na = 0, nb = 0;
+    for (int i = 0; i < n; i++) {
+        if (diff_slot(set, size - 1, a[i])->sides == 3) {
+            wa[na] = a[i];
+            ka[na++] = i;
+        } else {
+            ca[i] = 1;
+        }
+    }
+    for (int i = 0; i < m; i++) {
+        if (diff_slot(set, size - 1, b[i])->sides == 3) {
+            wb[nb] = b[i];
+            kb[nb++] = i;
+        } else {
+            cb[i] = 1;
+        }
+    }
+    mem_free(MEM_BUFFER, set);
+
+    int maxd = (na + nb + 1) / 2;
+    diffwork w = {wa, wb, mem_calloc(MEM_BUFFER, na + 1, 1), mem_calloc(MEM_BUFFER, nb + 1, 1),
+                  mem_alloc(MEM_BUFFER, sizeof(int) * (2 * maxd + 2)), mem_alloc(MEM_BUFFER, sizeof(int) * (2 * maxd + 2))};
+    diff_compare(&w, 0, na, 0, nb);
+    for (int i = 0; i < na; i++) {
+        ca[ka[i]] = w.ca[i];
+    }
+    for (int i = 0; i < nb; i++) {
+        cb[kb[i]] = w.cb[i];
+    }
+
+    mem_free(MEM_BUFFER, w.ca);
+    mem_free(MEM_BUFFER, w.cb);
+    mem_free(MEM_BUFFER, w.fv);
+    mem_free(MEM_BUFFER, w.bv);
+    mem_free(MEM_BUFFER, ka);
+    mem_free(MEM_BUFFER, kb);
+    mem_free(MEM_BUFFER, wa);
+    mem_free(MEM_BUFFER, wb);
+}
+
+/* the hunks turning the file's lines into the buffer's, len of them, as a new array of *n */
+static diffhunk *diff_compute(const uint64_t *file, int flen, const uint64_t *lines, int len, int *n) {
+    char *ca = mem_calloc(MEM_BUFFER, flen + 1, 1), *cb = mem_calloc(MEM_BUFFER, len + 1, 1);
+
+    // most edits leave most of the file alone at either end
+    int pre = 0, suf = 0;
+    while (pre < flen && pre < len && file[pre] == lines[pre]) {
+        pre++;
+    }
+    while (suf < flen - pre && suf < len - pre && file[flen - suf - 1] == lines[len - suf - 1]) {
+        suf++;
+    }
+    diff_lines(file + pre, flen - pre - suf, lines + pre, len - pre - suf, ca + pre, cb + pre);
+
+    // the lines changed on each side between those kept make a hunk
+    diffhunk *hunks = NULL;
+    int nhunks = 0, cap = 0;
+    int i = 0, j = 0;
+    while (i < flen || j < len) {
+        if (i < flen && j < len && !ca[i] && !cb[j]) {
+            i++;
+            j++;
+            continue;
+        }
+
+        diffhunk h = {j, 0, i, 0};
+        while (i < flen && ca[i]) {
+            i++;
+            h.fn++;
+        }
+        while (j < len && cb[j]) {
+            j++;
+            h.n++;
+        }
+        if (h.n == 0 && h.fn == 0) {
+            h.n = len - j;
+            h.fn = flen - i;
+            i = flen;
+            j = len;
+        }
+
+        if (nhunks == cap) {
+            cap = cap > 0 ? cap * 2 : 16;
+            hunks = mem_realloc(MEM_BUFFER, hunks, sizeof(diffhunk) * cap);
+        }
+        hunks[nhunks++] = h;
+    }
+
+    mem_free(MEM_BUFFER, ca);
+    mem_free(MEM_BUFFER, cb);
+    *n = nhunks;
+    return hunks;
+}
+
+/* the hashes of the buffer's lines, from its digest if it keeps one. *owned if they were made here */
+static const uint64_t *diff_buffer(buffer *b, int *len, bool *owned) {
+    const uint64_t *lines, *saved;
+    int nsaved;
+    *owned = !digest_lines(b, &lines, len, &saved, &nsaved);
+    if (!*owned) {
+        return lines;
+    }
+
+    uint64_t *hashes = mem_alloc(MEM_BUFFER, sizeof(uint64_t) * (b->len > 0 ? b->len : 1));
+    for (int y = 0; y < b->len; y++) {
+        line *l = bline(b, y);
+        hashes[y] = digest_line(l->s, l->len);
+    }
+    *len = b->len;
+    return hashes;
+}
+
+/* widen the lines edited to take in an edit, moving them with the lines added or removed */
+static void diff_observe(buffer *b, int y, int n, void *data) {
+    diff *d = data;
+    (void)b;
+
+    if (!d->stale) {
+        d->stale = true;
+        d->from = d->to = y;
+        d->shift = 0;
+    }
+    if (n > 0) {
+        d->to += d->to > y ? n : 0;
+    } else if (n < 0) {
+        d->from = d->from > y - n ? d->from + n : (d->from > y ? y : d->from);
+        d->to = d->to > y - n ? d->to + n : (d->to > y ? y : d->to);
+    }
+    d->from = y < d->from ? y : d->from;
+    d->to = y + (n > 0 ? n : n == 0) > d->to ? y + (n > 0 ? n : n == 0) : d->to;
+    d->shift += n;
+}
+
+int diff_start(buffer *b) {
+    if (b->name == NULL || !beditable(b)) {
+        return -1;
+    }
+
+    difffile f;
+    if (!diff_read(b->name, &f)) {
+        return -1;
+    }
+
+    if (b->diff == NULL) {
+        b->diff = mem_calloc(MEM_BUFFER, 1, sizeof(diff));
+        bobserve(b, diff_observe, b->diff);
+    }
+    diff *d = b->diff;
+    mem_free(MEM_BUFFER, d->lines);
+    d->lines = f.lines;
+    d->len = f.len;
+    f.lines = NULL;
+    diff_close(&f);
+
+    // every mark may have changed
+    d->stale = d->whole = true;
+    bdamage(b, 0, INT_MAX);
+
+    int n;
+    diff_hunks(b, &n);
+    return n;
+}
+
+void diff_end(buffer *b) {
+    diff *d = b->diff;
+    if (d == NULL) {
+        return;
+    }
+
+    bunobserve(b, diff_observe, d);
+    mem_free(MEM_BUFFER, d->lines);
+    mem_free(MEM_BUFFER, d->hunks);
+    mem_free(MEM_BUFFER, d);
+    b->diff = NULL;
+    bdamage(b, 0, INT_MAX);
+}
+
+const diffhunk *diff_hunks(buffer *b, int *n) {
+    diff *d = b->diff;
+    if (d == NULL) {
+        *n = 0;
+        return NULL;
+    }
+    if (!d->stale) {
+        *n = d->nhunks;
+        return d->hunks;
+    }
+
+    int len;
+    bool owned;
+    const uint64_t *lines = diff_buffer(b, &len, &owned);
+
+    // the hunks touching the lines edited are done again, from the line before them that was the
+    // same to the one after, as it was before the edits
+    int first = 0, last = d->nhunks, y = 0, yend = len - d->shift, fy = 0;
+    if (!d->whole) {
+        int from = d->from, to = d->to - d->shift;
+        while (first < d->nhunks && d->hunks[first].y + d->hunks[first].n < from) {
+            fy += d->hunks[first].fn - d->hunks[first].n;
+            first++;
+        }
+        last = first;
+        while (last < d->nhunks && d->hunks[last].y <= to) {
+            last++;
+        }
+        y = first < last && d->hunks[first].y < from ? d->hunks[first].y : from;
+        yend = first < last && d->hunks[last - 1].y + d->hunks[last - 1].n > to
+                ? d->hunks[last - 1].y + d->hunks[last - 1].n : to;
+        fy += y;
+    }
+    int fend = d->len;
+    if (!d->whole) {
+        fend = fy + yend - y;
+        for (int i = first; i < last; i++) {
+            fend += d->hunks[i].fn - d->hunks[i].n;
+        }
+    }
+
+    int nmid;
+    diffhunk *mid = diff_compute(d->lines + fy, fend - fy, lines + y, yend + d->shift - y, &nmid);
+    if (owned) {
+        mem_free(MEM_BUFFER, (void *)lines);
+    }
+
+    // the hunks before stay as they were, and those after move with the lines added or removed
+    int nhunks = first + nmid + d->nhunks - last;
+    diffhunk *hunks = mem_alloc(MEM_BUFFER, sizeof(diffhunk) * (nhunks > 0 ? nhunks : 1));
+    if (first > 0) {
+        memcpy(hunks, d->hunks, sizeof(diffhunk) * first);
+    }
+    for (int i = 0; i < nmid; i++) {
+        hunks[first + i] = mid[i];
+        hunks[first + i].y += y;
+        hunks[first + i].fy += fy;
+    }
+    for (int i = last; i < d->nhunks; i++) {
+        hunks[first + nmid + i - last] = d->hunks[i];
+        hunks[first + nmid + i - last].y += d->shift;
+    }
+    mem_free(MEM_BUFFER, mid);
+    mem_free(MEM_BUFFER, d->hunks);
+
+    // the marks of the lines diffed again are drawn again, those before them too for a hunk removed
+    bdamage(b, y > 0 ? y - 1 : 0, yend + d->shift);
+
+    d->hunks = hunks;
+    d->nhunks = nhunks;
+    d->stale = d->whole = false;
+    *n = nhunks;
+    return hunks;
+}
+
+enum diff_mark diff_mark(buffer *b, int y) {
+    int n;
+    const diffhunk *h = diff_hunks(b, &n);
+
+    // the last hunk starting at or before y
+    int lo = 0, hi = n;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (h[mid].y <= y) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (lo > 0 && y < h[lo - 1].y + h[lo - 1].n) {
+        return h[lo - 1].fn > 0 ? DIFF_CHANGED : DIFF_ADDED;
+    }
+    if (lo > 0 && h[lo - 1].y == y) {
+        return DIFF_REMOVED;
+    }
+    if (y == b->len - 1 && lo < n && h[lo].y == b->len) {
+        return DIFF_REMOVED;
+    }
+    return DIFF_SAME;
+}
+
+int diff_reload(buffer *b) {
+    if (b->name == NULL || !beditable(b)) {
+        return -1;
+    }
+
+    difffile f;
+    if (!diff_read(b->name, &f)) {
+        return -1;
+    }
+
+    int len;
+    bool owned;
+    const uint64_t *lines = diff_buffer(b, &len, &owned);
+    int n;
+    diffhunk *hunks = diff_compute(f.lines, f.len, lines, len, &n);
+    if (owned) {
+        mem_free(MEM_BUFFER, (void *)lines);
+    }
+
+    // from the last hunk back, so the lines of those before it stay where they were found
+    int changed = 0;
+    for (int i = n - 1; i >= 0; i--) {
+        diffhunk h = hunks[i];
+        size_t start = f.starts[h.fy], end = f.starts[h.fy + h.fn];
+        breplace(b, h.y, h.n, f.data + start, end - start);
+        changed += h.n > h.fn ? h.n : h.fn;
+    }
+    mem_free(MEM_BUFFER, hunks);
+
+    // an empty file still shows as an empty line
+    if (b->len == 0) {
+        baddline(b, 0);
+    }
+
+    // the buffer is the file again, like it was just opened
+    if (b->diff != NULL) {
+        mem_free(MEM_BUFFER, b->diff->lines);
+        b->diff->lines = f.lines;
+        b->diff->len = f.len;
+        b->diff->stale = b->diff->whole = true;
+        f.lines = NULL;
+    }
+    diff_close(&f);
+    digest_save(b);
+    journal_saved(b);
+    watch_saved(b);
+    b->dirty = false;
+    bmoveto(b, b->y, b->x);
+    return changed;
+}
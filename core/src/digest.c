@@ -0,0 +1,152 @@
+/*
+ * digest.c
+ * Keeping a hash of every line with edits, and comparing them with the saved version's
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#include <string.h>
+
+#include <core/digest.h>
+#include <core/hash.h>
+#include <core/mem.h>
+
+uint64_t digest_line(const char *s, int len) {
+    return hash_block(s, len);
+}
+
+/* make room for len lines */
+static void digest_grow(digest *d, int len) {
+    if (len <= d->cap) {
+        return;
+    }
+
+    int cap = d->cap > 0 ? d->cap : 256;
+    while (cap < len) {
+        cap *= 2;
+    }
+    d->lines = mem_realloc(MEM_BUFFER, d->lines, sizeof(uint64_t) * cap);
+    d->cap = cap;
+}
+
+/* keep the hashes in step with the lines, those of lines removed coming out of the sum */
+static void digest_observe(buffer *b, int y, int n, void *data) {
+    digest *d = data;
+    (void)b;
+
+    d->same = -1;
+
+    n = bstale_note(&d->stale, y, n, d->len);
+    if (n > 0) {
+        digest_grow(d, d->len + n);
+        memmove(&d->lines[y + n], &d->lines[y], sizeof(uint64_t) * (d->len - y));
+        memset(&d->lines[y], 0, sizeof(uint64_t) * n);
+    } else if (n < 0) {
+        for (int i = y; i < y - n; i++) {
+            d->sum -= d->lines[i];
+        }
+        memmove(&d->lines[y], &d->lines[y - n], sizeof(uint64_t) * (d->len - y + n));
+    }
+    d->len += n;
+}
+
+/* hash the lines edited or added since, NULL if the buffer isn't being hashed */
+static digest *digest_sync(buffer *b) {
+    digest *d = b->digest;
+    if (d == NULL) {
+        return NULL;
+    }
+
+    // anything else that shrank the buffer went unseen
+    while (d->len > b->len) {
+        d->sum -= d->lines[--d->len];
+        d->same = -1;
+    }
+
+    for (int i = 0; i < d->stale.n; i++) {
+        int y = d->stale.lines[i];
+        if (y < d->len) {
+            line *l = bline(b, y);
+            d->sum -= d->lines[y];
+            d->lines[y] = digest_line(l->s, l->len);
+            d->sum += d->lines[y];
+        }
+    }
+    d->stale.n = 0;
+
+    if (d->len < b->len) {
+        digest_grow(d, b->len);
+        for (int y = d->len; y < b->len; y++) {
+            line *l = bline(b, y);
+            d->lines[y] = digest_line(l->s, l->len);
+            d->sum += d->lines[y];
+        }
+        d->len = b->len;
+        d->same = -1;
+    }
+    return d;
+}
+
+void digest_save(buffer *b) {
+    if (!beditable(b)) {
+        return;
+    }
+
+    if (b->digest == NULL) {
+        b->digest = mem_calloc(MEM_BUFFER, 1, sizeof(digest));
+        bobserve(b, digest_observe, b->digest);
+    }
+    digest *d = digest_sync(b);
+
+    d->saved = mem_realloc(MEM_BUFFER, d->saved, sizeof(uint64_t) * (d->len > 0 ? d->len : 1));
+    memcpy(d->saved, d->lines, sizeof(uint64_t) * d->len);
+    d->nsaved = d->len;
+    d->savedsum = d->sum;
+    d->same = true;
+}
+
+void digest_end(buffer *b) {
+    digest *d = b->digest;
+    if (d == NULL) {
+        return;
+    }
+
+    bunobserve(b, digest_observe, d);
+    mem_free(MEM_BUFFER, d->lines);
+    bstale_free(&d->stale);
+    mem_free(MEM_BUFFER, d->saved);
+    mem_free(MEM_BUFFER, d);
+    b->digest = NULL;
+}
+
+bool digest_dirty(buffer *b) {
+    if (!b->dirty) {
+        return false;
+    }
+    digest *d = digest_sync(b);
+    if (d == NULL) {
+        return true;
+    }
+
+    // the sums only agreeing by chance is rare, so the lines are compared just once after an edit
+    if (d->same == -1) {
+        d->same = d->len == d->nsaved && d->sum == d->savedsum
+                && memcmp(d->lines, d->saved, sizeof(uint64_t) * d->len) == 0;
+    }
+    if (d->same) {
+        b->dirty = false;
+    }
+    return b->dirty;
+}
+
+bool digest_lines(buffer *b, const uint64_t **lines, int *len, const uint64_t **saved, int *nsaved) {
+    digest *d = digest_sync(b);
+    if (d == NULL) {
+        return false;
+    }
+
+    *lines = d->lines;
+    *len = d->len;
+    *saved = d->saved;
+    *nsaved = d->nsaved;
+    return true;
+}
@@ -6,11 +6,43 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
 
 #include <core/file.h>
 #include <core/jet.h>
 
+/* size of each read() issued against files and streams */
+#define READ_CHUNK 65536
+
+/* most bytes a single readstream() call will consume before yielding */
+#define STREAM_BUDGET (1 << 20)
+
+/* split data into lines, appending to the last line of the buffer */
+static void bfeed(buffer *b, const char *data, size_t len) {
+    while (len > 0) {
+        const char *nl = memchr(data, '\n', len);
+        size_t n = nl != NULL ? (size_t)(nl - data) : len;
+        line *l = b->lines[b->len - 1];
+
+        if (n > 0) {
+            laddstr(l, data, n, l->len);
+            bdamage(b, b->len - 1, b->len - 1);
+            bnotify(b, b->len - 1, 0);
+        }
+        if (nl == NULL) {
+            break;
+        }
+
+        // the line is finished, start the next one
+        bappendline(b, newline(b->pool));
+        data += n + 1;
+        len -= n + 1;
+    }
+}
+
 /* opens a file using the given filename, and parses it into a buffer */
 buffer *readbuf(const char *filename) {
     buffer *b;
@@ -27,51 +59,136 @@ buffer *readbuf(const char *filename) {
     }
 
     // otherwise, attempt to open
-    FILE *f = fopen(filename, "r");
-    if (f == NULL) {
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
         die("Failed to open file for reading", 1);
     }
 
     // read lines to the buffer
-    char c;
-    int i = 0;
-    line *l = newline();
-    do {
-        c = getc(f);
-        if (c == '\n') {
-            bappendline(b, l);
-            l = newline();
-            i = 0;
-        } else {
-            laddch(l, c, i);
-            i++;
-        }
-    } while (c != EOF);
-    fclose(f);
+    char chunk[READ_CHUNK];
+    ssize_t n;
+    bappendline(b, newline(b->pool));
+    while ((n = read(fd, chunk, sizeof(chunk))) > 0) {
+        bfeed(b, chunk, n);
+    }
+    close(fd);
+
+    // a trailing newline does not start another line
+    if (b->lines[b->len - 1]->len == 0) {
+        bdelline(b, b->len - 1);
+    }
 
     b->dirty = false;
 
     return b;
 }
 
+/* opens a file for viewing only, without loading it */
+buffer *viewbuf(const char *filename) {
+    lineindex *ix = newindex(filename);
+    if (ix == NULL) {
+        return NULL;
+    }
+
+    buffer *b = newbuf();
+    bname(b, filename);
+    b->index = ix;
+
+    // count the first screenful or so right away
+    bensure(b, INDEX_STRIDE);
+
+    return b;
+}
+
+/* wraps an open stream in a new buffer, to be filled by readstream() */
+buffer *openstream(int fd) {
+    buffer *b = newbuf();
+
+    // never block the caller waiting for input
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    b->fd = fd;
+
+    // incoming text is always appended to the last line
+    bappendline(b, newline(b->pool));
+    b->dirty = false;
+
+    return b;
+}
+
+/* reads the input currently available on the buffer's stream */
+long readstream(buffer *b) {
+    if (b->fd == -1) {
+        return -1;
+    }
+
+    char chunk[READ_CHUNK];
+    bool dirty = b->dirty;
+    long total = 0;
+    ssize_t n = 0;
+
+    while (total < STREAM_BUDGET && (n = read(b->fd, chunk, sizeof(chunk))) > 0) {
+        bfeed(b, chunk, n);
+        total += n;
+    }
+    b->dirty = dirty;
+
+    // keep going if we ran out of budget or the stream is simply not ready
+    if (n > 0 || (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))) {
+        return total;
+    }
+
+    // end of stream (or a hard error), drop the empty line left after the final newline
+    close(b->fd);
+    b->fd = -1;
+    if (b->len > 1 && b->lines[b->len - 1]->len == 0) {
+        bdelline(b, b->len - 1);
+        b->dirty = dirty;
+    }
+
+    return total > 0 ? total : -1;
+}
+
 /* attempts to write a buffer to the given file. returns -1 if it fails */
 /* TODO return bytes written */
 int writebufto(buffer *b, const char *filename) {
+    // a viewed file is unchanged, and truncating the mapping would pull it out from under us
+    if (b->index != NULL && b->name != NULL && strcmp(filename, b->name) == 0) {
+        return 0;
+    }
+
     // attempt to open file for writing
     FILE *f = fopen(filename, "w");
     if (f == NULL) {
         return -1;
     }
 
-    // write the file
-    for (int i = 0; i < b->len; i++) {
-        fputs(b->lines[i]->s, f);
-        fputc('\n', f);
+    // a viewed file was never changed, so just copy the mapping
+    if (b->index != NULL) {
+        bool failed = fwrite(b->index->map, 1, b->index->size, f) != b->index->size;
+        return fclose(f) == EOF || failed ? -1 : 0;
     }
 
-    // close
-    fclose(f);
+    // write the file, noticing if any of it didn't make it (a full disk, say)
+    bool failed = false;
+    for (int i = 0; i < b->len && !failed; i++) {
+        failed = fputs(b->lines[i]->s, f) == EOF || fputc('\n', f) == EOF;
+    }
+
+    // close. the journal of edits to the file starts again, once they are safely in it, and a
+    // file that wasn't all written keeps the buffer dirty and its journal
+    bool own = b->name != NULL && strcmp(filename, b->name) == 0;
+    if (!failed && own && b->journal != NULL) {
+        failed = fflush(f) == EOF || fsync(fileno(f)) == -1;
+    }
+    if (fclose(f) == EOF || failed) {
+        return -1;
+    }
     b->dirty = false;
+    if (own) {
+        journal_saved(b);
+        digest_save(b);
+        watch_saved(b);
+    }
     return 0;
 }
 
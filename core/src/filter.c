@@ -0,0 +1,294 @@
+/*
+ * filter.c
+ * Running lines of a buffer through an external command
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <core/filter.h>
+#include <core/mem.h>
+
+static double filter_clock() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* close those of n descriptors that are open */
+static void filter_close(int *fds, int n) {
+    for (int i = 0; i < n; i++) {
+        if (fds[i] != -1) {
+            close(fds[i]);
+        }
+    }
+}
+
+/* a pipe neither end of which is kept through exec, which only those dup2'd to are */
+static int filter_pipe(int *fds) {
+    if (pipe(fds) == -1) {
+        return -1;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return 0;
+}
+
+/* write as much of lines y + at.. as the pipe takes, starting off bytes into the first (its newline
+ * being at its length). false once it takes no more, the command having stopped reading */
+static bool filter_write(buffer *b, int fd, int y, int n, int *at, int *off) {
+    static char block[FILTER_BLOCK];
+    int len = 0;
+
+    // the block is filled right up, splitting the last line, as a pipe left a few bytes short of
+    // full only takes those few on the next write
+    for (int i = *at, from = *off; i < n && len < FILTER_BLOCK; i++, from = 0) {
+        line *l = bline(b, y + i);
+        int take = l->len + 1 - from < FILTER_BLOCK - len ? l->len + 1 - from : FILTER_BLOCK - len;
+        int text = l->len - from < take ? l->len - from : take;
+        memcpy(block + len, l->s + from, text);
+        if (text < take) {
+            block[len + text] = '\n';
+        }
+        len += take;
+    }
+
+    ssize_t wrote = write(fd, block, len);
+    if (wrote == -1) {
+        return errno == EAGAIN || errno == EINTR;
+    }
+    while (wrote > 0) {
+        int left = bline(b, y + *at)->len + 1 - *off;
+        if (wrote < left) {
+            *off += wrote;
+            break;
+        }
+        wrote -= left;
+        (*at)++;
+        *off = 0;
+    }
+    return true;
+}
+
+/* read what is waiting on fd onto the end of out, growing it as needed up to max bytes (and one
+ * more, to tell there were more than max). what comes after that is read and dropped. false once
+ * it has ended */
+static bool filter_read(int fd, char **out, int64_t *len, int64_t *cap, int64_t max) {
+    static char drop[4096];
+    if (*len <= max && *cap - *len < 4096) {
+        *cap = *cap > 0 ? *cap * 2 : 65536;
+        *cap = *cap < max + 1 ? *cap : max + 1;
+        *out = mem_realloc(MEM_FILE, *out, *cap);
+    }
+    ssize_t got = *len <= max ? read(fd, *out + *len, *cap - *len) : read(fd, drop, sizeof(drop));
+    if (got > 0 && *len <= max) {
+        *len += got;
+    }
+    return got > 0 || (got == -1 && (errno == EAGAIN || errno == EINTR));
+}
+
+/* lines the output starts with that are lines y.. of the buffer as they were, moving out past them */
+static int filter_same(buffer *b, int y, int n, const char **out, const char *end) {
+    int same = 0;
+    while (same < n) {
+        line *l = bline(b, y + same);
+        if (end - *out <= l->len || (*out)[l->len] != '\n' || memcmp(*out, l->s, l->len) != 0) {
+            break;
+        }
+        *out += l->len + 1;
+        same++;
+    }
+    return same;
+}
+
+/* the same for the lines the output ends with, which are lines ..y + n - 1, moving end back past them */
+static int filter_sametail(buffer *b, int y, int n, const char *out, const char **end) {
+    int same = 0;
+    while (same < n) {
+        line *l = bline(b, y + n - 1 - same);
+        const char *start = *end - 1 - l->len;
+        if (start < out || (start > out && start[-1] != '\n') || memcmp(start, l->s, l->len) != 0) {
+            break;
+        }
+        *end = start;
+        same++;
+    }
+    return same;
+}
+
+int filter_lines(buffer *b, int y, int n, const char *command, filter_stopfn stop, void *data, char *error, int size) {
+    error[0] = '\0';
+    if (!beditable(b) || y < 0 || n < 0 || y + n > b->len) {
+        snprintf(error, size, "Buffer can't be edited");
+        return -1;
+    }
+
+    // the command's input, output and errors, the ends it reads first
+    int pipes[6] = {-1, -1, -1, -1, -1, -1};
+    int *in = pipes, *out = pipes + 2, *err = pipes + 4;
+    if (filter_pipe(in) == -1 || filter_pipe(out) == -1 || filter_pipe(err) == -1) {
+        snprintf(error, size, "%s", strerror(errno));
+        filter_close(pipes, 6);
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        // whatever the editor blocks (SIGWINCH, say) would stay blocked through exec
+        sigset_t none;
+        sigemptyset(&none);
+        sigprocmask(SIG_SETMASK, &none, NULL);
+
+        // in a group of its own, so whatever it starts goes with it if it is killed
+        setpgid(0, 0);
+        dup2(in[0], STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        dup2(err[1], STDERR_FILENO);
+        execl("/bin/sh", "sh", "-c", command, (char *)NULL);
+        _exit(127);
+    }
+    close(in[0]);
+    close(out[1]);
+    close(err[1]);
+    if (pid != -1) {
+        setpgid(pid, pid);
+    }
+    if (pid == -1) {
+        snprintf(error, size, "%s", strerror(errno));
+        int ends[] = {in[1], out[0], err[0]};
+        filter_close(ends, 3);
+        return -1;
+    }
+
+    // a command that stops reading early (head, say) mustn't take the editor down with it
+    struct sigaction ignore = { .sa_handler = SIG_IGN }, was;
+    sigemptyset(&ignore.sa_mask);
+    sigaction(SIGPIPE, &ignore, &was);
+
+    int wfd = in[1], rfd = out[0], efd = err[0];
+    fcntl(wfd, F_SETFL, O_NONBLOCK);
+    fcntl(rfd, F_SETFL, O_NONBLOCK);
+    fcntl(efd, F_SETFL, O_NONBLOCK);
+    if (n == 0) {
+        close(wfd);
+        wfd = -1;
+    }
+
+    // written and read together, or a command with more output than a pipe holds would never finish
+    char *text = NULL, *errors = NULL;
+    int64_t len = 0, cap = 0, errlen = 0, errcap = 0;
+    int at = 0, off = 0;
+    const char *stopped = NULL;
+    double ask = filter_clock() + FILTER_TICK / 1000.0;
+    while ((rfd != -1 || efd != -1) && stopped == NULL) {
+        // the caller gets its say however busy the command keeps the pipes
+        if (stop != NULL && filter_clock() >= ask) {
+            ask = filter_clock() + FILTER_TICK / 1000.0;
+            if (stop(data)) {
+                stopped = "Stopped";
+                break;
+            }
+        }
+
+        struct pollfd fds[] = {{wfd, POLLOUT, 0}, {rfd, POLLIN, 0}, {efd, POLLIN, 0}};
+        if (poll(fds, 3, FILTER_TICK) == -1) {
+            stopped = errno != EINTR ? strerror(errno) : NULL;
+            continue;
+        }
+        if (fds[0].revents != 0 && (!filter_write(b, wfd, y, n, &at, &off) || at == n)) {
+            close(wfd);
+            wfd = -1;
+        }
+        if (fds[1].revents != 0 && !filter_read(rfd, &text, &len, &cap, FILTER_MAX)) {
+            close(rfd);
+            rfd = -1;
+        }
+        if (fds[2].revents != 0 && !filter_read(efd, &errors, &errlen, &errcap, FILTER_BLOCK)) {
+            close(efd);
+            efd = -1;
+        }
+        if (len > FILTER_MAX) {
+            stopped = "Output too large";
+        }
+    }
+    if (stopped != NULL) {
+        kill(-pid, SIGKILL);
+    }
+    int ends[] = {wfd, rfd, efd};
+    filter_close(ends, 3);
+    sigaction(SIGPIPE, &was, NULL);
+
+    // a command can close its output and still not exit, so the caller still gets its say
+    int status = -1;
+    for (;;) {
+        pid_t done = waitpid(pid, &status, stopped != NULL ? 0 : WNOHANG);
+        if (done == pid || (done == -1 && errno != EINTR)) {
+            break;
+        }
+        if (done == 0 && stop != NULL && filter_clock() >= ask) {
+            ask = filter_clock() + FILTER_TICK / 1000.0;
+            if (stop(data)) {
+                stopped = "Stopped";
+                kill(-pid, SIGKILL);
+            }
+        } else if (done == 0) {
+            poll(NULL, 0, 1);
+        }
+    }
+
+    if (stopped != NULL) {
+        snprintf(error, size, "%s", stopped);
+        mem_free(MEM_FILE, text);
+        mem_free(MEM_FILE, errors);
+        return -1;
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        const char *nl = errlen > 0 ? memchr(errors, '\n', errlen) : NULL;
+        int shown = nl != NULL ? nl - errors : errlen;
+        if (shown > 0) {
+            snprintf(error, size, "%.*s", shown, errors);
+        } else if (WIFEXITED(status)) {
+            snprintf(error, size, "Exited with status %d", WEXITSTATUS(status));
+        } else {
+            snprintf(error, size, "Killed by signal %d", WTERMSIG(status));
+        }
+        mem_free(MEM_FILE, text);
+        mem_free(MEM_FILE, errors);
+        return -1;
+    }
+    mem_free(MEM_FILE, errors);
+
+    // output without a newline at the end still ends its last line
+    if (len > 0 && text[len - 1] != '\n') {
+        if (len == cap) {
+            text = mem_realloc(MEM_FILE, text, ++cap);
+        }
+        text[len++] = '\n';
+    }
+    int lines = 0;
+    for (const char *p = text, *end = text + len; p < end && (p = memchr(p, '\n', end - p)) != NULL; p++) {
+        lines++;
+    }
+
+    // lines given back as they were are kept, so they aren't highlighted (or journaled) again
+    const char *start = text, *end = text + len;
+    int head = filter_same(b, y, n, &start, end);
+    int tail = filter_sametail(b, y + head, n - head, start, &end);
+    if (head + tail < n || start < end) {
+        breplace(b, y + head, n - head - tail, start, end - start);
+    }
+    if (b->len == 0) {
+        baddline(b, 0);
+    }
+    mem_free(MEM_FILE, text);
+    return lines;
+}
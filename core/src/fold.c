@@ -0,0 +1,269 @@
+/*
+ * fold.c
+ * Folding ranges of lines away, and finding the rows the rest are shown on
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#include <string.h>
+#include <limits.h>
+
+#include <core/fold.h>
+#include <core/syntax.h>
+#include <core/nest.h>
+#include <core/mem.h>
+
+/* sort the outermost folds out from the rest, after any change to them */
+static void fold_sync(buffer *b) {
+    folds *fs = b->folds;
+
+    if (fs->topcap < fs->len) {
+        fs->topcap = fs->len;
+        fs->top = mem_realloc(MEM_BUFFER, fs->top, sizeof(fold) * fs->topcap);
+        fs->before = mem_realloc(MEM_BUFFER, fs->before, sizeof(int) * fs->topcap);
+    }
+
+    // the folds are in order of start, so anything starting inside the last outermost one is in it
+    int hidden = 0;
+    fs->ntop = 0;
+    for (int i = 0; i < fs->len; i++) {
+        if (fs->ntop > 0 && fs->f[i].start <= fs->top[fs->ntop - 1].end) {
+            continue;
+        }
+        fs->top[fs->ntop] = fs->f[i];
+        fs->before[fs->ntop] = hidden;
+        hidden += fs->f[i].end - fs->f[i].start;
+        fs->ntop++;
+    }
+    fs->version++;
+}
+
+/* take fold i out, the lines from its start on moving */
+static void fold_remove(buffer *b, int i) {
+    folds *fs = b->folds;
+    bdamage(b, fs->f[i].start, INT_MAX);
+    fs->len--;
+    memmove(&fs->f[i], &fs->f[i + 1], sizeof(fold) * (fs->len - i));
+}
+
+/* keep the folds on the same lines as lines are added and removed. an edit to a hidden line, or
+ * lines added or removed within a fold, opens it */
+static void fold_observe(buffer *b, int y, int n, void *data) {
+    folds *fs = data;
+    int had = fs->len;
+
+    for (int i = 0; i < fs->len; i++) {
+        fold *f = &fs->f[i];
+        if (n == 0) {
+            if (y > f->start && y <= f->end) {
+                fold_remove(b, i--);
+            }
+        } else if (n > 0 ? y <= f->start : y - n <= f->start) {
+            f->start += n;
+            f->end += n;
+        } else if (y <= f->end) {
+            fold_remove(b, i--);
+        }
+    }
+
+    if (n != 0 || fs->len != had) {
+        fold_sync(b);
+    }
+}
+
+/* the outermost fold starting at or before y, -1 if there isn't one */
+static int fold_top(folds *fs, int y) {
+    int lo = 0, hi = fs->ntop;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (fs->top[mid].start <= y) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo - 1;
+}
+
+bool fold_close(buffer *b, int start, int end) {
+    if (start < 0 || end <= start || end >= b->len) {
+        return false;
+    }
+
+    if (b->folds == NULL) {
+        b->folds = mem_calloc(MEM_BUFFER, 1, sizeof(folds));
+        bobserve(b, fold_observe, b->folds);
+    }
+    folds *fs = b->folds;
+
+    // folds either hold each other or are apart, and the same one can't be closed twice
+    int at = 0;
+    for (int i = 0; i < fs->len; i++) {
+        fold f = fs->f[i];
+        bool apart = f.end < start || f.start > end;
+        bool inside = f.start >= start && f.end <= end;
+        bool holds = f.start <= start && f.end >= end;
+        if ((f.start == start && f.end == end) || (!apart && !inside && !holds)) {
+            return false;
+        }
+        if (f.start < start || (f.start == start && f.end > end)) {
+            at = i + 1;
+        }
+    }
+
+    if (fs->len == fs->cap) {
+        fs->cap = fs->cap > 0 ? fs->cap * 2 : 16;
+        fs->f = mem_realloc(MEM_BUFFER, fs->f, sizeof(fold) * fs->cap);
+    }
+    memmove(&fs->f[at + 1], &fs->f[at], sizeof(fold) * (fs->len - at));
+    fs->f[at].start = start;
+    fs->f[at].end = end;
+    fs->len++;
+
+    fold_sync(b);
+    bdamage(b, start, INT_MAX);
+    return true;
+}
+
+bool fold_open(buffer *b, int y) {
+    folds *fs = b->folds;
+    int i = fs != NULL ? fold_top(fs, y) : -1;
+    if (i == -1 || fs->top[i].start != y) {
+        return false;
+    }
+
+    // the outermost of the folds starting on y comes first
+    int k = 0;
+    while (fs->f[k].start != y) {
+        k++;
+    }
+    fold_remove(b, k);
+    fold_sync(b);
+    return true;
+}
+
+void fold_reveal(buffer *b, int y) {
+    folds *fs = b->folds;
+    if (fs == NULL || fold_shown(b, y) == y) {
+        return;
+    }
+
+    for (int i = 0; i < fs->len; i++) {
+        if (y > fs->f[i].start && y <= fs->f[i].end) {
+            fold_remove(b, i--);
+        }
+    }
+    fold_sync(b);
+}
+
+void fold_clear(buffer *b) {
+    folds *fs = b->folds;
+    if (fs == NULL) {
+        return;
+    }
+
+    bunobserve(b, fold_observe, fs);
+    mem_free(MEM_BUFFER, fs->f);
+    mem_free(MEM_BUFFER, fs->top);
+    mem_free(MEM_BUFFER, fs->before);
+    mem_free(MEM_BUFFER, fs);
+    b->folds = NULL;
+}
+
+int fold_version(buffer *b) {
+    return b->folds != NULL ? b->folds->version : 0;
+}
+
+int fold_shown(buffer *b, int y) {
+    folds *fs = b->folds;
+    int i = fs != NULL ? fold_top(fs, y) : -1;
+    return i != -1 && y <= fs->top[i].end ? fs->top[i].start : y;
+}
+
+int fold_last(buffer *b, int y) {
+    folds *fs = b->folds;
+    int i = fs != NULL ? fold_top(fs, y) : -1;
+    return i != -1 && fs->top[i].start == y ? fs->top[i].end : y;
+}
+
+int fold_row(buffer *b, int y) {
+    folds *fs = b->folds;
+    int i = fs != NULL ? fold_top(fs, y) : -1;
+    if (i == -1) {
+        return y;
+    }
+
+    fold f = fs->top[i];
+    return (y <= f.end ? f.start : y - (f.end - f.start)) - fs->before[i];
+}
+
+int fold_line(buffer *b, int row) {
+    folds *fs = b->folds;
+    if (fs == NULL || fs->ntop == 0) {
+        return row;
+    }
+
+    // the last fold shown on or above the row
+    int lo = 0, hi = fs->ntop;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (fs->top[mid].start - fs->before[mid] <= row) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0) {
+        return row;
+    }
+
+    fold f = fs->top[lo - 1];
+    int y = row + fs->before[lo - 1];
+    return y == f.start ? y : y + (f.end - f.start);
+}
+
+/* finding folds */
+
+bool fold_find(buffer *b, int y, int *start, int *end) {
+    bensure(b, y + 1);
+    if (y < 0 || y >= b->len) {
+        return false;
+    }
+
+    // a block opened on the line, the first brace it leaves open being the outermost
+    int oy, ox, cy, cx;
+    line *l = bline(b, y);
+    if (nest_open(b, NEST_BRACE, y, l->len, &oy, &ox) && oy == y) {
+        while (nest_open(b, NEST_BRACE, y, ox, &oy, &cx) && oy == y) {
+            ox = cx;
+        }
+        *start = y;
+        *end = nest_match(b, y, ox, INT_MAX, &cy, &cx) ? cy : -1;
+        return *end > y;
+    }
+
+    // an encapsulation the line opens, up to the line it ends on. the lines after have to be
+    // highlighted to know where that is
+    l = bline(b, y);
+    int enc = l->hlend;
+    if (enc != -1 && l->hlstart != enc && l->hlvalid == l->len) {
+        int z = y + 1;
+        for (; z < b->len; z++) {
+            gen_syntax(b, z + 1, INT_MAX);
+            if (bline(b, z)->hlend != enc) {
+                break;
+            }
+        }
+        *start = y;
+        *end = z < b->len ? z : b->len - 1;
+        return *end > y;
+    }
+
+    // the brace still open at the start of the line, which is the one a brace closing on it would
+    // close
+    if (nest_open(b, NEST_BRACE, y, 0, &oy, &ox) && nest_match(b, oy, ox, INT_MAX, &cy, &cx)) {
+        *start = oy;
+        *end = cy;
+        return *end > oy;
+    }
+    return false;
+}
@@ -0,0 +1,49 @@
+/*
+ * hash.c
+ * Non-cryptographic hashing of byte strings (64 bit FNV-1a, and a quicker one a word at a time)
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#include <string.h>
+
+#include <core/hash.h>
+
+#define HASH_PRIME 0x100000001b3ULL
+
+uint64_t hash_bytes(uint64_t h, const void *data, size_t len) {
+    const unsigned char *p = data;
+
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= HASH_PRIME;
+    }
+    return h;
+}
+
+/* spread the bits of a word over all of it (the finalizer of MurmurHash3) */
+static uint64_t hash_mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+uint64_t hash_block(const void *data, size_t len) {
+    const unsigned char *p = data;
+    uint64_t h = HASH_SEED ^ (len * HASH_PRIME);
+
+    // each word is mixed in with a multiply, the last few bytes being padded out to one
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        h = (h ^ hash_mix(w)) * HASH_PRIME;
+    }
+    if (len > 0) {
+        uint64_t w = 0;
+        memcpy(&w, p, len);
+        h = (h ^ hash_mix(w)) * HASH_PRIME;
+    }
+    return hash_mix(h);
+}
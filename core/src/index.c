@@ -0,0 +1,129 @@
+/*
+ * index.c
+ * Implements the sparse line index used for viewing huge files
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <core/index.h>
+#include <core/mem.h>
+
+/* remember the start of a line as a checkpoint */
+static void ixmark(lineindex *ix, size_t off) {
+    if (ix->nmarks == ix->cap) {
+        ix->cap = ix->cap > 0 ? ix->cap * 2 : 64;
+        ix->marks = mem_realloc(MEM_FILE, ix->marks, sizeof(size_t) * ix->cap);
+    }
+    ix->marks[ix->nmarks++] = off;
+}
+
+/* maps the file and sets up an empty index */
+lineindex *newindex(const char *filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+
+    lineindex *ix = mem_calloc(MEM_FILE, 1, sizeof(lineindex));
+    ix->fd = fd;
+    ix->map = map;
+    ix->size = st.st_size;
+    for (int i = 0; i < INDEX_CACHE; i++) {
+        ix->cachey[i] = -1;
+    }
+
+    // line 0 always starts at the beginning
+    ixmark(ix, 0);
+
+    return ix;
+}
+
+/* unmaps the file and frees the index */
+void delindex(lineindex *ix) {
+    for (int i = 0; i < INDEX_CACHE; i++) {
+        if (ix->cache[i] != NULL) {
+            delline(ix->cache[i]);
+        }
+    }
+    munmap((void*)ix->map, ix->size);
+    close(ix->fd);
+    mem_free(MEM_FILE, ix->marks);
+    mem_free(MEM_FILE, ix);
+}
+
+/* count lines until len of them are known */
+void ixextend(lineindex *ix, int len) {
+    while (!ix->complete && ix->known < len) {
+        const char *start = ix->map + ix->scanned;
+        const char *nl = memchr(start, '\n', ix->size - ix->scanned);
+
+        // an unterminated last line still counts
+        ix->known++;
+        ix->scanned = nl != NULL ? (size_t)(nl - ix->map) + 1 : ix->size;
+        if (ix->scanned == ix->size) {
+            ix->complete = true;
+        } else if (ix->known % INDEX_STRIDE == 0) {
+            ixmark(ix, ix->scanned);
+        }
+    }
+}
+
+/* find the offset of line y by scanning forward from the nearest known position */
+static size_t ixseek(lineindex *ix, int y) {
+    int from = y - y % INDEX_STRIDE;
+    size_t off = ix->marks[y / INDEX_STRIDE];
+
+    // the previous lookup may be closer
+    if (ix->lasty <= y && ix->lasty > from) {
+        from = ix->lasty;
+        off = ix->lastoff;
+    }
+
+    for (; from < y; from++) {
+        off = (const char*)memchr(ix->map + off, '\n', ix->size - off) - ix->map + 1;
+    }
+
+    ix->lasty = y;
+    ix->lastoff = off;
+    return off;
+}
+
+/* returns line y, materializing it from the mapping if needed */
+line *ixline(lineindex *ix, int y) {
+    int slot = y % INDEX_CACHE;
+    if (ix->cachey[slot] == y) {
+        return ix->cache[slot];
+    }
+
+    size_t off = ixseek(ix, y);
+    const char *end = memchr(ix->map + off, '\n', ix->size - off);
+    int len = end != NULL ? end - (ix->map + off) : (int)(ix->size - off);
+
+    // reuse whatever line previously occupied the slot
+    line *l = ix->cache[slot];
+    if (l == NULL) {
+        l = ix->cache[slot] = newline(NULL);
+    }
+    lset(l, ix->map + off, len);
+    ix->cachey[slot] = y;
+
+    return l;
+}
@@ -0,0 +1,315 @@
+/*
+ * journal.c
+ * Appending edits to a journal in batches, and replaying one left by a crash
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <core/journal.h>
+#include <core/mem.h>
+
+/* what every journal starts with, before the version of the file it is of */
+#define JOURNAL_MAGIC "jet-journal 1\n"
+#define JOURNAL_HEADER (sizeof(JOURNAL_MAGIC) - 1 + sizeof(journal_file))
+
+static double journal_clock() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* the version of the file at path, a size of -1 if there isn't one */
+static journal_file journal_stat(const char *path) {
+    journal_file f = {-1, 0, 0, 0};
+    struct stat st;
+    if (stat(path, &st) == 0) {
+        f.size = st.st_size;
+        f.sec = st.st_mtim.tv_sec;
+        f.nsec = st.st_mtim.tv_nsec;
+        f.ino = st.st_ino;
+    }
+    return f;
+}
+
+/* .name.journal, in the same directory as name */
+static char *journal_path(const char *name) {
+    const char *slash = strrchr(name, '/');
+    int dir = slash != NULL ? slash + 1 - name : 0;
+    char *path = mem_alloc(MEM_FILE, strlen(name) + 16);
+    sprintf(path, "%.*s.%s.journal", dir, name, name + dir);
+    return path;
+}
+
+/* add bytes to the records waiting */
+static void journal_put(journal *j, const void *data, int len) {
+    if (j->len + len > j->cap) {
+        j->cap = j->cap > 0 ? j->cap : 4096;
+        while (j->cap < j->len + len) {
+            j->cap *= 2;
+        }
+        j->pending = mem_realloc(MEM_FILE, j->pending, j->cap);
+    }
+    memcpy(j->pending + j->len, data, len);
+    j->len += len;
+}
+
+/* add a number, seven bits a byte, every byte but the last having its top bit set */
+static void journal_num(journal *j, int n) {
+    unsigned char bytes[5];
+    unsigned v = n;
+    int len = 0;
+    do {
+        bytes[len++] = (v & 0x7f) | (v >= 0x80 ? 0x80 : 0);
+        v >>= 7;
+    } while (v > 0);
+    journal_put(j, bytes, len);
+}
+
+void journal_edit(buffer *b, enum journal_op op, int y, int x, const char *s, int len) {
+    journal *j = b->journal;
+    if (j == NULL || j->failed) {
+        return;
+    }
+
+    if (j->len == 0) {
+        j->since = journal_clock();
+    }
+    unsigned char c = op;
+    journal_put(j, &c, 1);
+    journal_num(j, y);
+    if (op != JOURNAL_ADDLINE && op != JOURNAL_DELLINE && op != JOURNAL_DELBREAK) {
+        journal_num(j, x);
+    }
+    if (op == JOURNAL_ADDSTR || op == JOURNAL_REPLACE) {
+        journal_num(j, len);
+        if (len > 0) {
+            journal_put(j, s, len);
+        }
+    }
+}
+
+/* read a number from *p, false if the journal ends before it does */
+static bool journal_getnum(const char **p, const char *end, int *n) {
+    unsigned v = 0;
+    for (int shift = 0; *p < end && shift < 32; shift += 7) {
+        unsigned char c = *(*p)++;
+        v |= (unsigned)(c & 0x7f) << shift;
+        if (!(c & 0x80)) {
+            *n = v;
+            return v <= INT_MAX;
+        }
+    }
+    return false;
+}
+
+/* make the edit recorded at *p, moving past it. false if the record is cut short or doesn't fit
+ * the buffer, as the rest of a journal can't be trusted from there */
+static bool journal_apply(buffer *b, const char **p, const char *end) {
+    if (*p == end) {
+        return false;
+    }
+    int op = (unsigned char)*(*p)++;
+    int y, x = 0, len = 0;
+    if (!journal_getnum(p, end, &y) || y >= b->len + (op == JOURNAL_ADDLINE || op == JOURNAL_REPLACE)) {
+        return false;
+    }
+    bool column = op != JOURNAL_ADDLINE && op != JOURNAL_DELLINE && op != JOURNAL_DELBREAK;
+    if (column && !journal_getnum(p, end, &x)) {
+        return false;
+    }
+    bool text = op == JOURNAL_ADDSTR || op == JOURNAL_REPLACE;
+    if (text && (!journal_getnum(p, end, &len) || end - *p < len)) {
+        return false;
+    }
+
+    int linelen = y < b->len ? bline(b, y)->len : 0;
+    switch (op) {
+        case JOURNAL_ADDLINE:
+            baddline(b, y);
+            return true;
+        case JOURNAL_DELLINE:
+            bdelline(b, y);
+            return true;
+        case JOURNAL_ADDSTR:
+            if (x > linelen) {
+                return false;
+            }
+            baddstr(b, *p, len, y, x);
+            *p += len;
+            return true;
+        case JOURNAL_DELCH:
+            if (x >= linelen) {
+                return false;
+            }
+            bdelch(b, y, x);
+            return true;
+        case JOURNAL_ADDBREAK:
+            if (x > linelen) {
+                return false;
+            }
+            baddbreak(b, y, x);
+            return true;
+        case JOURNAL_DELBREAK:
+            if (y == 0) {
+                return false;
+            }
+            bdelbreak(b, y);
+            return true;
+        case JOURNAL_REPLACE:
+            if (x > b->len - y) {
+                return false;
+            }
+            breplace(b, y, x, *p, len);
+            *p += len;
+            return true;
+    }
+    return false;
+}
+
+/* replay the journal at j's path over the buffer, carrying on from its end. returns how many edits
+ * there were, -1 if it was of another version of the file */
+static int journal_replay(buffer *b, journal *j) {
+    int fd = open(j->path, O_RDWR | O_APPEND);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        if (fd != -1) {
+            close(fd);
+        }
+        return 0;
+    }
+
+    char *data = mem_alloc(MEM_FILE, st.st_size > 0 ? st.st_size : 1);
+    ssize_t got = 0, n;
+    while (got < st.st_size && (n = read(fd, data + got, st.st_size - got)) > 0) {
+        got += n;
+    }
+
+    // a journal of anything but the file as it is now is kept out of the way
+    if (got < (ssize_t)JOURNAL_HEADER || memcmp(data, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC) - 1) != 0
+            || memcmp(data + sizeof(JOURNAL_MAGIC) - 1, &j->of, sizeof(journal_file)) != 0) {
+        mem_free(MEM_FILE, data);
+        close(fd);
+
+        char old[strlen(j->path) + 8];
+        sprintf(old, "%s.old", j->path);
+        rename(j->path, old);
+        return -1;
+    }
+
+    // a crash can cut the last record short, which goes so the journal carries on after the others
+    const char *p = data + JOURNAL_HEADER, *end = data + got;
+    const char *good = p;
+    int edits = 0;
+    while (journal_apply(b, &p, end)) {
+        good = p;
+        edits++;
+    }
+    if (good != end && ftruncate(fd, good - data) == -1) {
+        edits = 0;
+    }
+    mem_free(MEM_FILE, data);
+
+    j->fd = fd;
+    return edits;
+}
+
+int journal_start(buffer *b) {
+    if (b->name == NULL || !beditable(b) || b->fd != -1 || b->journal != NULL) {
+        return 0;
+    }
+
+    journal *j = mem_calloc(MEM_FILE, 1, sizeof(journal));
+    j->path = journal_path(b->name);
+    j->fd = -1;
+    j->of = journal_stat(b->name);
+
+    // the edits replayed aren't journaled again
+    int recovered = journal_replay(b, j);
+    b->journal = j;
+    return recovered;
+}
+
+/* close the journal and remove it, the records waiting going with it */
+static void journal_remove(journal *j) {
+    if (j->fd != -1) {
+        close(j->fd);
+        unlink(j->path);
+        j->fd = -1;
+    }
+    j->len = 0;
+}
+
+void journal_end(buffer *b) {
+    journal *j = b->journal;
+    if (j == NULL) {
+        return;
+    }
+
+    journal_remove(j);
+    mem_free(MEM_FILE, j->path);
+    mem_free(MEM_FILE, j->pending);
+    mem_free(MEM_FILE, j);
+    b->journal = NULL;
+}
+
+/* write len bytes, false if they didn't all go */
+static bool journal_write(int fd, const char *data, int len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+int journal_flush(buffer *b, bool now) {
+    journal *j = b->journal;
+    if (j == NULL || j->len == 0) {
+        return -1;
+    }
+    int wait = JOURNAL_DELAY - (int)((journal_clock() - j->since) * 1000);
+    if (!now && wait > 0) {
+        return wait;
+    }
+
+    bool written = true;
+    if (j->fd == -1) {
+        j->fd = open(j->path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0600);
+        written = j->fd != -1 && journal_write(j->fd, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC) - 1)
+                && journal_write(j->fd, (const char *)&j->of, sizeof(journal_file));
+    }
+    written = written && journal_write(j->fd, j->pending, j->len) && fdatasync(j->fd) == 0;
+    j->len = 0;
+
+    // the edits already in the journal still replay right, a record cut short being dropped, but
+    // any after one missing wouldn't, so none are added until it starts again
+    if (!written) {
+        j->failed = true;
+        return JOURNAL_FAILED;
+    }
+    return -1;
+}
+
+void journal_saved(buffer *b) {
+    journal *j = b->journal;
+    if (j == NULL) {
+        return;
+    }
+
+    journal_remove(j);
+    mem_free(MEM_FILE, j->path);
+    j->path = journal_path(b->name);
+    j->of = journal_stat(b->name);
+    j->failed = false;
+}
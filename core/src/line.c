@@ -6,98 +6,506 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <ctype.h>
+#include <limits.h>
 
 #include <core/line.h>
+#include <core/mem.h>
+#include <core/utf8.h>
+
+/*
+ * Columns of lines that aren't plain ASCII are measured from the start, as tabs
+ * depend on the column they are at, but only as far as has been asked for. A stop
+ * is kept at the first character boundary every LCOL_STEP bytes, so the column of
+ * a byte is found from the stop just before it, and the byte at a column from a
+ * binary search of the stops, either way decoding at most a step of text. An edit
+ * only throws away the stops after it.
+ */
+
+/* allocation helpers, lines without a pool live on the heap */
+static void *lalloc(pool *p, size_t size) {
+    return p != NULL ? palloc(p, size) : mem_alloc(MEM_LINE, size);
+}
+
+static void *lrealloc(pool *p, void *ptr, size_t size, size_t newsize) {
+    return p != NULL ? prealloc(p, ptr, size, newsize) : mem_realloc(MEM_LINE, ptr, newsize);
+}
+
+static void lfree(pool *p, void *ptr, size_t size) {
+    if (p != NULL) {
+        pfree(p, ptr, size);
+    } else {
+        mem_free(MEM_LINE, ptr);
+    }
+}
 
 /* creates a new, empty line */
-line *newline() {
-    line *l = malloc(sizeof(line));
+line *newline(pool *p) {
+    line *l = lalloc(p, sizeof(line));
+    l->pool = p;
 
-    l->s = malloc(1);
+    l->cap = psize(1);
+    l->s = lalloc(p, l->cap);
     l->s[0] = '\0';
 
     l->len = 0;
 
     l->attrs = NULL;
-    l->needs_update = true;
+    l->hlvalid = 0;
+    l->hldirty = l->hldirtyend = 0;
+    l->hlstart = l->hlend = -1;
+    l->plain = 1;
+    l->side = NULL;
 
     return l;
 }
 
 /* cleans up the line */
 void delline(line *l) {
-    free(l->s);
+    lfree(l->pool, l->s, l->cap);
     if (l->attrs != NULL) {
-        free(l->attrs);
+        lfree(l->pool, l->attrs, sizeof(attribute) * l->cap);
+    }
+    if (l->side != NULL) {
+        if (l->side->marks != NULL) {
+            lfree(l->pool, l->side->marks, sizeof(lmark) * l->side->markcap);
+        }
+        if (l->side->stops != NULL) {
+            lfree(l->pool, l->side->stops, sizeof(lstop) * l->side->stopcap);
+        }
+        lfree(l->pool, l->side, sizeof(lside));
     }
-    free(l);
+    lfree(l->pool, l, sizeof(line));
 }
 
-/* grow or shrink a line */
-void lresize(line *l, int len) {
-    l->s = realloc(l->s, len + 1);
+/* the side of a line is only allocated once something needs it */
+static lside *lsidealloc(line *l) {
+    if (l->side == NULL) {
+        l->side = lalloc(l->pool, sizeof(lside));
+        l->side->marks = NULL;
+        l->side->nmarks = l->side->markcap = 0;
+        l->side->stops = NULL;
+        l->side->nstops = l->side->stopcap = 0;
+        l->side->x = l->side->col = 0;
+    }
+    return l->side;
+}
+
+/* attributes are only allocated once the line is highlighted */
+static void lattrs(line *l) {
+    if (l->attrs == NULL) {
+        l->attrs = lalloc(l->pool, sizeof(attribute) * l->cap);
+        for (int i = 0; i < l->len; i++) {
+            l->attrs[i] = nullattr();
+        }
+    }
+}
+
+/* set the length of a line, only touching storage */
+static void lsize(line *l, int len) {
+    // reallocate if we outgrow the storage, or are left using very little of it
+    if (len + 1 > l->cap || ((len + 1) * 4 < l->cap && l->cap > psize(1))) {
+        int cap = len + 1;
+        if (cap > l->cap && cap < l->cap + l->cap / 2) {
+            cap = l->cap + l->cap / 2;
+        }
+        cap = psize(cap);
+
+        l->s = lrealloc(l->pool, l->s, l->cap, cap);
+        if (l->attrs != NULL) {
+            l->attrs = lrealloc(l->pool, l->attrs, sizeof(attribute) * l->cap, sizeof(attribute) * cap);
+        }
+        l->cap = cap;
+    }
     l->s[len] = '\0';
 
-    l->attrs = realloc(l->attrs, sizeof(attribute) * len);
     // if we're growing, fill the new space with blank attributes
-    if (len > l->len) {
+    if (l->attrs != NULL && len > l->len) {
         for (int i = l->len; i < len; i++) {
             l->attrs[i] = nullattr();
         }
     }
 
     l->len = len;
-    l->needs_update = true;
+}
+
+/* forget the columns measured past an edit at i, along with those of characters read up to it while decoding */
+static void lcoltrim(line *l, int i) {
+    lside *side = l->side;
+    if (side == NULL || side->x + 3 < i) {
+        return;
+    }
+
+    while (side->nstops > 0 && side->stops[side->nstops - 1].x + 3 >= i) {
+        side->nstops--;
+    }
+    side->x = side->nstops > 0 ? side->stops[side->nstops - 1].x : 0;
+    side->col = side->nstops > 0 ? side->stops[side->nstops - 1].col : 0;
+}
+
+/*
+ * d characters were inserted (or -d removed) at i. Marks and highlighting after
+ * them move along with the text, and the highlighter is told what changed: from
+ * the start of the word before, as a keyword is matched against the whole word,
+ * to the character after, which decides where a keyword ends
+ */
+static void ledit(line *l, int i, int d) {
+    if (l->side != NULL) {
+        lside *side = l->side;
+        int n = 0;
+        for (int j = 0; j < side->nmarks; j++) {
+            lmark m = side->marks[j];
+            if (m.x > i) {
+                if (m.x < i - d) {
+                    continue;
+                }
+                m.x += d;
+            }
+            side->marks[n++] = m;
+        }
+        side->nmarks = n;
+    }
+
+    if (l->hlvalid > i) {
+        l->hlvalid = l->hlvalid + d > i ? l->hlvalid + d : i;
+    }
+    if (l->hldirty <= l->hldirtyend) {
+        if (l->hldirty > i) {
+            l->hldirty = l->hldirty + d > i ? l->hldirty + d : i;
+        }
+        if (l->hldirtyend > i) {
+            l->hldirtyend = l->hldirtyend + d > i ? l->hldirtyend + d : i;
+        }
+    }
+
+    int from = i;
+    while (from > 0 && isalpha((unsigned char)l->s[from - 1])) {
+        from--;
+    }
+    from = from > 0 ? from - 1 : 0;
+    int to = i + (d > 0 ? d : 0) + 1;
+
+    l->hldirty = from < l->hldirty ? from : l->hldirty;
+    l->hldirtyend = to > l->hldirtyend ? to : l->hldirtyend;
+
+    // a plain line stays plain if what went in is, and one that wasn't may be once something is taken out
+    if (d > 0 && l->plain == 1) {
+        l->plain = utf8_plain(&l->s[i], d);
+    } else if (d < 0 && l->plain == 0) {
+        l->plain = -1;
+    }
+    lcoltrim(l, i);
+}
+
+/* grow or shrink a line */
+void lresize(line *l, int len) {
+    int oldlen = l->len;
+    lsize(l, len);
+
+    // whatever the new space is filled with hasn't been written yet
+    if (len > oldlen) {
+        l->plain = -1;
+    }
+    ledit(l, len < oldlen ? len : oldlen, len - oldlen);
+}
+
+/* replace the whole text of a line, which is highlighted again from scratch */
+void lset(line *l, const char *s, int len) {
+    lsize(l, len);
+    memcpy(l->s, s, len);
+    l->plain = -1;
+
+    // nothing highlighted for the old text holds for the new, and a mark left in the same state
+    // would stop the highlighter there with the rest of the line as it was
+    if (l->attrs != NULL) {
+        lclrattrs(l, 0, len);
+    }
+    if (l->side != NULL) {
+        l->side->nmarks = 0;
+    }
+    l->hlvalid = 0;
+    l->hldirty = 0;
+    l->hldirtyend = len;
+    lcoltrim(l, 0);
+}
+
+/* whether the line is all printable ASCII */
+bool lplain(line *l) {
+    if (l->plain < 0) {
+        l->plain = utf8_plain(l->s, l->len);
+    }
+    return l->plain;
+}
+
+/* measure the line until past byte x or column col */
+static lside *lmeasure(line *l, int x, int col) {
+    lside *side = lsidealloc(l);
+
+    while (side->x < l->len && (side->x <= x || side->col <= col)) {
+        if (side->x >= side->nstops * LCOL_STEP) {
+            if (side->nstops == side->stopcap) {
+                int cap = side->stopcap > 0 ? side->stopcap * 2 : 8;
+                side->stops = side->stops != NULL
+                    ? lrealloc(l->pool, side->stops, sizeof(lstop) * side->stopcap, sizeof(lstop) * cap)
+                    : lalloc(l->pool, sizeof(lstop) * cap);
+                side->stopcap = cap;
+            }
+            side->stops[side->nstops].x = side->x;
+            side->stops[side->nstops].col = side->col;
+            side->nstops++;
+        }
+
+        int ch;
+        int n = utf8_decode(&l->s[side->x], l->len - side->x, &ch);
+        side->col += utf8_width(ch, side->col);
+        side->x += n;
+    }
+    return side;
+}
+
+/* the column the character at (or around) byte x starts at */
+int lcolumn(line *l, int x) {
+    if (x <= 0) {
+        return 0;
+    }
+    if (lplain(l)) {
+        return x < l->len ? x : l->len;
+    }
+    if (x >= l->len) {
+        return lwidth(l);
+    }
+
+    // the stop for x's step can be a few bytes past it, if a character was in the way
+    lside *side = lmeasure(l, x, -1);
+    int k = x / LCOL_STEP < side->nstops ? x / LCOL_STEP : side->nstops - 1;
+    if (side->stops[k].x > x) {
+        k--;
+    }
+
+    int at = side->stops[k].x;
+    int col = side->stops[k].col;
+    while (at < x) {
+        int ch;
+        int n = utf8_decode(&l->s[at], l->len - at, &ch);
+        if (at + n > x) {
+            break;
+        }
+        col += utf8_width(ch, col);
+        at += n;
+    }
+    return col;
+}
+
+/* the byte the character drawn at column col starts at */
+int lbyte(line *l, int col) {
+    if (col <= 0 || l->len == 0) {
+        return 0;
+    }
+    if (lplain(l)) {
+        return col < l->len ? col : l->len;
+    }
+
+    // the last stop at or before col
+    lside *side = lmeasure(l, -1, col);
+    int lo = 0, hi = side->nstops;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (side->stops[mid].col <= col) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    int at = side->stops[lo - 1].x;
+    int at_col = side->stops[lo - 1].col;
+    while (at < l->len) {
+        int ch;
+        int n = utf8_decode(&l->s[at], l->len - at, &ch);
+        int w = utf8_width(ch, at_col);
+        if (at_col + w > col) {
+            break;
+        }
+        at_col += w;
+        at += n;
+    }
+    return at;
+}
+
+/* how many columns the whole line takes */
+int lwidth(line *l) {
+    if (lplain(l)) {
+        return l->len;
+    }
+    return lmeasure(l, INT_MAX, -1)->col;
+}
+
+/* the start of the character byte x is in */
+int lstart(line *l, int x) {
+    if (x <= 0 || x >= l->len || lplain(l)) {
+        return x;
+    }
+
+    // back over continuation bytes, as long as they decode as part of the sequence
+    int p = x;
+    while (p > 0 && x - p < 3 && (l->s[p] & 0xc0) == 0x80) {
+        p--;
+    }
+    int ch;
+    return p + utf8_decode(&l->s[p], l->len - p, &ch) > x ? p : x;
+}
+
+/* the start of the character after the one at x */
+int lnext(line *l, int x) {
+    if (x >= l->len) {
+        return l->len;
+    }
+    if (lplain(l)) {
+        return x + 1;
+    }
+
+    int ch;
+    x += utf8_decode(&l->s[x], l->len - x, &ch);
+
+    // combining marks go along with the character before them
+    while (x < l->len) {
+        int n = utf8_decode(&l->s[x], l->len - x, &ch);
+        if (utf8_width(ch, 0) != 0) {
+            break;
+        }
+        x += n;
+    }
+    return x;
+}
+
+/* the start of the character before x */
+int lprev(line *l, int x) {
+    if (x <= 0) {
+        return 0;
+    }
+    if (lplain(l)) {
+        return x - 1;
+    }
+    return lbyte(l, lcolumn(l, x) - 1);
 }
 
 /* add an attribute to the line */
 void laddattr(line *l, attribute a, int i) {
+    lattrs(l);
     l->attrs[i] = a;
 }
 
-/* clear the attributes from the line */
-void lclrattrs(line *l) {
-    for (int i = 0; i < l->len; i++) {
+/* clear the attributes of characters from..to-1 */
+void lclrattrs(line *l, int from, int to) {
+    lattrs(l);
+    for (int i = from; i < to && i < l->len; i++) {
         l->attrs[i] = nullattr();
     }
 }
 
-/* add a character to the line at the given index */
-void laddch(line *l, const char c, int i) {
-    lresize(l, l->len + 1);
+/* the attribute in effect just before x, worked out from the nearest mark */
+attribute lattrat(line *l, int x) {
+    attribute a = nullattr();
+    if (l->attrs == NULL) {
+        return a;
+    }
+
+    // the last mark at or before x
+    int lo = 0, hi = lnmarks(l);
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (l->side->marks[mid].x <= x) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
 
-    // offset memory if needed
-    if (l->s[i] != '\0' && i < l->len) {
-        memmove(&l->s[i + 1], &l->s[i], l->len - i);
+    int i = 0;
+    if (lo > 0) {
+        a = l->side->marks[lo - 1].attr;
+        i = l->side->marks[lo - 1].x;
+    }
+    for (; i < x && i < l->len; i++) {
+        if (l->attrs[i].type != NONE) {
+            a = l->attrs[i];
+        }
     }
+    return a;
+}
 
-    // insert the char
-    l->s[i] = c;
-    l->needs_update = true;
+/* how many highlighting marks the line has */
+int lnmarks(line *l) {
+    return l->side != NULL ? l->side->nmarks : 0;
+}
+
+/* insert a mark at index i */
+void laddmark(line *l, lmark m, int i) {
+    lside *side = lsidealloc(l);
+    if (side->nmarks == side->markcap) {
+        int cap = side->markcap > 0 ? side->markcap * 2 : 4;
+        side->marks = side->marks != NULL
+            ? lrealloc(l->pool, side->marks, sizeof(lmark) * side->markcap, sizeof(lmark) * cap)
+            : lalloc(l->pool, sizeof(lmark) * cap);
+        side->markcap = cap;
+    }
+
+    memmove(&side->marks[i + 1], &side->marks[i], sizeof(lmark) * (side->nmarks - i));
+    side->marks[i] = m;
+    side->nmarks++;
+}
+
+/* remove n marks from index i */
+void ldelmarks(line *l, int i, int n) {
+    if (n == 0) {
+        return;
+    }
+    lside *side = l->side;
+    memmove(&side->marks[i], &side->marks[i + n], sizeof(lmark) * (side->nmarks - i - n));
+    side->nmarks -= n;
+}
+
+/* the line's highlighting is clean again, up to hlvalid */
+void lclrdirty(line *l) {
+    l->hldirty = INT_MAX;
+    l->hldirtyend = -1;
+}
+
+/* add a character to the line at the given index */
+void laddch(line *l, const char c, int i) {
+    laddstr(l, &c, 1, i);
 }
 
 /* add a string to the line at the given index */
 void laddstr(line *l, const char *s, int len, int i) {
     int oldlen = l->len;
-    lresize(l, l->len + len);
+    lsize(l, l->len + len);
 
-    // offset if needed
+    // offset if needed, the attributes along with the text
     if (i < oldlen) {
         memmove(&l->s[i + len], &l->s[i], oldlen - i);
+        if (l->attrs != NULL) {
+            memmove(&l->attrs[i + len], &l->attrs[i], sizeof(attribute) * (oldlen - i));
+            for (int j = i; j < i + len; j++) {
+                l->attrs[j] = nullattr();
+            }
+        }
     }
 
     // insert the string
     memcpy(&l->s[i], s, len);
-    l->needs_update = true;
+    ledit(l, i, len);
 }
 
 /* delete the character at the given index */
 void ldelch(line *l, int i) {
     if (i < l->len) {
         memmove(&l->s[i], &l->s[i + 1], l->len - i - 1);
+        if (l->attrs != NULL) {
+            memmove(&l->attrs[i], &l->attrs[i + 1], sizeof(attribute) * (l->len - i - 1));
+        }
     }
 
-    lresize(l, l->len - 1);
-    l->needs_update = true;
+    lsize(l, l->len - 1);
+    ledit(l, i, -1);
 }
-
@@ -0,0 +1,140 @@
+/*
+ * mem.c
+ * Implements the core allocator interface
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include <core/mem.h>
+
+/* default hooks, straight to libc */
+static void *libc_alloc(size_t size, void *ctx) {
+    return malloc(size);
+}
+
+static void *libc_realloc(void *ptr, size_t size, void *ctx) {
+    return realloc(ptr, size);
+}
+
+static void libc_free(void *ptr, void *ctx) {
+    free(ptr);
+}
+
+static allocator hooks = { libc_alloc, libc_realloc, libc_free, NULL };
+
+static const char *names[MEM_TAGS] = { "buffer", "line", "syntax", "file" };
+
+#ifdef JET_MEM_STATS
+
+/* every allocation is prefixed with its size so frees can be accounted for. 16 bytes keeps the
+ * payload aligned for anything */
+#define HEADER 16
+
+static struct {
+    atomic_ulong calls;
+    atomic_size_t bytes;
+    atomic_size_t peak;
+} counters[MEM_TAGS];
+
+/* record a change in the number of bytes held by a subsystem */
+static void mem_account(enum mem_tag tag, size_t add, size_t sub) {
+    atomic_fetch_add_explicit(&counters[tag].calls, 1, memory_order_relaxed);
+    size_t bytes = atomic_fetch_add_explicit(&counters[tag].bytes, add - sub, memory_order_relaxed) + add - sub;
+
+    size_t peak = atomic_load_explicit(&counters[tag].peak, memory_order_relaxed);
+    while (bytes > peak && !atomic_compare_exchange_weak(&counters[tag].peak, &peak, bytes));
+}
+
+#endif
+
+/* swap out the allocator */
+void mem_sethooks(const allocator *a) {
+    if (a != NULL) {
+        hooks = *a;
+    } else {
+        hooks = (allocator){ libc_alloc, libc_realloc, libc_free, NULL };
+    }
+}
+
+/* returns the counters of a subsystem */
+mem_stats mem_stat(enum mem_tag tag) {
+    mem_stats st = { 0, 0, 0 };
+#ifdef JET_MEM_STATS
+    st.calls = atomic_load(&counters[tag].calls);
+    st.bytes = atomic_load(&counters[tag].bytes);
+    st.peak = atomic_load(&counters[tag].peak);
+#endif
+    return st;
+}
+
+/* returns the name of a subsystem */
+const char *mem_name(enum mem_tag tag) {
+    return names[tag];
+}
+
+/* allocate memory */
+void *mem_alloc(enum mem_tag tag, size_t size) {
+#ifdef JET_MEM_STATS
+    char *p = hooks.alloc(HEADER + size, hooks.ctx);
+    if (p == NULL) {
+        return NULL;
+    }
+    *(size_t*)p = size;
+    mem_account(tag, size, 0);
+    return p + HEADER;
+#else
+    return hooks.alloc(size, hooks.ctx);
+#endif
+}
+
+/* allocate zeroed memory */
+void *mem_calloc(enum mem_tag tag, size_t n, size_t size) {
+    // as calloc does, rather than allocating what n * size wraps around to
+    if (size != 0 && n > SIZE_MAX / size) {
+        return NULL;
+    }
+    void *p = mem_alloc(tag, n * size);
+    if (p != NULL) {
+        memset(p, 0, n * size);
+    }
+    return p;
+}
+
+/* resize memory */
+void *mem_realloc(enum mem_tag tag, void *ptr, size_t size) {
+#ifdef JET_MEM_STATS
+    if (ptr == NULL) {
+        return mem_alloc(tag, size);
+    }
+
+    char *p = (char*)ptr - HEADER;
+    size_t old = *(size_t*)p;
+    p = hooks.realloc(p, HEADER + size, hooks.ctx);
+    if (p == NULL) {
+        return NULL;
+    }
+    *(size_t*)p = size;
+    mem_account(tag, size, old);
+    return p + HEADER;
+#else
+    return hooks.realloc(ptr, size, hooks.ctx);
+#endif
+}
+
+/* free memory */
+void mem_free(enum mem_tag tag, void *ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+#ifdef JET_MEM_STATS
+    char *p = (char*)ptr - HEADER;
+    mem_account(tag, 0, *(size_t*)p);
+    hooks.free(p, hooks.ctx);
+#else
+    hooks.free(ptr, hooks.ctx);
+#endif
+}
@@ -0,0 +1,822 @@
+/*
+ * nest.c
+ * Summing how lines nest in a tree, and walking it to match brackets
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#include <string.h>
+#include <limits.h>
+
+#include <core/nest.h>
+#include <core/syntax.h>
+#include <core/mem.h>
+
+/* the kind of bracket at x of line l, -1 if it isn't one or doesn't count. a is the attribute in
+ * effect, kept up to date along the line, brackets highlighted as anything (a string or a comment)
+ * not counting */
+static int nest_bracket(line *l, int x, attribute *a, bool *open) {
+    if (l->attrs != NULL && l->attrs[x].type != NONE) {
+        *a = l->attrs[x];
+    }
+    if (a->enabled) {
+        return -1;
+    }
+
+    switch (l->s[x]) {
+    case '(': *open = true; return NEST_PAREN;
+    case ')': *open = false; return NEST_PAREN;
+    case '[': *open = true; return NEST_SQUARE;
+    case ']': *open = false; return NEST_SQUARE;
+    case '{': *open = true; return NEST_BRACE;
+    case '}': *open = false; return NEST_BRACE;
+    }
+    return -1;
+}
+
+/* sum characters from to to - 1 of a line, a being the attribute in effect before them and after */
+static nestsum nest_scan(line *l, int from, int to, attribute *a) {
+    nestsum s;
+    int d[NEST_KINDS] = {0}, low[NEST_KINDS] = {0};
+
+    for (int x = from; x < to; x++) {
+        bool open;
+        int k = nest_bracket(l, x, a, &open);
+        if (k == -1) {
+            continue;
+        }
+        d[k] += open ? 1 : -1;
+        low[k] = d[k] < low[k] ? d[k] : low[k];
+    }
+
+    for (int k = 0; k < NEST_KINDS; k++) {
+        s.close[k] = -low[k];
+        s.open[k] = d[k] - low[k];
+    }
+    return s;
+}
+
+/* the sum of a followed by b: what b closes is closed in a first, and what a leaves open b closes */
+static nestsum nest_add(nestsum a, nestsum b) {
+    nestsum s;
+    for (int k = 0; k < NEST_KINDS; k++) {
+        int closed = b.close[k] < a.open[k] ? b.close[k] : a.open[k];
+        s.close[k] = a.close[k] + b.close[k] - closed;
+        s.open[k] = b.open[k] + a.open[k] - closed;
+    }
+    return s;
+}
+
+/* where line y is or would go among the long lines */
+static int nest_findlong(nest *n, int y) {
+    int lo = 0, hi = n->nlongs;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (n->longs[mid].y < y) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/* the chunks of line y if it is long, NULL if it isn't */
+static nestchunk *nest_chunks(nest *n, int y) {
+    int i = nest_findlong(n, y);
+    return i < n->nlongs && n->longs[i].y == y ? n->longs[i].chunks : NULL;
+}
+
+/* sum line y, and the chunks of it if it is long. a long line whose length stayed the same only
+ * has the chunks it changed in summed again */
+static void nest_line(nest *n, buffer *b, int y) {
+    line *l = bline(b, y);
+    attribute a = nullattr();
+
+    int i = nest_findlong(n, y);
+    bool had = i < n->nlongs && n->longs[i].y == y;
+
+    if (l->len <= NEST_CHUNK) {
+        if (had) {
+            mem_free(MEM_BUFFER, n->longs[i].chunks);
+            n->nlongs--;
+            memmove(&n->longs[i], &n->longs[i + 1], sizeof(nestlong) * (n->nlongs - i));
+        }
+        n->lines[y] = nest_scan(l, 0, l->len, &a);
+        return;
+    }
+
+    if (!had) {
+        if (n->nlongs == n->longcap) {
+            n->longcap = n->longcap > 0 ? n->longcap * 2 : 16;
+            n->longs = mem_realloc(MEM_BUFFER, n->longs, sizeof(nestlong) * n->longcap);
+        }
+        memmove(&n->longs[i + 1], &n->longs[i], sizeof(nestlong) * (n->nlongs - i));
+        n->longs[i].y = y;
+        n->longs[i].chunks = NULL;
+        n->longs[i].nchunks = 0;
+        n->nlongs++;
+    }
+    nestlong *nl = &n->longs[i];
+
+    // the chunks the changes touch, or all of them if the line grew or shrank
+    int nchunks = (l->len + NEST_CHUNK - 1) / NEST_CHUNK;
+    int first = 0, last = nchunks - 1;
+    if (nl->nchunks != nchunks) {
+        nl->chunks = mem_realloc(MEM_BUFFER, nl->chunks, sizeof(nestchunk) * nchunks);
+        nl->nchunks = nchunks;
+    } else if (nl->from >= nl->to) {
+        last = -1;
+    } else if (nl->from > 0 || nl->to < l->len) {
+        first = nl->from / NEST_CHUNK;
+        last = (nl->to < l->len ? nl->to : l->len) / NEST_CHUNK;
+        last = last < nchunks - 1 ? last : nchunks - 1;
+        a = nl->chunks[first].attr;
+    }
+    nl->from = INT_MAX;
+    nl->to = 0;
+
+    for (int c = first; c <= last; c++) {
+        int end = (c + 1) * NEST_CHUNK;
+        nl->chunks[c].attr = a;
+        nl->chunks[c].sum = nest_scan(l, c * NEST_CHUNK, end < l->len ? end : l->len, &a);
+    }
+
+    nestsum s = {{0}, {0}};
+    for (int c = 0; c < nchunks; c++) {
+        s = nest_add(s, nl->chunks[c].sum);
+    }
+    n->lines[y] = s;
+}
+
+/* make room for len lines */
+static void nest_grow(nest *n, int len) {
+    if (len <= n->cap) {
+        return;
+    }
+
+    int cap = n->cap > 0 ? n->cap : 256;
+    while (cap < len) {
+        cap *= 2;
+    }
+    n->lines = mem_realloc(MEM_BUFFER, n->lines, sizeof(nestsum) * cap);
+    n->cap = cap;
+}
+
+/* characters from to to - 1 of line y need summing again, the whole line if it isn't long */
+static void nest_change(nest *n, int y, int from, int to) {
+    int i = nest_findlong(n, y);
+    if (i < n->nlongs && n->longs[i].y == y) {
+        nestlong *nl = &n->longs[i];
+        nl->from = from < nl->from ? from : nl->from;
+        nl->to = to > nl->to ? to : nl->to;
+    }
+    bstale_mark(&n->stale, y);
+}
+
+/* the groups */
+
+/* the first line of group g, past the lines of the groups before it */
+static int nest_first(nest *n, int g) {
+    int y = 0;
+    for (int i = g + n->size; i > 1; i /= 2) {
+        if (i % 2 == 1) {
+            y += n->counts[i - 1];
+        }
+    }
+    return y;
+}
+
+/* the group holding line y, which must have been summed, with its first line in start */
+static int nest_find(nest *n, int y, int *start) {
+    int i = 1;
+    *start = 0;
+    while (i < n->size) {
+        i *= 2;
+        if (y - *start >= n->counts[i]) {
+            *start += n->counts[i];
+            i++;
+        }
+    }
+    return i - n->size;
+}
+
+/* sum groups a to b again from their lines, then everything above them */
+static void nest_fix(nest *n, int a, int b) {
+    for (int g = a, y = nest_first(n, a); g <= b; g++) {
+        nestsum s = {{0}, {0}};
+        for (int end = y + n->counts[n->size + g]; y < end; y++) {
+            s = nest_add(s, n->lines[y]);
+        }
+        n->tree[n->size + g] = s;
+    }
+    for (a += n->size, b += n->size; a > 1;) {
+        a /= 2;
+        b /= 2;
+        for (int i = a; i <= b; i++) {
+            n->tree[i] = nest_add(n->tree[2 * i], n->tree[2 * i + 1]);
+            n->counts[i] = n->counts[2 * i] + n->counts[2 * i + 1];
+        }
+    }
+}
+
+/* lay the lines out in groups of NEST_GROUP again, each followed by an empty one for a group split
+ * later to move into, and sum everything */
+static void nest_build(nest *n) {
+    int groups = (n->len + NEST_GROUP - 1) / NEST_GROUP;
+    int size = 1;
+    while (size < 2 * groups) {
+        size *= 2;
+    }
+    if (size != n->size) {
+        n->size = size;
+        n->tree = mem_realloc(MEM_BUFFER, n->tree, sizeof(nestsum) * 2 * size);
+        n->counts = mem_realloc(MEM_BUFFER, n->counts, sizeof(int) * 2 * size);
+    }
+
+    memset(&n->counts[size], 0, sizeof(int) * size);
+    for (int g = 0; g < groups; g++) {
+        int left = n->len - g * NEST_GROUP;
+        n->counts[size + 2 * g] = left < NEST_GROUP ? left : NEST_GROUP;
+    }
+    nest_fix(n, 0, size - 1);
+    n->relayout = false;
+}
+
+/* split group g, grown past twice NEST_GROUP lines, in two. the groups between it and the nearest
+ * empty one move along to make room, the lines being laid out again if there isn't one near */
+static void nest_split(nest *n, int g) {
+    int *counts = &n->counts[n->size];
+    int c = counts[g];
+    for (int d = 1; d <= NEST_GROUP && c <= 4 * NEST_GROUP; d++) {
+        if (g + d < n->size && counts[g + d] == 0) {
+            memmove(&counts[g + 2], &counts[g + 1], sizeof(int) * (d - 1));
+            counts[g] = c / 2;
+            counts[g + 1] = c - c / 2;
+            nest_fix(n, g, g + d);
+            return;
+        }
+        if (g - d >= 0 && counts[g - d] == 0) {
+            memmove(&counts[g - d], &counts[g - d + 1], sizeof(int) * (d - 1));
+            counts[g - 1] = c / 2;
+            counts[g] = c - c / 2;
+            nest_fix(n, g - d, g);
+            return;
+        }
+    }
+    n->relayout = true;
+}
+
+/* n lines were added at y, to be summed on the next sync. the group holding y takes them */
+static void nest_insert(nest *ns, int y, int n) {
+    nest_grow(ns, ns->len + n);
+    memmove(&ns->lines[y + n], &ns->lines[y], sizeof(nestsum) * (ns->len - y));
+    memset(&ns->lines[y], 0, sizeof(nestsum) * n);
+    if (ns->relayout) {
+        ns->len += n;
+        return;
+    }
+
+    int start, g = nest_find(ns, y, &start);
+    ns->len += n;
+    ns->counts[ns->size + g] += n;
+    nest_fix(ns, g, g);
+    if (ns->counts[ns->size + g] > 2 * NEST_GROUP) {
+        nest_split(ns, g);
+    }
+}
+
+/* n lines were removed from y on, taken out of the groups they were in. those left empty stay,
+ * for groups split later to move into */
+static void nest_remove(nest *ns, int y, int n) {
+    int start, first = 0, last = 0;
+    if (!ns->relayout) {
+        first = last = nest_find(ns, y, &start);
+        int *counts = &ns->counts[ns->size];
+        int take = start + counts[first] - y < n ? start + counts[first] - y : n;
+        counts[first] -= take;
+        for (int left = n - take; left > 0; left -= take) {
+            take = counts[++last] < left ? counts[last] : left;
+            counts[last] -= take;
+        }
+    }
+
+    memmove(&ns->lines[y], &ns->lines[y + n], sizeof(nestsum) * (ns->len - y - n));
+    ns->len -= n;
+    if (!ns->relayout) {
+        nest_fix(ns, first, last);
+    }
+}
+
+/* keep the sums on the same lines as lines are added and removed, in the groups they were in */
+static void nest_observe(buffer *b, int y, int n, void *data) {
+    nest *ns = data;
+    (void)b;
+
+    // a long line changed is summed again all along
+    if (n == 0 && y < ns->len) {
+        nest_change(ns, y, 0, INT_MAX);
+        return;
+    }
+    n = bstale_note(&ns->stale, y, n, ns->len);
+    if (n == 0) {
+        return;
+    }
+
+    int kept = 0;
+    for (int i = 0; i < ns->nlongs; i++) {
+        nestlong *l = &ns->longs[i];
+        if (l->y >= y && l->y < y - n) {
+            mem_free(MEM_BUFFER, l->chunks);
+            continue;
+        }
+        l->y += l->y >= y ? n : 0;
+        ns->longs[kept++] = *l;
+    }
+    ns->nlongs = kept;
+
+    if (n > 0) {
+        nest_insert(ns, y, n);
+    } else {
+        nest_remove(ns, y, -n);
+    }
+}
+
+/* lines from on were summed at the end, and go in the last group until it is full, then in new
+ * groups after it */
+static void nest_append(nest *n, int from) {
+    int i = 1;
+    while (i < n->size) {
+        i = n->counts[2 * i + 1] > 0 ? 2 * i + 1 : 2 * i;
+    }
+
+    int *counts = &n->counts[n->size];
+    int first = i - n->size, g = first;
+    for (int y = from; y < n->len;) {
+        if (counts[g] == NEST_GROUP && ++g == n->size) {
+            n->relayout = true;
+            return;
+        }
+        int take = n->len - y < NEST_GROUP - counts[g] ? n->len - y : NEST_GROUP - counts[g];
+        counts[g] += take;
+        y += take;
+    }
+    nest_fix(n, first, g);
+}
+
+void nest_end(buffer *b) {
+    nest *n = b->nest;
+    if (n == NULL) {
+        return;
+    }
+
+    bunobserve(b, nest_observe, n);
+    for (int i = 0; i < n->nlongs; i++) {
+        mem_free(MEM_BUFFER, n->longs[i].chunks);
+    }
+    mem_free(MEM_BUFFER, n->longs);
+    mem_free(MEM_BUFFER, n->lines);
+    bstale_free(&n->stale);
+    mem_free(MEM_BUFFER, n->tree);
+    mem_free(MEM_BUFFER, n->counts);
+    mem_free(MEM_BUFFER, n);
+    b->nest = NULL;
+}
+
+void nest_stale(buffer *b, int y, int from, int to) {
+    if (b->nest != NULL && y < b->nest->len) {
+        nest_change(b->nest, y, from, to);
+    }
+}
+
+/* bring the sums up to date with the buffer, starting on them if this is the first time. viewed
+ * files have none */
+static nest *nest_sync(buffer *b) {
+    if (b->index != NULL) {
+        return NULL;
+    }
+
+    if (b->nest == NULL) {
+        b->nest = mem_calloc(MEM_BUFFER, 1, sizeof(nest));
+        b->nest->relayout = true;
+        bobserve(b, nest_observe, b->nest);
+    }
+    nest *n = b->nest;
+
+    // anything else that shrank the buffer went unseen, and lines past the old end are new
+    if (n->len > b->len) {
+        nest_remove(n, b->len, n->len - b->len);
+        while (n->nlongs > 0 && n->longs[n->nlongs - 1].y >= n->len) {
+            mem_free(MEM_BUFFER, n->longs[--n->nlongs].chunks);
+        }
+    }
+    if (n->len < b->len) {
+        int from = n->len;
+        nest_grow(n, b->len);
+        for (int y = n->len; y < b->len; y++) {
+            nest_line(n, b, y);
+        }
+        n->len = b->len;
+        if (!n->relayout) {
+            nest_append(n, from);
+        }
+    }
+
+    // a lot of lines changed at once are quicker summed with everything else
+    bool all = n->relayout || n->stale.n > n->len / NEST_GROUP;
+    for (int i = 0; i < n->stale.n; i++) {
+        int y = n->stale.lines[i];
+        if (y >= n->len) {
+            continue;
+        }
+        nest_line(n, b, y);
+        if (all) {
+            continue;
+        }
+
+        // a group is summed once its last line waiting is
+        int start, g = nest_find(n, y, &start);
+        int next = i + 1 < n->stale.n ? n->stale.lines[i + 1] : INT_MAX;
+        if (next >= start && next < start + n->counts[n->size + g]) {
+            continue;
+        }
+        nest_fix(n, g, g);
+    }
+    n->stale.n = 0;
+
+    if (n->relayout) {
+        nest_build(n);
+    } else if (all) {
+        nest_fix(n, 0, n->size - 1);
+    }
+    return n;
+}
+
+/* looking along a line */
+
+/* where the chunk holding x of a line starts, the attribute in effect there in a */
+static int nest_start(nestchunk *chunks, int x, attribute *a) {
+    if (chunks == NULL) {
+        *a = nullattr();
+        return 0;
+    }
+    *a = chunks[x / NEST_CHUNK].attr;
+    return x / NEST_CHUNK * NEST_CHUNK;
+}
+
+/* the attribute in effect just before x of line y, from the start of its chunk */
+static attribute nest_attrat(nest *n, line *l, int y, int x) {
+    nestchunk *chunks = n != NULL && l->len > NEST_CHUNK ? nest_chunks(n, y) : NULL;
+    attribute a;
+    bool open;
+    for (int i = nest_start(chunks, x, &a); i < x && l->attrs != NULL; i++) {
+        nest_bracket(l, i, &a, &open);
+    }
+    return a;
+}
+
+/* the need-th closing bracket of kind k along line y from x on that wasn't opened since, -1 if it
+ * isn't on the line with need left for the lines after */
+static int nest_forline(nest *n, line *l, int y, int k, int x, int *need) {
+    nestchunk *chunks = n != NULL && l->len > NEST_CHUNK ? nest_chunks(n, y) : NULL;
+
+    while (x < l->len) {
+        attribute a;
+        int i = nest_start(chunks, x, &a);
+        int end = chunks != NULL && i + NEST_CHUNK < l->len ? i + NEST_CHUNK : l->len;
+
+        // whole chunks without it are passed over
+        if (chunks != NULL && x == i) {
+            nestsum *s = &chunks[x / NEST_CHUNK].sum;
+            if (s->close[k] < *need) {
+                *need += s->open[k] - s->close[k];
+                x = end;
+                continue;
+            }
+        }
+
+        // the attribute is followed from the start of the chunk, brackets only counting from x
+        for (; i < end; i++) {
+            bool open;
+            if (nest_bracket(l, i, &a, &open) != k || i < x) {
+                continue;
+            }
+            *need += open ? 1 : -1;
+            if (*need == 0) {
+                return i;
+            }
+        }
+        x = end;
+    }
+    return -1;
+}
+
+/* the need-th opening bracket of kind k back from to along characters from to to - 1 that isn't
+ * closed before to, -1 if it isn't there with need left for what comes before. a is the attribute
+ * in effect before from */
+static int nest_backscan(line *l, int k, int from, int to, attribute a, int *need) {
+    attribute start = a;
+    nestsum s = nest_scan(l, from, to, &a);
+    if (s.open[k] < *need) {
+        *need += s.close[k] - s.open[k];
+        return -1;
+    }
+
+    // it is the last bracket to take the depth along the characters up to want, and it never
+    // falls below that after
+    int want = s.open[k] - s.close[k] - *need + 1;
+    int d = 0, at = -1;
+    a = start;
+    for (int x = from; x < to; x++) {
+        bool open;
+        if (nest_bracket(l, x, &a, &open) != k) {
+            continue;
+        }
+        d += open ? 1 : -1;
+        at = open && d == want ? x : at;
+    }
+    return at;
+}
+
+/* the need-th opening bracket of kind k back along line y from just before x that isn't closed
+ * before x, -1 if it isn't on the line with need left for the lines before */
+static int nest_backline(nest *n, line *l, int y, int k, int x, int *need) {
+    nestchunk *chunks = n != NULL && l->len > NEST_CHUNK ? nest_chunks(n, y) : NULL;
+
+    while (x > 0) {
+        attribute a;
+        int start = nest_start(chunks, x - 1, &a);
+
+        // whole chunks without it are passed over
+        int end = start + NEST_CHUNK < l->len ? start + NEST_CHUNK : l->len;
+        if (chunks != NULL && x == end) {
+            nestsum *s = &chunks[start / NEST_CHUNK].sum;
+            if (s->open[k] < *need) {
+                *need += s->close[k] - s->open[k];
+                x = start;
+                continue;
+            }
+        }
+
+        int at = nest_backscan(l, k, start, x, a, need);
+        if (at != -1) {
+            return at;
+        }
+        x = start;
+    }
+    return -1;
+}
+
+/* walking the tree */
+
+/* the first group from g on where the need-th closing bracket of kind k is, need being what's left
+ * of it at the start of that group. -1 if there isn't one */
+static int nest_right(nest *n, int k, int g, int *need) {
+    if (g >= n->size) {
+        return -1;
+    }
+
+    int i = g + n->size;
+    do {
+        while (i % 2 == 0) {
+            i /= 2;
+        }
+        if (n->tree[i].close[k] >= *need) {
+            while (i < n->size) {
+                i *= 2;
+                if (n->tree[i].close[k] < *need) {
+                    *need += n->tree[i].open[k] - n->tree[i].close[k];
+                    i++;
+                }
+            }
+            return i - n->size;
+        }
+        *need += n->tree[i].open[k] - n->tree[i].close[k];
+        i++;
+    } while ((i & -i) != i);
+    return -1;
+}
+
+/* the last group before g where the need-th opening bracket of kind k is, counting back from the
+ * end of group g - 1, need being what's left of it at the end of that group. -1 if there isn't one */
+static int nest_left(nest *n, int k, int g, int *need) {
+    if (g <= 0) {
+        return -1;
+    }
+
+    int i = g + n->size;
+    do {
+        i--;
+        while (i > 1 && i % 2 == 1) {
+            i /= 2;
+        }
+        if (n->tree[i].open[k] >= *need) {
+            while (i < n->size) {
+                i = 2 * i + 1;
+                if (n->tree[i].open[k] < *need) {
+                    *need += n->tree[i].close[k] - n->tree[i].open[k];
+                    i--;
+                }
+            }
+            return i - n->size;
+        }
+        *need += n->tree[i].close[k] - n->tree[i].open[k];
+    } while ((i & -i) != i);
+    return -1;
+}
+
+/* the first closing bracket of kind k from (y, x) on that wasn't opened since */
+static bool nest_forward(buffer *b, int k, int y, int x, int *fy, int *fx) {
+    nest *n = nest_sync(b);
+    int need = 1;
+
+    int at = nest_forline(n, bline(b, y), y, k, x, &need);
+    if (at != -1) {
+        *fy = y;
+        *fx = at;
+        return true;
+    }
+
+    // viewed files are walked a line at a time
+    if (n == NULL) {
+        for (y++; bensure(b, y + 1), y < b->len; y++) {
+            at = nest_forline(NULL, bline(b, y), y, k, 0, &need);
+            if (at != -1) {
+                *fy = y;
+                *fx = at;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // the rest of the group, then the tree down to the group it is in
+    int start, g = nest_find(n, y, &start);
+    int end = start + n->counts[n->size + g];
+    for (y++; y < end && n->lines[y].close[k] < need; y++) {
+        need += n->lines[y].open[k] - n->lines[y].close[k];
+    }
+    if (y < n->len && y == end) {
+        g = nest_right(n, k, g + 1, &need);
+        if (g == -1) {
+            return false;
+        }
+        for (y = nest_first(n, g); n->lines[y].close[k] < need; y++) {
+            need += n->lines[y].open[k] - n->lines[y].close[k];
+        }
+    }
+    if (y >= n->len) {
+        return false;
+    }
+
+    *fy = y;
+    *fx = nest_forline(n, bline(b, y), y, k, 0, &need);
+    return true;
+}
+
+/* the last opening bracket of kind k before (y, x) that isn't closed before it */
+static bool nest_backward(buffer *b, int k, int y, int x, int *by, int *bx) {
+    nest *n = nest_sync(b);
+    int need = 1;
+
+    int at = nest_backline(n, bline(b, y), y, k, x, &need);
+    if (at != -1) {
+        *by = y;
+        *bx = at;
+        return true;
+    }
+
+    if (n == NULL) {
+        for (y--; y >= 0; y--) {
+            line *l = bline(b, y);
+            at = nest_backline(NULL, l, y, k, l->len, &need);
+            if (at != -1) {
+                *by = y;
+                *bx = at;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int start, g = nest_find(n, y, &start);
+    for (y--; y >= start && n->lines[y].open[k] < need; y--) {
+        need += n->lines[y].close[k] - n->lines[y].open[k];
+    }
+    if (y >= 0 && y == start - 1) {
+        g = nest_left(n, k, g, &need);
+        if (g == -1) {
+            return false;
+        }
+        y = nest_first(n, g) + n->counts[n->size + g] - 1;
+        for (; n->lines[y].open[k] < need; y--) {
+            need += n->lines[y].close[k] - n->lines[y].open[k];
+        }
+    }
+    if (y < 0) {
+        return false;
+    }
+
+    line *l = bline(b, y);
+    *by = y;
+    *bx = nest_backline(n, l, y, k, l->len, &need);
+    return true;
+}
+
+/* whether the characters before (y, x) are highlighted as they should be, brackets in strings and
+ * comments after that possibly still counting */
+static bool nest_highlighted(buffer *b, int y, int x) {
+    if (b->syntax == NULL || b->index != NULL || y < b->syntax->clean) {
+        return true;
+    }
+    if (y > b->syntax->clean) {
+        return false;
+    }
+
+    line *l = b->lines[y];
+    int start = y > 0 ? b->lines[y - 1]->hlend : -1;
+    x = x < l->len ? x : l->len;
+    return l->hlstart == start && l->hlvalid >= x && (l->hldirty > l->hldirtyend || l->hldirty >= x);
+}
+
+/* highlight the characters before (y, x), just as far along line y as that. a long line is only
+ * highlighted as far as it needs to be to find a bracket on it */
+static void nest_highlight(buffer *b, int y, int x) {
+    line *l = b->lines[y];
+    gen_syntax(b, y + 1, x < l->len ? lcolumn(l, x) + 1 : INT_MAX);
+}
+
+/* nest_forward, highlighting as far as where the bracket turns up (but not past line limit) until
+ * it stays there. cy is -1 if it isn't before limit */
+static void nest_close(buffer *b, int k, int y, int x, int limit, int *cy, int *cx) {
+    for (;;) {
+        bool found = nest_forward(b, k, y, x, cy, cx);
+        int uy = found ? *cy : b->len - 1;
+        int ux = found ? *cx + 1 : INT_MAX;
+        if (uy >= limit) {
+            uy = limit - 1;
+            ux = INT_MAX;
+        }
+        if (uy < 0 || nest_highlighted(b, uy, ux)) {
+            *cy = found && *cy < limit ? *cy : -1;
+            return;
+        }
+        nest_highlight(b, uy, ux);
+    }
+}
+
+bool nest_match(buffer *b, int y, int x, int limit, int *my, int *mx) {
+    bensure(b, y + 1);
+    if (y < 0 || y >= b->len || x < 0 || x >= bline(b, y)->len) {
+        return false;
+    }
+
+    line *l = bline(b, y);
+    if (!nest_highlighted(b, y, x + 1)) {
+        nest_highlight(b, y, x + 1);
+    }
+
+    bool open;
+    attribute a = nest_attrat(nest_sync(b), l, y, x);
+    int k = nest_bracket(l, x, &a, &open);
+    if (k == -1) {
+        return false;
+    }
+    if (open) {
+        nest_close(b, k, y, x + 1, limit, my, mx);
+    } else if (!nest_backward(b, k, y, x, my, mx)) {
+        *my = -1;
+    }
+    return true;
+}
+
+bool nest_open(buffer *b, enum nest_kind kind, int y, int x, int *oy, int *ox) {
+    bensure(b, y + 1);
+    if (y < 0 || y >= b->len) {
+        return false;
+    }
+
+    line *l = bline(b, y);
+    x = x < l->len ? x : l->len;
+    if (!nest_highlighted(b, y, x)) {
+        nest_highlight(b, y, x);
+    }
+    return nest_backward(b, kind, y, x, oy, ox);
+}
+
+bool nest_around(buffer *b, int y, int x, int limit, int *oy, int *ox, int *cy, int *cx) {
+    int k = -1;
+    for (int i = 0; i < NEST_KINDS; i++) {
+        int iy, ix;
+        if (nest_open(b, i, y, x, &iy, &ix) && (k == -1 || iy > *oy || (iy == *oy && ix > *ox))) {
+            k = i;
+            *oy = iy;
+            *ox = ix;
+        }
+    }
+    if (k == -1) {
+        return false;
+    }
+
+    nest_close(b, k, *oy, *ox + 1, limit, cy, cx);
+    return true;
+}
@@ -0,0 +1,160 @@
+/*
+ * pool.c
+ * Implements the slab allocator
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <core/pool.h>
+#include <core/mem.h>
+
+/* header of every slab */
+typedef struct poolchunk {
+    struct poolchunk *next;
+} poolchunk;
+
+/* header of allocations too large for a size class */
+typedef struct poolbig {
+    struct poolbig *prev, *next;
+} poolbig;
+
+/* size classes, roughly 1.5x apart so growing lines waste little */
+static const size_t classes[POOL_CLASSES] = {
+    16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072, 4096
+};
+
+#define POOL_MAX 4096
+
+/* chunk headers are padded so objects stay 16 byte aligned */
+#define CHUNK_HEADER 16
+#define BIG_HEADER 16
+
+/* returns the index of the smallest class that fits size */
+static int pclass(size_t size) {
+    int c = 0;
+    while (classes[c] < size) {
+        c++;
+    }
+    return c;
+}
+
+/* create an empty pool */
+pool *newpool() {
+    return mem_calloc(MEM_LINE, 1, sizeof(pool));
+}
+
+/* free every chunk and large allocation */
+void delpool(pool *p) {
+    while (p->chunks != NULL) {
+        poolchunk *next = p->chunks->next;
+        mem_free(MEM_LINE, p->chunks);
+        p->chunks = next;
+    }
+    while (p->big != NULL) {
+        poolbig *next = p->big->next;
+        mem_free(MEM_LINE, p->big);
+        p->big = next;
+    }
+    mem_free(MEM_LINE, p);
+}
+
+/* returns the rounded up size for a request */
+size_t psize(size_t size) {
+    return size <= POOL_MAX ? classes[pclass(size)] : size;
+}
+
+/* allocate size bytes */
+void *palloc(pool *p, size_t size) {
+    // large allocations are kept on a list of their own
+    if (size > POOL_MAX) {
+        poolbig *b = mem_alloc(MEM_LINE, BIG_HEADER + size);
+        b->prev = NULL;
+        b->next = p->big;
+        if (p->big != NULL) {
+            p->big->prev = b;
+        }
+        p->big = b;
+        return (char*)b + BIG_HEADER;
+    }
+
+    // reuse a freed object of the same class if we have one
+    int c = pclass(size);
+    if (p->free[c] != NULL) {
+        void *ptr = p->free[c];
+        p->free[c] = *(void**)ptr;
+        return ptr;
+    }
+
+    // otherwise carve it out of the current chunk, starting a new one if it's used up
+    size = classes[c];
+    if (p->left < size) {
+        poolchunk *chunk = mem_alloc(MEM_LINE, POOL_CHUNK);
+        chunk->next = p->chunks;
+        p->chunks = chunk;
+        p->next = (char*)chunk + CHUNK_HEADER;
+        p->left = POOL_CHUNK - CHUNK_HEADER;
+    }
+
+    void *ptr = p->next;
+    p->next += size;
+    p->left -= size;
+    return ptr;
+}
+
+/* grow or shrink an allocation */
+void *prealloc(pool *p, void *ptr, size_t size, size_t newsize) {
+    if (ptr == NULL) {
+        return palloc(p, newsize);
+    }
+
+    // nothing to do if it still fits the same class
+    if (size <= POOL_MAX && newsize <= POOL_MAX && pclass(size) == pclass(newsize)) {
+        return ptr;
+    }
+
+    // large to large can be resized in place by the heap
+    if (size > POOL_MAX && newsize > POOL_MAX) {
+        poolbig *b = mem_realloc(MEM_LINE, (char*)ptr - BIG_HEADER, BIG_HEADER + newsize);
+        if (b->prev != NULL) {
+            b->prev->next = b;
+        } else {
+            p->big = b;
+        }
+        if (b->next != NULL) {
+            b->next->prev = b;
+        }
+        return (char*)b + BIG_HEADER;
+    }
+
+    void *moved = palloc(p, newsize);
+    memcpy(moved, ptr, size < newsize ? size : newsize);
+    pfree(p, ptr, size);
+    return moved;
+}
+
+/* give an allocation back */
+void pfree(pool *p, void *ptr, size_t size) {
+    if (ptr == NULL) {
+        return;
+    }
+
+    if (size > POOL_MAX) {
+        poolbig *b = (poolbig*)((char*)ptr - BIG_HEADER);
+        if (b->prev != NULL) {
+            b->prev->next = b->next;
+        } else {
+            p->big = b->next;
+        }
+        if (b->next != NULL) {
+            b->next->prev = b->prev;
+        }
+        mem_free(MEM_LINE, b);
+        return;
+    }
+
+    int c = pclass(size);
+    *(void**)ptr = p->free[c];
+    p->free[c] = ptr;
+}
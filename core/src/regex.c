@@ -38,35 +38,19 @@
 
 /* Definitions: */
 
-#define MAX_REGEXP_OBJECTS      30    /* Max number of regex symbols in expression. */
-#define MAX_CHAR_CLASS_LEN      40    /* Max length of character-class buffer in.   */
+enum { UNUSED, DOT, BEGIN, END, QUESTIONMARK, STAR, PLUS, CHAR, CHAR_CLASS, INV_CHAR_CLASS, DIGIT, NOT_DIGIT, ALPHA, NOT_ALPHA, WHITESPACE, NOT_WHITESPACE, INVALID, /* BRANCH */ };
 
-
-enum { UNUSED, DOT, BEGIN, END, QUESTIONMARK, STAR, PLUS, CHAR, CHAR_CLASS, INV_CHAR_CLASS, DIGIT, NOT_DIGIT, ALPHA, NOT_ALPHA, WHITESPACE, NOT_WHITESPACE, /* BRANCH */ };
-
-typedef struct regex_t
-{
-    unsigned char  type;   /* CHAR, STAR, etc.                      */
-    union
-    {
-        unsigned char  ch;   /*      the character itself             */
-        unsigned char* ccl;  /*  OR  a pointer to characters in class */
-    };
-} regex_t;
-
-
-
-/* private members */
-static int match_len;
+/* The characters of a class symbol */
+#define CCL(p) ((const char*)(p) + (p)->ccl)
 
 
 
 /* Private function declarations: */
-static int matchpattern(regex_t* pattern, const char* text);
+static int matchpattern(const regex_t* pattern, const char* text, int* match_len);
 static int matchcharclass(char c, const char* str);
-static int matchstar(regex_t p, regex_t* pattern, const char* text);
-static int matchplus(regex_t p, regex_t* pattern, const char* text);
-static int matchone(regex_t p, char c);
+static int matchstar(const regex_t* p, const regex_t* pattern, const char* text, int* match_len);
+static int matchplus(const regex_t* p, const regex_t* pattern, const char* text, int* match_len);
+static int matchone(const regex_t* p, char c);
 static int matchdigit(char c);
 static int matchalpha(char c);
 static int matchwhitespace(char c);
@@ -84,16 +68,17 @@ int re_match(const char* pattern, const char* text)
 
 int re_matchp(re_t pattern, const char* text)
 {
-    match_len = 0;
-    if (pattern != 0)
+    /* Kept on the stack so several threads can match at once. */
+    int match_len = 0;
+    if (pattern != 0 && pattern->re[0].type != INVALID)
     {
-        if (pattern[0].type == BEGIN)
+        if (pattern->re[0].type == BEGIN)
         {
-            return ((matchpattern(&pattern[1], text)) ? 1 : -1);
+            return ((matchpattern(&pattern->re[1], text, &match_len)) ? 1 : -1);
         }
         else
         {
-            if (matchpattern(pattern, text))
+            if (matchpattern(pattern->re, text, &match_len))
             {
                 return match_len;
             }
@@ -104,13 +89,22 @@ int re_matchp(re_t pattern, const char* text)
 
 re_t re_compile(const char* pattern)
 {
-    /* The sizes of the two static arrays below substantiates the static RAM usage of this module.
-       MAX_REGEXP_OBJECTS is the max number of symbols in the expression.
+    /* The size of the static program below substantiates the static RAM usage of this module. */
+    static re_prog prog;
+
+    return re_compileto(&prog, pattern) == 0 ? &prog : 0;
+}
+
+int re_compileto(re_prog* prog, const char* pattern)
+{
+    /* MAX_REGEXP_OBJECTS is the max number of symbols in the expression.
        MAX_CHAR_CLASS_LEN determines the size of buffer for chars in all char-classes in the expression. */
-    static regex_t re_compiled[MAX_REGEXP_OBJECTS];
-    static unsigned char ccl_buf[MAX_CHAR_CLASS_LEN];
+    regex_t* re_compiled = prog->re;
+    unsigned char* ccl_buf = prog->ccl;
     int ccl_bufidx = 1;
 
+    ccl_buf[0] = 0;
+
     char c;     /* current char in pattern   */
     int i = 0;  /* index into pattern        */
     int j = 0;  /* index into re_compiled    */
@@ -189,7 +183,8 @@ re_t re_compile(const char* pattern)
                           {
                               if (ccl_bufidx >= MAX_CHAR_CLASS_LEN) {
                                   //fputs("exceeded internal buffer!\n", stderr);
-                                  return 0;
+                                  re_compiled[0].type = INVALID;
+                                  return -1;
                               }
                               ccl_buf[ccl_bufidx++] = pattern[i];
                           }
@@ -197,11 +192,12 @@ re_t re_compile(const char* pattern)
                           {
                               /* Catches cases such as [00000000000000000000000000000000000000][ */
                               //fputs("exceeded internal buffer!\n", stderr);
-                              return 0;
+                              re_compiled[0].type = INVALID;
+                              return -1;
                           }
                           /* Null-terminate string end */
                           ccl_buf[ccl_bufidx++] = 0;
-                          re_compiled[j].ccl = &ccl_buf[buf_begin];
+                          re_compiled[j].ccl = (unsigned char)(&ccl_buf[buf_begin] - (unsigned char*)&re_compiled[j]);
                       } break;
 
                       /* Other characters: */
@@ -217,10 +213,10 @@ re_t re_compile(const char* pattern)
     /* 'UNUSED' is a sentinel used to indicate end-of-pattern */
     re_compiled[j].type = UNUSED;
 
-    return (re_t) re_compiled;
+    return 0;
 }
 
-void re_print(regex_t* pattern)
+void re_print(const regex_t* pattern)
 {
     const char* types[] = { "UNUSED", "DOT", "BEGIN", "END", "QUESTIONMARK", "STAR", "PLUS", "CHAR", "CHAR_CLASS", "INV_CHAR_CLASS", "DIGIT", "NOT_DIGIT", "ALPHA", "NOT_ALPHA", "WHITESPACE", "NOT_WHITESPACE", "BRANCH" };
 
@@ -240,7 +236,7 @@ void re_print(regex_t* pattern)
             char c;
             for (j = 0; j < MAX_CHAR_CLASS_LEN; ++j)
             {
-                c = pattern[i].ccl[j];
+                c = CCL(&pattern[i])[j];
                 if ((c == '\0') || (c == ']'))
                 {
                     break;
@@ -339,29 +335,29 @@ static int matchcharclass(char c, const char* str)
     return 0;
 }
 
-static int matchone(regex_t p, char c)
+static int matchone(const regex_t* p, char c)
 {
-    switch (p.type)
+    switch (p->type)
     {
         case DOT:            return 1;
-        case CHAR_CLASS:     return  matchcharclass(c, (const char*)p.ccl);
-        case INV_CHAR_CLASS: return !matchcharclass(c, (const char*)p.ccl);
+        case CHAR_CLASS:     return  matchcharclass(c, CCL(p));
+        case INV_CHAR_CLASS: return !matchcharclass(c, CCL(p));
         case DIGIT:          return  matchdigit(c);
         case NOT_DIGIT:      return !matchdigit(c);
         case ALPHA:          return  matchalphanum(c);
         case NOT_ALPHA:      return !matchalphanum(c);
         case WHITESPACE:     return  matchwhitespace(c);
         case NOT_WHITESPACE: return !matchwhitespace(c);
-        default:             return  (p.ch == c);
+        default:             return  (p->ch == c);
     }
 }
 
-static int matchstar(regex_t p, regex_t* pattern, const char* text)
+static int matchstar(const regex_t* p, const regex_t* pattern, const char* text, int* match_len)
 {
     do
     {
-        match_len++;
-        if (matchpattern(pattern, text))
+        (*match_len)++;
+        if (matchpattern(pattern, text, match_len))
             return 1;
     }
     while ((text[0] != '\0') && matchone(p, *text++));
@@ -369,23 +365,23 @@ static int matchstar(regex_t p, regex_t* pattern, const char* text)
     return 0;
 }
 
-static int matchplus(regex_t p, regex_t* pattern, const char* text)
+static int matchplus(const regex_t* p, const regex_t* pattern, const char* text, int* match_len)
 {
     while ((text[0] != '\0') && matchone(p, *text++))
     {
-        match_len++;
-        if (matchpattern(pattern, text))
+        (*match_len)++;
+        if (matchpattern(pattern, text, match_len))
             return 1;
     }
     return 0;
 }
 
-static int matchquestion(regex_t p, regex_t* pattern, const char* text)
+static int matchquestion(const regex_t* p, const regex_t* pattern, const char* text, int* match_len)
 {
     if ((text[0] != '\0') && matchone(p, *text++))
     {
-        match_len++;
-        matchpattern(pattern, text);
+        (*match_len)++;
+        matchpattern(pattern, text, match_len);
     }
     return 1;
 }
@@ -395,27 +391,27 @@ static int matchquestion(regex_t p, regex_t* pattern, const char* text)
 #if 0
 
 /* Recursive matching */
-static int matchpattern(regex_t* pattern, const char* text)
+static int matchpattern(const regex_t* pattern, const char* text, int* match_len)
 {
     if ((pattern[0].type == UNUSED) || (pattern[1].type == QUESTIONMARK))
     {
-        return matchquestion(pattern[1], &pattern[2], text);
+        return matchquestion(&pattern[1], &pattern[2], text, match_len);
     }
     else if (pattern[1].type == STAR)
     {
-        return matchstar(pattern[0], &pattern[2], text);
+        return matchstar(&pattern[0], &pattern[2], text, match_len);
     }
     else if (pattern[1].type == PLUS)
     {
-        return matchplus(pattern[0], &pattern[2], text);
+        return matchplus(&pattern[0], &pattern[2], text, match_len);
     }
     else if ((pattern[0].type == END) && pattern[1].type == UNUSED)
     {
         return text[0] == '\0';
     }
-    else if ((text[0] != '\0') && matchone(pattern[0], text[0]))
+    else if ((text[0] != '\0') && matchone(&pattern[0], text[0]))
     {
-        return matchpattern(&pattern[1], text+1);
+        return matchpattern(&pattern[1], text+1, match_len);
     }
     else
     {
@@ -426,21 +422,21 @@ static int matchpattern(regex_t* pattern, const char* text)
 #else
 
 /* Iterative matching */
-static int matchpattern(regex_t* pattern, const char* text)
+static int matchpattern(const regex_t* pattern, const char* text, int* match_len)
 {
     do
     {
         if ((pattern[0].type == UNUSED) || (pattern[1].type == QUESTIONMARK))
         {
-            return matchquestion(pattern[1], &pattern[2], text);
+            return matchquestion(&pattern[1], &pattern[2], text, match_len);
         }
         else if (pattern[1].type == STAR)
         {
-            return matchstar(pattern[0], &pattern[2], text);
+            return matchstar(&pattern[0], &pattern[2], text, match_len);
         }
         else if (pattern[1].type == PLUS)
         {
-            return matchplus(pattern[0], &pattern[2], text);
+            return matchplus(&pattern[0], &pattern[2], text, match_len);
         }
         else if ((pattern[0].type == END) && pattern[1].type == UNUSED)
         {
@@ -452,9 +448,9 @@ static int matchpattern(regex_t* pattern, const char* text)
             return (matchpattern(pattern, text) || matchpattern(&pattern[2], text));
             }
             */
-        match_len++;
+        (*match_len)++;
     }
-    while ((text[0] != '\0') && matchone(*pattern++, *text++));
+    while ((text[0] != '\0') && matchone(pattern++, *text++));
 
     return 0;
 }
@@ -0,0 +1,545 @@
+/*
+ * rules.c
+ * Compiles .jsr rule files into blobs and looks rules up in them
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <core/rules.h>
+#include <core/hash.h>
+#include <core/mem.h>
+
+/* address of something at an offset from base */
+#define AT(base, off) ((const char *)(base) + (off))
+
+/* a blob being built */
+typedef struct writer {
+    char *data;
+    size_t len, cap;
+} writer;
+
+/* a keyword read from a rule file */
+typedef struct word {
+    char *s;
+    enum attr_type type;
+} word;
+
+/* append len bytes (zeros if data is NULL) at the given alignment, returns where they went */
+static uint32_t wput(writer *w, const void *data, size_t len, size_t align) {
+    size_t off = (w->len + align - 1) & ~(align - 1);
+
+    if (off + len > w->cap) {
+        while (off + len > w->cap) {
+            w->cap = w->cap > 0 ? w->cap * 2 : 4096;
+        }
+        w->data = mem_realloc(MEM_SYNTAX, w->data, w->cap);
+    }
+
+    memset(w->data + w->len, 0, off - w->len);
+    if (data != NULL) {
+        memcpy(w->data + off, data, len);
+    } else {
+        memset(w->data + off, 0, len);
+    }
+    w->len = off + len;
+
+    return off;
+}
+
+static uint32_t wstr(writer *w, const char *s) {
+    return wput(w, s, strlen(s) + 1, 1);
+}
+
+static enum attr_type rules_attr(const char *name) {
+    if (strcmp(name, "HIGHLIGHT") == 0) {
+        return HIGHLIGHT;
+    } else if (strcmp(name, "BOLD") == 0) {
+        return BOLD;
+    } else if (strcmp(name, "COLOR1") == 0) {
+        return COLOR1;
+    } else if (strcmp(name, "COLOR2") == 0) {
+        return COLOR2;
+    } else if (strcmp(name, "COLOR3") == 0) {
+        return COLOR3;
+    } else if (strcmp(name, "COLOR4") == 0) {
+        return COLOR4;
+    }
+    return NONE;
+}
+
+/* keywords made only of letters are looked up by hash, anything else is matched in order */
+static bool rules_plain(const char *s) {
+    for (; *s != '\0'; s++) {
+        if (!isalpha((unsigned char)*s)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* write out the ruleset for the words, regexes and encapsulations of one file, returns its offset */
+static uint32_t rules_write(writer *w, const char *name, word *words, int nwords,
+        rules_re *regs, int nregs, rules_enc *encs, int nencs) {
+    uint32_t set = wput(w, NULL, sizeof(ruleset), 8);
+    ruleset r = {0};
+
+    r.name = wstr(w, name) - set;
+
+    // size the keyword table to stay at most half full
+    int nplain = 0;
+    for (int i = 0; i < nwords; i++) {
+        nplain += rules_plain(words[i].s);
+    }
+    uint32_t slots = 1;
+    while (slots < (uint32_t)nplain * 2) {
+        slots <<= 1;
+    }
+
+    rules_key *table = mem_calloc(MEM_SYNTAX, slots, sizeof(rules_key));
+    rules_key *others = mem_calloc(MEM_SYNTAX, nwords + 1, sizeof(rules_key));
+    for (int i = 0; i < nwords; i++) {
+        rules_key k = {0, strlen(words[i].s), words[i].type};
+
+        if (!rules_plain(words[i].s)) {
+            k.word = wstr(w, words[i].s) - set;
+            others[r.nothers++] = k;
+            continue;
+        }
+
+        // the first of any duplicates wins, like it did when keywords were tried in order
+        uint32_t slot = hash_bytes(HASH_SEED, words[i].s, k.len) & (slots - 1);
+        while (table[slot].len != 0 && !(table[slot].len == k.len
+                    && strcmp(w->data + set + table[slot].word, words[i].s) == 0)) {
+            slot = (slot + 1) & (slots - 1);
+        }
+        if (table[slot].len == 0) {
+            k.word = wstr(w, words[i].s) - set;
+            table[slot] = k;
+        }
+    }
+
+    r.keys = wput(w, table, sizeof(rules_key) * slots, 8) - set;
+    r.keymask = slots - 1;
+    r.others = wput(w, others, sizeof(rules_key) * r.nothers, 8) - set;
+    r.regs = wput(w, regs, sizeof(rules_re) * nregs, 8) - set;
+    r.nregs = nregs;
+    r.encs = wput(w, encs, sizeof(rules_enc) * nencs, 8) - set;
+    r.nencs = nencs;
+    memcpy(w->data + set, &r, sizeof(ruleset));
+
+    mem_free(MEM_SYNTAX, table);
+    mem_free(MEM_SYNTAX, others);
+    return set;
+}
+
+/* hash of a file type key, its kind included so an extension and a file name can be the same string */
+static uint32_t rules_typehash(enum rules_kind kind, const char *key, int len) {
+    uint8_t k = kind;
+    return hash_bytes(hash_bytes(HASH_SEED, &k, 1), key, len);
+}
+
+/* add a file type key for the ruleset at set */
+static void rules_addtype(writer *w, rules_type **types, int *ntypes, enum rules_kind kind,
+        const char *key, uint32_t set) {
+    // cleared first so the padding is the same every time it is built
+    *types = mem_realloc(MEM_SYNTAX, *types, sizeof(rules_type) * (*ntypes + 1));
+    memset(&(*types)[*ntypes], 0, sizeof(rules_type));
+    (*types)[*ntypes].key = wstr(w, key);
+    (*types)[*ntypes].set = set;
+    (*types)[*ntypes].kind = kind;
+    (*ntypes)++;
+}
+
+/*
+ * compile one rule file. The first line lists what files it handles: extensions,
+ * "=name" for whole file names and "!interp" for scripts started with "#!interp".
+ * Each following line is "<attribute> <KEY|REG|ENC> <value>". Returns false for an
+ * empty file, otherwise the ruleset is written and its keys are added to types,
+ * along with the file's name (less .jsr) as the language for modelines
+ */
+static bool rules_compile(writer *w, FILE *f, const char *name, uint64_t *hash,
+        rules_type **types, int *ntypes) {
+    char *text = NULL;
+    size_t cap = 0;
+    ssize_t n;
+    int y = 0;
+
+    char *exts = NULL;
+    word *words = NULL;
+    rules_re *regs = NULL;
+    rules_enc *encs = NULL;
+    int nwords = 0, nregs = 0, nencs = 0;
+
+    *hash = HASH_SEED;
+    while ((n = getline(&text, &cap, f)) != -1) {
+        *hash = hash_bytes(*hash, text, n);
+        if (n > 0 && text[n - 1] == '\n') {
+            text[--n] = '\0';
+        }
+
+        if (y++ == 0) {
+            exts = mem_alloc(MEM_SYNTAX, n + 1);
+            strcpy(exts, text);
+            continue;
+        }
+
+        // parse our data
+        char type[512];
+        char attr[512];
+        char val[2048];
+        if (sscanf(text, "%511s %511s %2047[^\n]", attr, type, val) != 3) {
+            continue;
+        }
+        enum attr_type a = rules_attr(attr);
+
+        // keywords
+        if (strcmp(type, "KEY") == 0) {
+            char *k = strtok(val, " ");
+            while (k != NULL) {
+                words = mem_realloc(MEM_SYNTAX, words, sizeof(word) * (nwords + 1));
+                words[nwords].s = mem_alloc(MEM_SYNTAX, strlen(k) + 1);
+                strcpy(words[nwords].s, k);
+                words[nwords].type = a;
+                nwords++;
+
+                k = strtok(NULL, " ");
+            }
+        }
+
+        // regex
+        else if (strcmp(type, "REG") == 0) {
+            // cleared first so unused parts of the program are the same every time it is built
+            regs = mem_realloc(MEM_SYNTAX, regs, sizeof(rules_re) * (nregs + 1));
+            memset(&regs[nregs], 0, sizeof(rules_re));
+            re_compileto(&regs[nregs].prog, val);
+            regs[nregs].type = a;
+            nregs++;
+        }
+
+        // encapsulation
+        else if (strcmp(type, "ENC") == 0) {
+            char bs[128], es[128];
+            if (sscanf(val, "%127s %127s", bs, es) != 2) {
+                continue;
+            }
+
+            encs = mem_realloc(MEM_SYNTAX, encs, sizeof(rules_enc) * (nencs + 1));
+            memset(&encs[nencs], 0, sizeof(rules_enc));
+            re_compileto(&encs[nencs].begin, bs);
+            re_compileto(&encs[nencs].end, es);
+            encs[nencs].type = a;
+            nencs++;
+        }
+    }
+    free(text);
+
+    if (exts != NULL) {
+        char lang[256];
+        snprintf(lang, sizeof(lang), "%s", name);
+        size_t langlen = strlen(lang);
+        if (langlen > 4 && strcmp(lang + langlen - 4, ".jsr") == 0) {
+            lang[langlen - 4] = '\0';
+        }
+
+        uint32_t set = rules_write(w, lang, words, nwords, regs, nregs, encs, nencs);
+        rules_addtype(w, types, ntypes, RULES_LANG, lang, set);
+
+        char *ext = strtok(exts, " ");
+        while (ext != NULL) {
+            if (ext[0] == '=' && ext[1] != '\0') {
+                rules_addtype(w, types, ntypes, RULES_NAME, ext + 1, set);
+            } else if (ext[0] == '!' && ext[1] != '\0') {
+                rules_addtype(w, types, ntypes, RULES_INTERP, ext + 1, set);
+            } else {
+                rules_addtype(w, types, ntypes, RULES_EXT, ext, set);
+            }
+
+            ext = strtok(NULL, " ");
+        }
+    }
+
+    for (int i = 0; i < nwords; i++) {
+        mem_free(MEM_SYNTAX, words[i].s);
+    }
+    mem_free(MEM_SYNTAX, words);
+    mem_free(MEM_SYNTAX, regs);
+    mem_free(MEM_SYNTAX, encs);
+    mem_free(MEM_SYNTAX, exts);
+
+    return y > 0;
+}
+
+static int rules_cmpname(const void *a, const void *b) {
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+char *rules_build(const char *dirpath, size_t *size) {
+    struct stat st;
+    if (stat(dirpath, &st) != 0) {
+        return NULL;
+    }
+
+    // grab all the syntax files, sorted so the same directory always gives the same blob
+    DIR *d = opendir(dirpath);
+    struct dirent *curr;
+    if (!d) {
+        return NULL;
+    }
+    char **names = NULL;
+    int nnames = 0;
+    while ((curr = readdir(d)) != NULL) {
+        // ignore ./ and ../
+        if (strcmp(curr->d_name, ".") == 0 || strcmp(curr->d_name, "..") == 0) {
+            continue;
+        }
+        names = mem_realloc(MEM_SYNTAX, names, sizeof(char *) * (nnames + 1));
+        names[nnames] = mem_alloc(MEM_SYNTAX, strlen(curr->d_name) + 1);
+        strcpy(names[nnames++], curr->d_name);
+    }
+    closedir(d);
+    qsort(names, nnames, sizeof(char *), rules_cmpname);
+
+    writer w = {NULL, 0, 0};
+    rules_header h = {RULES_MAGIC, RULES_VERSION};
+    wput(&w, NULL, sizeof(rules_header), 8);
+    h.dir = wstr(&w, dirpath);
+    h.mtime = st.st_mtime;
+
+    rules_source *sources = mem_calloc(MEM_SYNTAX, nnames + 1, sizeof(rules_source));
+    rules_type *types = NULL;
+    int ntypes = 0;
+
+    for (int i = 0; i < nnames; i++) {
+        char fpath[1024];
+        snprintf(fpath, sizeof(fpath), "%s/%s", dirpath, names[i]);
+
+        FILE *f = fopen(fpath, "r");
+        if (f == NULL) {
+            continue;
+        }
+
+        struct stat fst;
+        rules_source *src = &sources[h.nsources];
+        if (fstat(fileno(f), &fst) == 0 && S_ISREG(fst.st_mode)
+                && rules_compile(&w, f, names[i], &src->hash, &types, &ntypes)) {
+            src->path = wstr(&w, fpath);
+            src->mtime = fst.st_mtime;
+            src->size = fst.st_size;
+            h.nsources++;
+        }
+        fclose(f);
+    }
+
+    // size the file type table to stay at most half full, the first file to claim a key wins
+    uint32_t slots = 1;
+    while (slots < (uint32_t)ntypes * 2) {
+        slots <<= 1;
+    }
+    rules_type *table = mem_calloc(MEM_SYNTAX, slots, sizeof(rules_type));
+    for (int i = 0; i < ntypes; i++) {
+        const char *key = w.data + types[i].key;
+        uint32_t slot = rules_typehash(types[i].kind, key, strlen(key)) & (slots - 1);
+
+        while (table[slot].key != 0 && !(table[slot].kind == types[i].kind
+                    && strcmp(w.data + table[slot].key, key) == 0)) {
+            slot = (slot + 1) & (slots - 1);
+        }
+        if (table[slot].key == 0) {
+            table[slot] = types[i];
+        }
+    }
+    h.types = wput(&w, table, sizeof(rules_type) * slots, 8);
+    h.typemask = slots - 1;
+    mem_free(MEM_SYNTAX, table);
+
+    // the sources go last and aren't hashed, their times get updated in place
+    h.sources = wput(&w, sources, sizeof(rules_source) * h.nsources, 8);
+    h.hash = hash_bytes(HASH_SEED, w.data + sizeof(rules_header), h.sources - sizeof(rules_header));
+
+    // end on zeros, so a string read from a damaged blob still stops inside it
+    wput(&w, NULL, 8, 8);
+    h.size = w.len;
+    memcpy(w.data, &h, sizeof(rules_header));
+
+    for (int i = 0; i < nnames; i++) {
+        mem_free(MEM_SYNTAX, names[i]);
+    }
+    mem_free(MEM_SYNTAX, names);
+    mem_free(MEM_SYNTAX, sources);
+    mem_free(MEM_SYNTAX, types);
+
+    *size = w.len;
+    return w.data;
+}
+
+/* whether n elements of the given size at off lie within size bytes */
+static bool rules_fits(uint64_t off, uint64_t n, size_t elem, size_t size) {
+    return off <= size && n * elem <= size - off;
+}
+
+bool rules_check(const char *blob, size_t size) {
+    const rules_header *h = (const rules_header *)blob;
+
+    if (size < sizeof(rules_header) || h->magic != RULES_MAGIC || h->version != RULES_VERSION
+            || h->size != size || blob[size - 1] != '\0' || h->dir >= size
+            || h->sources < sizeof(rules_header)
+            || !rules_fits(h->sources, h->nsources, sizeof(rules_source), size)
+            || (h->typemask & (h->typemask + 1)) != 0
+            || !rules_fits(h->types, (uint64_t)h->typemask + 1, sizeof(rules_type), size)
+            || h->hash != hash_bytes(HASH_SEED, blob + sizeof(rules_header), h->sources - sizeof(rules_header))) {
+        return false;
+    }
+
+    const rules_source *sources = (const rules_source *)AT(blob, h->sources);
+    for (uint32_t i = 0; i < h->nsources; i++) {
+        if (sources[i].path >= size) {
+            return false;
+        }
+    }
+
+    const rules_type *types = (const rules_type *)AT(blob, h->types);
+    for (uint32_t i = 0; i <= h->typemask; i++) {
+        if (types[i].key == 0) {
+            continue;
+        }
+        if (types[i].key >= size || !rules_fits(types[i].set, 1, sizeof(ruleset), size)) {
+            return false;
+        }
+
+        const ruleset *r = (const ruleset *)AT(blob, types[i].set);
+        size_t left = size - types[i].set;
+        if (r->name >= left
+                || !rules_fits(r->keys, (uint64_t)r->keymask + 1, sizeof(rules_key), left)
+                || !rules_fits(r->others, r->nothers, sizeof(rules_key), left)
+                || !rules_fits(r->regs, r->nregs, sizeof(rules_re), left)
+                || !rules_fits(r->encs, r->nencs, sizeof(rules_enc), left)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* hash the contents of a file, 0 if it can't be read */
+static uint64_t rules_hashfile(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return 0;
+    }
+
+    char chunk[4096];
+    size_t n;
+    uint64_t hash = HASH_SEED;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        hash = hash_bytes(hash, chunk, n);
+    }
+    fclose(f);
+
+    return hash;
+}
+
+bool rules_current(const char *blob, const char *dirpath, int fd) {
+    const rules_header *h = (const rules_header *)blob;
+    struct stat st;
+
+    // files added, removed or renamed change the directory
+    if (strcmp(AT(blob, h->dir), dirpath) != 0 || stat(dirpath, &st) != 0 || st.st_mtime != h->mtime) {
+        return false;
+    }
+
+    const rules_source *sources = (const rules_source *)AT(blob, h->sources);
+    for (uint32_t i = 0; i < h->nsources; i++) {
+        const char *path = AT(blob, sources[i].path);
+        if (stat(path, &st) != 0 || st.st_size != sources[i].size) {
+            return false;
+        }
+        if (st.st_mtime == sources[i].mtime) {
+            continue;
+        }
+
+        if (rules_hashfile(path) != sources[i].hash) {
+            return false;
+        }
+
+        // only touched, record the new time so the file isn't hashed again next time
+        if (fd != -1) {
+            int64_t mtime = st.st_mtime;
+            off_t at = h->sources + sizeof(rules_source) * i + offsetof(rules_source, mtime);
+            if (pwrite(fd, &mtime, sizeof(mtime), at) != sizeof(mtime)) {
+                fd = -1;
+            }
+        }
+    }
+
+    return true;
+}
+
+const ruleset *rules_find(const char *blob, enum rules_kind kind, const char *key, int len) {
+    const rules_header *h = (const rules_header *)blob;
+    const rules_type *types = (const rules_type *)AT(blob, h->types);
+    uint32_t slot = rules_typehash(kind, key, len) & h->typemask;
+
+    for (; types[slot].key != 0; slot = (slot + 1) & h->typemask) {
+        const char *k = AT(blob, types[slot].key);
+        if (types[slot].kind == kind && strncmp(k, key, len) == 0 && k[len] == '\0') {
+            return (const ruleset *)AT(blob, types[slot].set);
+        }
+    }
+    return NULL;
+}
+
+const char *rules_name(const ruleset *r) {
+    return AT(r, r->name);
+}
+
+const rules_re *rules_regs(const ruleset *r) {
+    return (const rules_re *)AT(r, r->regs);
+}
+
+const rules_enc *rules_encs(const ruleset *r) {
+    return (const rules_enc *)AT(r, r->encs);
+}
+
+int rules_keyword(const ruleset *r, const char *s, int i, int len, enum attr_type *type) {
+    // keywords have to start a word
+    if (i != 0 && isalpha((unsigned char)s[i - 1])) {
+        return -1;
+    }
+
+    // a plain keyword can only be the whole run of letters here
+    int end = i;
+    while (end < len && isalpha((unsigned char)s[end])) {
+        end++;
+    }
+    if (end > i) {
+        const rules_key *keys = (const rules_key *)AT(r, r->keys);
+        uint32_t slot = hash_bytes(HASH_SEED, s + i, end - i) & r->keymask;
+
+        for (; keys[slot].len != 0; slot = (slot + 1) & r->keymask) {
+            if (keys[slot].len == end - i && memcmp(AT(r, keys[slot].word), s + i, end - i) == 0) {
+                *type = keys[slot].type;
+                return end - i;
+            }
+        }
+    }
+
+    // other keywords just need to end the word
+    const rules_key *others = (const rules_key *)AT(r, r->others);
+    for (uint32_t k = 0; k < r->nothers; k++) {
+        int klen = others[k].len;
+        if (klen <= len - i && memcmp(AT(r, others[k].word), s + i, klen) == 0
+                && (i + klen == len || !isalpha((unsigned char)s[i + klen]))) {
+            *type = others[k].type;
+            return klen;
+        }
+    }
+
+    return -1;
+}
@@ -6,452 +6,633 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <ctype.h>
 #include <stdio.h>
-#include <dirent.h>
-
-#ifdef __APPLE__
-#include <mach-o/dyld.h>
-#endif
-
-#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
-#endif
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <core/attribute.h>
 #include <core/syntax.h>
+#include <core/fold.h>
+#include <core/nest.h>
 #include <core/regex.h>
+#include <core/rules.h>
+#include <core/hash.h>
 #include <core/line.h>
-#include <core/file.h>
-
-typedef struct _rule {
-    char *s;
-    int len;
-    enum attr_type type;
-} rule;
+#include <core/mem.h>
 
-static bool syntax_enabled = false;
+/* compiled rules for each syntax directory, searched in the order they were added and before the built in rules */
+typedef struct syntax_rules {
+    char *blob;
+    size_t size;
+    bool mapped;
+} syntax_rules;
 
-/*
- * rule arrays:
- *  - key is for keywords, those are simply literal matches
- *  - reg is for a regular expression to match
- *  - enc is encapsulations. enc_b stores the beginning rules while enc_e stores
- *      the corresponding end rules
- */
-static rule *key, *reg, *enc_b, *enc_e;
-static int key_len, reg_len, enc_len;
+static syntax_rules *loaded;
+static int loadedlen;
 
-static char **filetypes;
-static char **jsrfiles;
-static int fileslen;
+/* directories added but not compiled or mapped yet, which waits until a buffer first needs a ruleset */
+static char **pending;
+static int pendinglen;
 
-/* private functions */
-static bool test_keyword(const line *l, int i, rule r);
-static int test_regex(const line *l, int i, rule r);
+/* how many lines at each end of a file can hold a modeline */
+#define MODELINES 5
 
-/* populates list of supported filetypes */
+/* adds the user's own rule files, which take precedence over the built in ones */
 void syntax_readfiles() {
-    fileslen = 0;
-
-    // get the syntax directory using <exedir>/../share/jet/syntax
-    const char *syntax_loc = "/../share/jet/syntax";
+    // look in $XDG_CONFIG_HOME/jet/syntax, or ~/.config/jet/syntax
+    const char *config = getenv("XDG_CONFIG_HOME");
+    const char *home = getenv("HOME");
     char dirpath[1024];
 
-#ifdef __APPLE__
-    uint32_t len = 1024;
-    _NSGetExecutablePath(dirpath, &len);
-#endif
+    if (config != NULL && config[0] != '\0') {
+        snprintf(dirpath, sizeof(dirpath), "%s/jet/syntax", config);
+    } else if (home != NULL && home[0] != '\0') {
+        snprintf(dirpath, sizeof(dirpath), "%s/.config/jet/syntax", home);
+    } else {
+        return;
+    }
+
+    syntax_readdir(dirpath);
+}
 
-#ifdef __linux__
-    size_t len;
-    len = readlink("/proc/self/exe", dirpath, sizeof(dirpath) - 1);
-    if (len != -1) {
-        dirpath[len] = '\0';
+/* where the compiled rules for a directory are cached, false if there is nowhere to put them */
+static bool syntax_cachepath(const char *dirpath, char *path, size_t size) {
+    const char *cache = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    char dir[768];
+
+    if (cache != NULL && cache[0] != '\0') {
+        snprintf(dir, sizeof(dir), "%s/jet", cache);
+    } else if (home != NULL && home[0] != '\0') {
+        snprintf(dir, sizeof(dir), "%s/.cache/jet", home);
+    } else {
+        return false;
     }
-#endif
-    if (dirpath[0] == '\0') {
-        return;
+
+    // create the directory (and its parent) if this is the first time
+    char *slash = strrchr(dir, '/');
+    *slash = '\0';
+    mkdir(dir, 0755);
+    *slash = '/';
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        return false;
+    }
+
+    // one cache per directory of rules
+    unsigned long long key = hash_bytes(HASH_SEED, dirpath, strlen(dirpath));
+    snprintf(path, size, "%s/syntax-%016llx.jsc", dir, key);
+    return true;
+}
+
+/* map the cached rules for a directory if they are still current */
+static bool syntax_mapcache(const char *dirpath, const char *path, syntax_rules *r) {
+    int fd = open(path, O_RDWR);
+    if (fd == -1) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(rules_header)) {
+        close(fd);
+        return false;
+    }
+
+    char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+
+    if (!rules_check(map, st.st_size) || !rules_current(map, dirpath, fd)) {
+        munmap(map, st.st_size);
+        close(fd);
+        return false;
     }
-    dirpath[strlen(dirpath) - 4] = '\0';
-    strcat(dirpath, syntax_loc);
+    close(fd);
 
-    // grab all the syntax files
-    DIR *d = opendir(dirpath);
-    struct dirent *curr;
-    if (!d) {
+    r->blob = map;
+    r->size = st.st_size;
+    r->mapped = true;
+    return true;
+}
+
+/* save compiled rules, written aside and renamed so a reader never sees half a file */
+static void syntax_writecache(const char *path, const char *blob, size_t size) {
+    char tmp[1100];
+    snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+
+    int fd = mkstemp(tmp);
+    if (fd == -1) {
         return;
     }
-    while ((curr = readdir(d)) != NULL) {
-        // ignore ./ and ../
-        if (strcmp(curr->d_name, ".") == 0 || strcmp(curr->d_name, "..") == 0) {
-            continue;
-        }
 
-        char fpath[512];
-        strcpy(fpath, dirpath);
-        strcat(fpath, "/");
-        strcat(fpath, curr->d_name);
+    bool ok = write(fd, blob, size) == (ssize_t)size;
+    close(fd);
+    if (!ok || rename(tmp, path) != 0) {
+        unlink(tmp);
+    }
+}
+
+/* compile or map the rules of one directory, compiling them if the cache is out of date */
+static void syntax_loaddir(const char *dirpath) {
+    syntax_rules r;
+    char path[1024];
 
-        // read the first line of the file and add entries to available filetypes
-        buffer *buf = readbuf(fpath);
-        if (buf->len == 0) {
-            delbuf(buf);
-            closedir(d);
+    struct stat st;
+    if (stat(dirpath, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        return;
+    }
+    bool cached = syntax_cachepath(dirpath, path, sizeof(path));
+
+    if (!cached || !syntax_mapcache(dirpath, path, &r)) {
+        r.blob = rules_build(dirpath, &r.size);
+        r.mapped = false;
+        if (r.blob == NULL) {
             return;
         }
-        char *ext = strtok(buf->lines[0]->s, " ");
-        while (ext != NULL) {
-            filetypes = realloc(filetypes, sizeof(char*) * fileslen + 1);
-            filetypes[fileslen] = malloc(strlen(ext) + 1);
-            strcpy(filetypes[fileslen], ext);
-
-            jsrfiles = realloc(jsrfiles, sizeof(char*) * fileslen + 1);
-            jsrfiles[fileslen] = malloc(strlen(fpath) + 1);
-            strcpy(jsrfiles[fileslen], fpath);
-
-            fileslen++;
-            ext = strtok(NULL, " ");
+        if (cached) {
+            syntax_writecache(path, r.blob, r.size);
         }
     }
 
-    closedir(d);
+    loaded = mem_realloc(MEM_SYNTAX, loaded, sizeof(syntax_rules) * (loadedlen + 1));
+    loaded[loadedlen++] = r;
+}
+
+/* adds the filetypes of every rule file in the given directory, once a buffer needs them */
+void syntax_readdir(const char *dirpath) {
+    pending = mem_realloc(MEM_SYNTAX, pending, sizeof(char *) * (pendinglen + 1));
+    pending[pendinglen] = mem_alloc(MEM_SYNTAX, strlen(dirpath) + 1);
+    strcpy(pending[pendinglen++], dirpath);
+}
+
+/* load any directories added since the last lookup */
+static void syntax_loadpending() {
+    for (int i = 0; i < pendinglen; i++) {
+        syntax_loaddir(pending[i]);
+        mem_free(MEM_SYNTAX, pending[i]);
+    }
+
+    mem_free(MEM_SYNTAX, pending);
+    pending = NULL;
+    pendinglen = 0;
 }
 
 /* clears the list of supported filetypes */
 void syntax_clearfiles() {
-    for (int i = 0; i < fileslen; i++) {
-        free(filetypes[i]);
-        free(jsrfiles[i]);
+    for (int i = 0; i < loadedlen; i++) {
+        if (loaded[i].mapped) {
+            munmap(loaded[i].blob, loaded[i].size);
+        } else {
+            mem_free(MEM_SYNTAX, loaded[i].blob);
+        }
     }
 
-    free(filetypes);
-    free(jsrfiles);
-    fileslen = 0;
-}
+    mem_free(MEM_SYNTAX, loaded);
+    loaded = NULL;
+    loadedlen = 0;
 
-/* sets up syntax  */
-void syntax_init(buffer *b) {
-    // if we don't have a name, no syntax for you
-    if (b->name == NULL) {
-        return;
+    for (int i = 0; i < pendinglen; i++) {
+        mem_free(MEM_SYNTAX, pending[i]);
     }
+    mem_free(MEM_SYNTAX, pending);
+    pending = NULL;
+    pendinglen = 0;
+}
 
-    // grab the extension
-    const char *ext = strchr(b->name, '.');
-    if (!ext || ext == b->name || *(ext + 1) == '\0') { // did we get it?
-        return;
+/* the ruleset for len characters of key, from the user's rules first and then the built in ones */
+static const ruleset *syntax_find(enum rules_kind kind, const char *key, int len) {
+    const ruleset *r = NULL;
+
+    if (len <= 0) {
+        return NULL;
     }
-    ext++;
 
-    // if we don't support the extension, no syntax for you
-    char *fname = NULL;
-    for (int i = 0; i < fileslen; i++) {
-        if (strcmp(ext, filetypes[i]) == 0) {
-            fname = jsrfiles[i];
-            break;
-        }
+    syntax_loadpending();
+    for (int i = 0; i < loadedlen && r == NULL; i++) {
+        r = rules_find(loaded[i].blob, kind, key, len);
     }
-    if (fname == NULL) {
-        return;
+    if (r == NULL) {
+        r = rules_find(rules_builtin, kind, key, len);
     }
 
-    // hoo boy we're in the clear, let's go
-    buffer *syn = readbuf(fname);
+    return r;
+}
 
-    // for each line (except the first)
-    for (int y = 1; y < syn->len; y++) {
-        line *l = syn->lines[y];
-        enum attr_type a;
+/* whether s starts with word, and the word is not the tail end of a longer one */
+static bool syntax_word(const char *line, const char *s, const char *word) {
+    return strncmp(s, word, strlen(word)) == 0 && (s == line || !isalnum((unsigned char)s[-1]));
+}
 
-        char type[512];
-        char attr[512];
-        char val[2048];
+/* the language a vim or emacs modeline in the line names, NULL if it has none */
+static const ruleset *syntax_modeline(const line *l) {
+    const char *s = l->s;
+    const char *end = s + l->len;
+    char lang[64];
+    int len = 0;
 
-        // parse our data
-        sscanf(l->s, "%s %s %[^\n]", attr, type, val);
+    // vim: "vim: set ft=c:", "vi: filetype=c" and the like
+    for (const char *p = s; p < end && len == 0; p++) {
+        if (!syntax_word(s, p, "vim:") && !syntax_word(s, p, "vi:") && !syntax_word(s, p, "ex:")) {
+            continue;
+        }
+        for (const char *q = strchr(p, ':') + 1; q < end; q++) {
+            const char *opts[] = {"filetype=", "ft=", "syntax=", "syn="};
+            for (int i = 0; i < 4 && len == 0; i++) {
+                if (syntax_word(s, q, opts[i])) {
+                    const char *v = q + strlen(opts[i]);
+                    while (v + len < end && len < (int)sizeof(lang) - 1 && (isalnum((unsigned char)v[len])
+                                || v[len] == '_' || v[len] == '-')) {
+                        lang[len] = v[len];
+                        len++;
+                    }
+                }
+            }
+            if (len > 0) {
+                break;
+            }
+        }
+    }
 
-        // set the attribute
-        if (strcmp(attr, "HIGHLIGHT") == 0) {
-            a = HIGHLIGHT;
+    // emacs: "-*- mode: c -*-" or just "-*- c -*-"
+    const char *open = len == 0 ? strstr(s, "-*-") : NULL;
+    const char *close = open != NULL ? strstr(open + 3, "-*-") : NULL;
+    if (close != NULL) {
+        const char *v = open + 3;
+        const char *mode = strstr(v, "mode:");
+        if (mode != NULL && mode < close) {
+            v = mode + 5;
+        } else if (memchr(v, ':', close - v) != NULL) {
+            v = close;
         }
-        else if (strcmp(attr, "BOLD") == 0) {
-            a = BOLD;
+        while (v < close && isspace((unsigned char)*v)) {
+            v++;
         }
-        else if (strcmp(attr, "COLOR1") == 0) {
-            a = COLOR1;
+        while (v + len < close && len < (int)sizeof(lang) - 1 && !isspace((unsigned char)v[len])
+                && v[len] != ';') {
+            lang[len] = tolower((unsigned char)v[len]);
+            len++;
         }
-        else if (strcmp(attr, "COLOR2") == 0) {
-            a = COLOR2;
+    }
+
+    return syntax_find(RULES_LANG, lang, len);
+}
+
+/* the ruleset for the interpreter named by a "#!" line, NULL if the line isn't one */
+static const ruleset *syntax_shebang(const line *l) {
+    if (l->len < 2 || l->s[0] != '#' || l->s[1] != '!') {
+        return NULL;
+    }
+
+    // take the program's name, or the first argument to env that isn't an option or a variable
+    const char *p = l->s + 2;
+    const char *name = NULL;
+    int len = 0;
+    while (*p != '\0') {
+        while (*p == ' ' || *p == '\t') {
+            p++;
         }
-        else if (strcmp(attr, "COLOR3") == 0) {
-            a = COLOR3;
+        const char *word = p;
+        while (*p != '\0' && *p != ' ' && *p != '\t') {
+            p++;
         }
-        else if (strcmp(attr, "COLOR4") == 0) {
-            a = COLOR4;
+        if (p == word) {
+            break;
         }
-        else a = NONE;
 
-        // keywords
-        if (strcmp(type, "KEY") == 0) {
-            char *k = strtok(val, " ");
-            while (k != NULL) {
-                rule r;
-                r.len = strlen(k);
-                r.s = malloc(r.len + 1);
-                strcpy(r.s, k);
-                r.type = a;
-
-                key_len++;
-                key = realloc(key, sizeof(rule) * key_len);
-                key[key_len - 1] = r;
-
-                k = strtok(NULL, " ");
+        name = word;
+        for (const char *c = word; c < p; c++) {
+            if (*c == '/') {
+                name = c + 1;
             }
         }
+        len = p - name;
 
-        // regex
-        else if (strcmp(type, "REG") == 0) {
-            rule r;
-            r.len = strlen(val);
-            r.s = malloc(r.len + 1);
-            strcpy(r.s, val);
-            r.type = a;
-
-            reg_len++;
-            reg = realloc(reg, sizeof(rule) * reg_len);
-            reg[reg_len - 1] = r;
+        if (!(len == 3 && strncmp(name, "env", 3) == 0) && word[0] != '-' && memchr(word, '=', p - word) == NULL) {
+            break;
         }
+        len = 0;
+    }
 
-        // encapsulation
-        else if (strcmp(type, "ENC") == 0) {
-            rule b, e;
-            char bs[128], es[128];            
-            sscanf(val, "%s %s", bs, es);
+    // python3.11 falls back to python
+    const ruleset *r = syntax_find(RULES_INTERP, name, len);
+    while (r == NULL && len > 0 && (isdigit((unsigned char)name[len - 1]) || name[len - 1] == '.')) {
+        r = syntax_find(RULES_INTERP, name, --len);
+    }
+    return r;
+}
 
-            b.len = strlen(bs);
-            b.s = malloc(b.len + 1);
-            strcpy(b.s, bs);
-            b.type = a;
+/*
+ * sets up syntax for a buffer. A modeline wins, then the file's whole name, then
+ * its extension (after the last dot), and last of all the interpreter of a "#!" line
+ */
+void syntax_init(buffer *b) {
+    const ruleset *rules = NULL;
+    syntax_end(b);
+
+    // lines of viewed files aren't looked at, they can't be highlighted anyway
+    if (b->index == NULL) {
+        for (int y = 0; y < b->len && rules == NULL; y++) {
+            if (y == MODELINES && b->len - MODELINES > y) {
+                y = b->len - MODELINES;
+            }
+            rules = syntax_modeline(b->lines[y]);
+        }
+    }
 
-            e.len = strlen(es);
-            e.s = malloc(e.len + 1);
-            strcpy(e.s, es);
-            e.type = a;
+    if (rules == NULL && b->name != NULL) {
+        const char *name = strrchr(b->name, '/');
+        name = name != NULL ? name + 1 : b->name;
 
-            enc_len++;
-            enc_b = realloc(enc_b, sizeof(rule) * enc_len);
-            enc_b[enc_len - 1] = b;
+        rules = syntax_find(RULES_NAME, name, strlen(name));
 
-            enc_e = realloc(enc_e, sizeof(rule) * enc_len);
-            enc_e[enc_len - 1] = e;
+        // a leading dot hides a file rather than starting an extension
+        const char *ext = strrchr(name, '.');
+        if (rules == NULL && ext != NULL && ext != name) {
+            rules = syntax_find(RULES_EXT, ext + 1, strlen(ext + 1));
         }
     }
 
-    delbuf(syn);
-
-    syntax_enabled = true;
-}
+    if (rules == NULL && b->index == NULL && b->len > 0) {
+        rules = syntax_shebang(b->lines[0]);
+    }
 
-/* clears all syntax rules */
-void syntax_end() {
-    for (int i = 0; i < key_len; i++) {
-        free(key[i].s);
+    if (rules != NULL) {
+        b->syntax = mem_alloc(MEM_SYNTAX, sizeof(syntax));
+        b->syntax->rules = rules;
+        b->syntax->clean = 0;
     }
-    free(key);
-    key_len = 0;
 
-    for (int i = 0; i < reg_len; i++) {
-        free(reg[i].s);
+    // viewed files are never highlighted, and only hold on to a few lines at a time
+    if (b->index != NULL) {
+        return;
     }
-    free(reg);
-    reg_len = 0;
 
-    for (int i = 0; i < enc_len; i++) {
-        free(enc_b[i].s);
-        free(enc_e[i].s);
+    // whatever the lines were highlighted with before is no good now, nor are brackets counted by it
+    nest_end(b);
+    for (int y = 0; y < b->len; y++) {
+        line *l = b->lines[y];
+        if (l->attrs != NULL) {
+            lclrattrs(l, 0, l->len);
+        }
+        ldelmarks(l, 0, lnmarks(l));
+        l->hlvalid = 0;
+        l->hldirty = 0;
+        l->hldirtyend = l->len;
     }
-    free(enc_b);
-    free(enc_e);
+}
 
-    key = reg = enc_b = enc_e = NULL;
-    enc_len = 0;
+/* forgets a buffer's syntax rules, the rules themselves stay loaded for other buffers */
+void syntax_end(buffer *b) {
+    mem_free(MEM_SYNTAX, b->syntax);
+    b->syntax = NULL;
+}
 
-    syntax_enabled = false;
+const char *syntax_name(buffer *b) {
+    return b->syntax != NULL ? rules_name(b->syntax->rules) : NULL;
 }
 
-/* generate syntax attributes for the given buffer */
-void gen_syntax(buffer *b) {
-    // only proceed if syntax is enabled
-    if (!syntax_enabled) {
-        return;
+/* where highlighting is along a line */
+typedef struct scan {
+    line *l;
+    int cleared;        // attributes before here were cleared or written this time around
+    attribute attr;     // the attribute in effect, the last one written
+} scan;
+
+/* write an attribute at x, clearing anything left from last time up to it first */
+static void scan_attr(scan *sc, attribute a, int x) {
+    if (x + 1 > sc->cleared) {
+        lclrattrs(sc->l, sc->cleared, x + 1);
+        sc->cleared = x + 1;
     }
+    laddattr(sc->l, a, x);
+    sc->attr = a;
+}
 
-    int y, x;
-    line *prev, *curr, *next;
-    int curr_enc = -1;
+static bool sameattr(attribute a, attribute b) {
+    return a.enabled == b.enabled && (!a.enabled || a.type == b.type);
+}
 
-    // iterate over each line
-    for (y = 0; y < b->len; y++) {
-        bool enc_ended = false;
-        x = 0;
-        if (y > 0) {
-            prev = b->lines[y - 1];
-        } else {
-            prev = NULL;
-        }
-        curr = b->lines[y];
-        if (y < b->len - 1) {
-            next = b->lines[y + 1];
-        } else {
-            next = NULL;
-        }
+/*
+ * highlight a line from the last mark before whatever changed, up to the first
+ * mark past want (or the end of the line). Stops early if it arrives at an old
+ * mark past the change in the same state, as from there on nothing is different
+ */
+static void syntax_scan(const ruleset *rules, line *l, int want) {
+    const rules_enc *encs = rules_encs(rules);
+    const rules_re *regs = rules_regs(rules);
+
+    // pick up from the last mark at or before the first thing that needs doing
+    int from = l->hldirty < l->hlvalid ? l->hldirty : l->hlvalid;
+    int m = 0;
+    while (m < lnmarks(l) && l->side->marks[m].x <= from && l->side->marks[m].x < l->len) {
+        m++;
+    }
 
-        // only regenerate if needed
-        if (!curr->needs_update) {
-            continue;
-        }
+    scan sc = { l, 0, nullattr() };
+    int x = 0;
+    int curr_enc = l->hlstart;
+    int last = 0;
+    if (m > 0) {
+        x = last = sc.cleared = l->side->marks[m - 1].x;
+        curr_enc = l->side->marks[m - 1].enc;
+        sc.attr = l->side->marks[m - 1].attr;
+    } else if (curr_enc != -1 && l->len > 0) {
+        // if we're in an encapsulation, add begin attribute
+        attribute a = { encs[curr_enc].type, true };
+        scan_attr(&sc, a, 0);
+    }
 
-        lclrattrs(curr);
+    // check each x for matches to any rule
+    do {
+        if (x > last) {
+            lclrattrs(l, sc.cleared, x);
+            sc.cleared = sc.cleared > x ? sc.cleared : x;
 
-        // if we're in an encapsulation, add begin attribute
-        if (curr_enc != -1 && curr->len > 0) {
-            attribute a = { enc_b[curr_enc].type, true };
-            laddattr(curr, a, 0);
-        }
+            // old marks that were jumped over are no use
+            int passed = m;
+            while (passed < lnmarks(l) && l->side->marks[passed].x < x) {
+                passed++;
+            }
+            ldelmarks(l, m, passed - m);
 
-        // check each x for matches to any rule
-        do {
-            bool matched = false;
-            // closing encapsulations
-            if (curr_enc != -1) {
-                rule r = enc_e[curr_enc];
-                int len;
+            bool atmark = m < lnmarks(l) && l->side->marks[m].x == x;
+            if (atmark && x > l->hldirtyend && l->hlvalid > x && l->side->marks[m].enc == curr_enc
+                    && sameattr(l->side->marks[m].attr, sc.attr)) {
+                lclrdirty(l);
+                return;
+            }
 
-                if ((len = re_match(r.s, curr->s + x)) != -1) {
-                    // create the attribute
-                    attribute a = { r.type, false };
+            if (atmark || x - last >= SYNTAX_CHUNK) {
+                lmark mark = { x, curr_enc, sc.attr };
+                if (atmark) {
+                    l->side->marks[m] = mark;
+                } else {
+                    laddmark(l, mark, m);
+                }
+                m++;
+                last = x;
+
+                // far enough along to be seen, the rest waits
+                if (x >= want) {
+                    ldelmarks(l, m, lnmarks(l) - m);
+                    l->hlvalid = x;
+                    lclrdirty(l);
+                    return;
+                }
+            }
+        }
 
-                    x += len;
-                    if (x < curr->len) {
-                        laddattr(curr, a, x);
-                    }
+        bool matched = false;
+        // closing encapsulations
+        if (curr_enc != -1) {
+            int len;
 
-                    // following lines need to be updated
-                    for (int j = y + 1; j < b->len; j++) {
-                        b->lines[j]->needs_update = true;
-                    }
+            if ((len = re_matchp(&encs[curr_enc].end, l->s + x)) != -1) {
+                // create the attribute
+                attribute a = { encs[curr_enc].type, false };
 
-                    curr_enc = -1;
+                x += len;
+                if (x < l->len) {
+                    scan_attr(&sc, a, x);
+                } else {
+                    sc.attr = a;
                 }
 
-                enc_ended = true;
-                matched = true;
+                curr_enc = -1;
             }
 
-            // opening encapsulations
-            if (!matched) {
-                for (int i = 0; i < enc_len; i++) {
-                    rule r = enc_b[i];
-                    int len;
+            matched = true;
+        }
 
-                    if ((len = re_match(r.s, curr->s + x)) != -1) {
-                        // create attr
-                        attribute a = { r.type, true };
+        // opening encapsulations
+        if (!matched) {
+            for (int i = 0; i < rules->nencs; i++) {
+                int len;
 
-                        laddattr(curr, a, x);
-                        x += len - 1;
+                if ((len = re_matchp(&encs[i].begin, l->s + x)) != -1) {
+                    // create attr
+                    attribute a = { encs[i].type, true };
 
-                        curr_enc = i;
-                        matched = true;
-                        break;
-                    }
-                }
-            }
+                    scan_attr(&sc, a, x);
+                    x += len - 1;
 
-            // regexes
-            if (!matched) {
-                for (int i = 0; i < reg_len; i++) {
-                    rule r = reg[i];
-                    int len;
-
-                    if ((len = test_regex(curr, x, r)) != -1) {
-                        // create attrs
-                        attribute beg = { r.type, true };
-                        attribute end = { r.type, false };
-
-                        // add attributes and update x
-                        laddattr(curr, beg, x);
-                        x += len;
-                        if (x < curr->len) {
-                            laddattr(curr, end, x);
-                        }
-
-                        matched = true;
-                        break;
-                    }
+                    curr_enc = i;
+                    matched = true;
+                    break;
                 }
             }
+        }
 
-            // keywords
-            if (!matched) {
-                for (int i = 0; i < key_len; i++) {
-                    rule r = key[i];
-
-                    if (test_keyword(curr, x, r)) {
-                        // create attrs
-                        attribute beg = { r.type, true };
-                        attribute end = { r.type, false };
+        // regexes
+        if (!matched) {
+            for (int i = 0; i < rules->nregs; i++) {
+                int len;
 
-                        // add attributes and update x
-                        laddattr(curr, beg, x);
-                        x += r.len;
-                        if (x < curr->len) {
-                            laddattr(curr, end, x);
-                        }
+                if ((len = re_matchp(&regs[i].prog, l->s + x)) != -1) {
+                    // create attrs
+                    attribute beg = { regs[i].type, true };
+                    attribute end = { regs[i].type, false };
 
-                        break;
+                    // add attributes and update x
+                    scan_attr(&sc, beg, x);
+                    x += len;
+                    if (x < l->len) {
+                        scan_attr(&sc, end, x);
                     }
+
+                    matched = true;
+                    break;
                 }
             }
-
-            x++;
-        } while (x < curr->len);
-
-        // if we are in an encapsulation, we need to update the next line
-        if (next != NULL && curr_enc != -1) {
-            next->needs_update = true;
         }
 
-        // if we're in an encapsulation, we always want this line to update
-        if (curr_enc == -1 && !enc_ended) {
-            curr->needs_update = false;
+        // keywords
+        if (!matched) {
+            enum attr_type type;
+            int len;
+
+            if ((len = rules_keyword(rules, l->s, x, l->len, &type)) != -1) {
+                // create attrs
+                attribute beg = { type, true };
+                attribute end = { type, false };
+
+                // add attributes and update x
+                scan_attr(&sc, beg, x);
+                x += len;
+                if (x < l->len) {
+                    scan_attr(&sc, end, x);
+                }
+            }
         }
-    }
+
+        x++;
+    } while (x < l->len);
+
+    lclrattrs(l, sc.cleared, l->len);
+    ldelmarks(l, m, lnmarks(l) - m);
+    l->hlvalid = l->len;
+    l->hlend = curr_enc;
+    lclrdirty(l);
 }
 
-/* checks for matches to rule r with a keyword in l at index i */
-static bool test_keyword(const line *l, int i, rule r) {
-    // do we have the word?
-    if (re_match(r.s, l->s + i) == -1) {
-        return false;
+/* generate syntax attributes for the given buffer */
+int gen_syntax(buffer *b, int lines, int cols) {
+    // only proceed if syntax is enabled, lines of viewed files don't stick around long enough
+    if (b->syntax == NULL || b->index != NULL) {
+        return 0;
     }
 
-    // is this an actual word?
-    if ((i != 0 && isalpha(l->s[i - 1]))
-            || (i + r.len != l->len && isalpha(l->s[i + r.len]))) {
-        return false;
-    }
+    const ruleset *rules = b->syntax->rules;
+    int clean = b->syntax->clean < b->len ? b->syntax->clean : b->len;
+    int highlighted = 0;
+    lines = lines < b->len ? lines : b->len;
+
+    // carry on from the last line known to be right, each line starting in whatever the one before ended in
+    int curr_enc = clean > 0 ? b->lines[clean - 1]->hlend : -1;
+    for (int y = clean; y < lines; y++) {
+        line *l = b->lines[y];
+        if (l->hlstart != curr_enc) {
+            l->hlstart = curr_enc;
+            l->hldirty = 0;
+            l->hldirtyend = l->hldirtyend > 0 ? l->hldirtyend : 0;
+        }
 
-    return true;
-}
+        // a line the next one depends on has to be done to the end
+        int want = y < lines - 1 || cols == INT_MAX ? INT_MAX : lbyte(l, cols);
+        int done = l->hlvalid < l->len ? l->hlvalid : INT_MAX;
+        if (l->hldirty <= l->hldirtyend || done < want) {
+            // brackets are counted again from the first change up to as far as was ever highlighted
+            int from = l->hldirty < l->hlvalid ? l->hldirty : l->hlvalid;
+            int to = l->hlvalid;
+            syntax_scan(rules, l, want);
+            nest_stale(b, y, from, to > l->hlvalid ? to : l->hlvalid);
+            bdamage(b, y, y);
+            highlighted++;
+        }
 
-/* checks for matches to rule r with provided index and regex. returns -1 if no
- * match is found, length of the match otherwise */
-static int test_regex(const line *l, int i, rule r) {
-    int len = re_match(r.s, l->s + i);
+        if (y == clean && l->hlvalid == l->len) {
+            clean++;
+        }
+        curr_enc = l->hlend;
+
+        // lines folded away are left alone until they are shown again, opening the fold damaging
+        // them. the line after starts in what the last of them ended in when it was last highlighted
+        int last = fold_last(b, y);
+        if (last > y) {
+            line *end = b->lines[last];
+            curr_enc = end->hlvalid == end->len ? end->hlend : curr_enc;
+            clean = clean == y + 1 ? last + 1 : clean;
+            y = last;
+        }
+    }
 
-    return len;
+    b->syntax->clean = clean;
+    return highlighted;
 }
-
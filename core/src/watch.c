@@ -0,0 +1,249 @@
+/*
+ * watch.c
+ * Watching the files of buffers with inotify, and reading in only what changed
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#include <core/watch.h>
+#include <core/hash.h>
+#include <core/digest.h>
+#include <core/diff.h>
+#include <core/journal.h>
+#include <core/mem.h>
+
+/* what happening to a file in a watched directory counts as a change to it */
+#define WATCH_EVENTS (IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+
+/* the one inotify instance, and how many buffers watch each directory */
+static int watchfd = -1;
+static struct {
+    int wd, count;
+} *dirs;
+static int ndirs;
+
+int watch_fd(void) {
+    return ndirs > 0 ? watchfd : -1;
+}
+
+/* hash the len bytes of fd before end, noting whether the last is a newline */
+static uint64_t watch_tail(int fd, int64_t end, bool *newline) {
+    char data[WATCH_TAIL];
+    int64_t start = end > WATCH_TAIL ? end - WATCH_TAIL : 0;
+    ssize_t got = pread(fd, data, end - start, start);
+    if (got != end - start) {
+        *newline = false;
+        return 0;
+    }
+    *newline = got > 0 && data[got - 1] == '\n';
+    return hash_block(data, got);
+}
+
+void watch_saved(buffer *b) {
+    watch *w = b->watch;
+    if (w == NULL) {
+        return;
+    }
+
+    struct stat st;
+    int fd = open(b->name, O_RDONLY);
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        w->size = -1;
+    } else {
+        w->size = st.st_size;
+        w->sec = st.st_mtim.tv_sec;
+        w->nsec = st.st_mtim.tv_nsec;
+        w->ino = st.st_ino;
+        w->tail = watch_tail(fd, st.st_size, &w->newline);
+    }
+    if (fd != -1) {
+        close(fd);
+    }
+    w->pending = false;
+}
+
+void watch_start(buffer *b) {
+    if (b->name == NULL || !beditable(b) || b->fd != -1 || b->watch != NULL) {
+        return;
+    }
+    if (watchfd == -1) {
+        watchfd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (watchfd == -1) {
+            return;
+        }
+    }
+
+    const char *slash = strrchr(b->name, '/');
+    char dir[slash != NULL ? slash - b->name + 2 : 2];
+    if (slash != NULL) {
+        memcpy(dir, b->name, slash - b->name + 1);
+        dir[slash - b->name + 1] = '\0';
+    } else {
+        strcpy(dir, ".");
+    }
+    int wd = inotify_add_watch(watchfd, dir, WATCH_EVENTS);
+    if (wd == -1) {
+        return;
+    }
+
+    // the same directory is watched once however many of its files are open
+    int i = 0;
+    while (i < ndirs && dirs[i].wd != wd) {
+        i++;
+    }
+    if (i == ndirs) {
+        dirs = mem_realloc(MEM_FILE, dirs, sizeof(*dirs) * (ndirs + 1));
+        dirs[ndirs].wd = wd;
+        dirs[ndirs++].count = 0;
+    }
+    dirs[i].count++;
+
+    watch *w = mem_calloc(MEM_FILE, 1, sizeof(watch));
+    const char *base = slash != NULL ? slash + 1 : b->name;
+    w->wd = wd;
+    w->base = mem_alloc(MEM_FILE, strlen(base) + 1);
+    strcpy(w->base, base);
+    b->watch = w;
+    watch_saved(b);
+}
+
+void watch_end(buffer *b) {
+    watch *w = b->watch;
+    if (w == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < ndirs; i++) {
+        if (dirs[i].wd == w->wd && --dirs[i].count == 0) {
+            inotify_rm_watch(watchfd, w->wd);
+            dirs[i] = dirs[--ndirs];
+            break;
+        }
+    }
+    mem_free(MEM_FILE, w->base);
+    mem_free(MEM_FILE, w);
+    b->watch = NULL;
+}
+
+void watch_events(buffer **bufs, int n) {
+    if (watch_fd() == -1) {
+        return;
+    }
+
+    char data[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t got;
+    while ((got = read(watchfd, data, sizeof(data))) > 0) {
+        for (char *p = data; p < data + got;) {
+            struct inotify_event *e = (struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + e->len;
+
+            // events lost to an overflow could have been to any file
+            for (int i = 0; i < n; i++) {
+                watch *w = bufs[i]->watch;
+                if (w != NULL && ((e->mask & IN_Q_OVERFLOW) || (e->wd == w->wd && e->len > 0 && strcmp(e->name, w->base) == 0))) {
+                    w->pending = true;
+                }
+            }
+        }
+    }
+}
+
+/* add the bytes the file at fd has past the end of what the buffer was read from, a line at a time.
+ * false if they can't be read */
+static bool watch_append(buffer *b, int fd, int64_t from, int64_t to) {
+    watch *w = b->watch;
+
+    // a last line without a newline (or the empty line of an empty file) is carried on by what follows
+    bool carry = from == 0 || !w->newline;
+    line *last = bline(b, b->len - 1);
+    int64_t len = to - from + (carry ? last->len : 0);
+    if (len > INT32_MAX) {
+        return false;
+    }
+
+    char *text = mem_alloc(MEM_FILE, len > 0 ? len : 1);
+    int64_t at = 0;
+    if (carry) {
+        memcpy(text, last->s, last->len);
+        at = last->len;
+    }
+    while (at < len) {
+        ssize_t got = pread(fd, text + at, len - at, from + at - (carry ? last->len : 0));
+        if (got <= 0) {
+            mem_free(MEM_FILE, text);
+            return false;
+        }
+        at += got;
+    }
+
+    breplace(b, carry ? b->len - 1 : b->len, carry, text, len);
+    mem_free(MEM_FILE, text);
+    return true;
+}
+
+enum watch_change watch_update(buffer *b, int *lines) {
+    watch *w = b->watch;
+    *lines = 0;
+    if (w == NULL || !w->pending) {
+        return WATCH_NONE;
+    }
+    w->pending = false;
+
+    struct stat st;
+    int fd = open(b->name, O_RDONLY);
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        if (fd != -1) {
+            close(fd);
+        }
+        bool was = w->size != -1;
+        w->size = -1;
+        return was ? WATCH_GONE : WATCH_NONE;
+    }
+    if (st.st_size == w->size && st.st_mtim.tv_sec == w->sec && st.st_mtim.tv_nsec == w->nsec
+            && (int64_t)st.st_ino == w->ino) {
+        close(fd);
+        return WATCH_NONE;
+    }
+
+    // edits not yet saved aren't thrown away, the change just being noted as seen
+    if (digest_dirty(b)) {
+        close(fd);
+        watch_saved(b);
+        return WATCH_CONFLICT;
+    }
+
+    // the same file, longer, and ending as it did is one that had lines added
+    bool newline;
+    bool appended = (int64_t)st.st_ino == w->ino && w->size >= 0 && st.st_size > w->size
+            && watch_tail(fd, w->size, &newline) == w->tail;
+    if (appended) {
+        int had = b->len;
+        appended = watch_append(b, fd, w->size, st.st_size);
+        *lines = b->len - had + (w->size == 0 || !w->newline);
+    }
+    close(fd);
+
+    if (appended) {
+        digest_save(b);
+        journal_saved(b);
+        b->dirty = false;
+        watch_saved(b);
+        if (b->diff != NULL) {
+            diff_start(b);
+        }
+        return WATCH_APPENDED;
+    }
+
+    *lines = diff_reload(b);
+    if (*lines == -1) {
+        *lines = 0;
+        return WATCH_GONE;
+    }
+    return WATCH_RELOADED;
+}
@@ -0,0 +1,358 @@
+/*
+ * words.c
+ * Counting words line by line in a hash table, and finding them by prefix for completion
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <core/words.h>
+#include <core/hash.h>
+#include <core/mem.h>
+
+/* whether a byte can be part of a word */
+static bool words_char(char c) {
+    unsigned char u = c;
+    return isalnum(u) || u == '_' || u >= 0x80;
+}
+
+int words_start(line *l, int x) {
+    int start = x;
+    while (start > 0 && words_char(l->s[start - 1])) {
+        start--;
+    }
+    return start < x && !isdigit((unsigned char)l->s[start]) ? start : x;
+}
+
+/* find the next word of a line from *x on, its start in *start and its end in *x. single letters
+ * aren't worth completing, and runs starting with a digit are numbers */
+static bool words_next(line *l, int *x, int *start) {
+    while (*x < l->len) {
+        if (!words_char(l->s[*x])) {
+            (*x)++;
+            continue;
+        }
+        *start = *x;
+        while (*x < l->len && words_char(l->s[*x])) {
+            (*x)++;
+        }
+        if (*x - *start > 1 && !isdigit((unsigned char)l->s[*start])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* put word id in the hash table */
+static void words_slot(words *w, int id) {
+    uint32_t slot = w->words[id]->hash & w->mask;
+    while (w->slots[slot] != -1) {
+        slot = (slot + 1) & w->mask;
+    }
+    w->slots[slot] = id;
+}
+
+/* make a hash table of size slots for the words */
+static void words_hash(words *w, int size) {
+    mem_free(MEM_BUFFER, w->slots);
+    w->slots = mem_alloc(MEM_BUFFER, sizeof(int) * size);
+    memset(w->slots, -1, sizeof(int) * size);
+    w->mask = size - 1;
+    for (int id = 0; id < w->nwords; id++) {
+        words_slot(w, id);
+    }
+}
+
+/* the id of the len bytes at s, added as a word there are none of if it is new */
+static int words_id(words *w, const char *s, int len) {
+    uint64_t hash = hash_bytes(HASH_SEED, s, len);
+    for (uint32_t slot = hash & w->mask; w->slots[slot] != -1; slot = (slot + 1) & w->mask) {
+        word *d = w->words[w->slots[slot]];
+        if (d->hash == hash && d->len == len && memcmp(d->s, s, len) == 0) {
+            return w->slots[slot];
+        }
+    }
+
+    if (w->nwords == w->wordcap) {
+        w->wordcap = w->wordcap > 0 ? w->wordcap * 2 : 256;
+        w->words = mem_realloc(MEM_BUFFER, w->words, sizeof(word *) * w->wordcap);
+    }
+    word *d = mem_alloc(MEM_BUFFER, sizeof(word) + len);
+    d->hash = hash;
+    d->count = 0;
+    d->len = len;
+    memcpy(d->s, s, len);
+
+    int id = w->nwords++;
+    w->words[id] = d;
+    w->dead++;
+
+    // kept at most half full
+    if (w->nwords * 2 > w->mask + 1) {
+        words_hash(w, (w->mask + 1) * 2);
+    } else {
+        words_slot(w, id);
+    }
+    return id;
+}
+
+/* add n to how many of a word there are */
+static void words_count(words *w, int id, int n) {
+    word *d = w->words[id];
+    w->dead -= d->count == 0;
+    d->count += n;
+    w->dead += d->count == 0;
+}
+
+/* split line y into words, counting them in place of those it held */
+static void words_line(words *w, buffer *b, int y) {
+    line *l = bline(b, y);
+    wordline *wl = &w->lines[y];
+
+    int n = 0;
+    for (int x = 0, start; words_next(l, &x, &start);) {
+        n++;
+    }
+    int *ids = n > 0 ? mem_alloc(MEM_BUFFER, sizeof(int) * n) : NULL;
+    n = 0;
+    for (int x = 0, start; words_next(l, &x, &start);) {
+        ids[n] = words_id(w, l->s + start, x - start);
+        words_count(w, ids[n++], 1);
+    }
+
+    for (int i = 0; i < wl->n; i++) {
+        words_count(w, wl->ids[i], -1);
+    }
+    mem_free(MEM_BUFFER, wl->ids);
+    wl->ids = ids;
+    wl->n = n;
+}
+
+/* forget the words of line y */
+static void words_drop(words *w, int y) {
+    wordline *wl = &w->lines[y];
+    for (int i = 0; i < wl->n; i++) {
+        words_count(w, wl->ids[i], -1);
+    }
+    mem_free(MEM_BUFFER, wl->ids);
+}
+
+/* make room for len lines */
+static void words_grow(words *w, int len) {
+    if (len <= w->cap) {
+        return;
+    }
+
+    int cap = w->cap > 0 ? w->cap : 256;
+    while (cap < len) {
+        cap *= 2;
+    }
+    w->lines = mem_realloc(MEM_BUFFER, w->lines, sizeof(wordline) * cap);
+    w->cap = cap;
+}
+
+/* keep the lines in step with the buffer, the words of those removed going with them */
+static void words_observe(buffer *b, int y, int n, void *data) {
+    words *w = data;
+    (void)b;
+
+    n = bstale_note(&w->stale, y, n, w->len);
+    if (n > 0) {
+        words_grow(w, w->len + n);
+        memmove(&w->lines[y + n], &w->lines[y], sizeof(wordline) * (w->len - y));
+        for (int i = y; i < y + n; i++) {
+            w->lines[i].ids = NULL;
+            w->lines[i].n = 0;
+        }
+    } else if (n < 0) {
+        for (int i = y; i < y - n; i++) {
+            words_drop(w, i);
+        }
+        memmove(&w->lines[y], &w->lines[y - n], sizeof(wordline) * (w->len - y + n));
+    }
+    w->len += n;
+}
+
+void words_end(buffer *b) {
+    words *w = b->words;
+    if (w == NULL) {
+        return;
+    }
+
+    bunobserve(b, words_observe, w);
+    for (int y = 0; y < w->len; y++) {
+        mem_free(MEM_BUFFER, w->lines[y].ids);
+    }
+    for (int id = 0; id < w->nwords; id++) {
+        mem_free(MEM_BUFFER, w->words[id]);
+    }
+    mem_free(MEM_BUFFER, w->lines);
+    mem_free(MEM_BUFFER, w->words);
+    mem_free(MEM_BUFFER, w->slots);
+    mem_free(MEM_BUFFER, w->sorted);
+    bstale_free(&w->stale);
+    mem_free(MEM_BUFFER, w);
+    b->words = NULL;
+}
+
+/* drop the words there are none of, the rest taking new ids in the same order */
+static void words_compact(words *w) {
+    int *ids = mem_alloc(MEM_BUFFER, sizeof(int) * w->nwords);
+
+    // the sorted words are still those with the first ids
+    int sorted = 0;
+    for (int i = 0; i < w->nsorted; i++) {
+        if (w->sorted[i]->count > 0) {
+            w->sorted[sorted++] = w->sorted[i];
+        }
+    }
+    w->nsorted = sorted;
+
+    int kept = 0;
+    for (int id = 0; id < w->nwords; id++) {
+        if (w->words[id]->count > 0) {
+            ids[id] = kept;
+            w->words[kept++] = w->words[id];
+        } else {
+            mem_free(MEM_BUFFER, w->words[id]);
+        }
+    }
+    w->nwords = kept;
+    w->dead = 0;
+
+    for (int y = 0; y < w->len; y++) {
+        wordline *wl = &w->lines[y];
+        for (int i = 0; i < wl->n; i++) {
+            wl->ids[i] = ids[wl->ids[i]];
+        }
+    }
+    mem_free(MEM_BUFFER, ids);
+
+    int size = 256;
+    while (size < w->nwords * 2) {
+        size *= 2;
+    }
+    words_hash(w, size);
+}
+
+/* how word d compares with the len bytes of s */
+static int words_cmp(const word *d, const char *s, int len) {
+    int c = memcmp(d->s, s, d->len < len ? d->len : len);
+    return c != 0 ? c : d->len - len;
+}
+
+static int words_order(const void *a, const void *b) {
+    const word *d = *(word * const *)a, *e = *(word * const *)b;
+    return words_cmp(d, e->s, e->len);
+}
+
+/* sort the words added since in with the rest */
+static void words_sort(words *w) {
+    int fresh = w->nwords - w->nsorted;
+    word **add = mem_alloc(MEM_BUFFER, sizeof(word *) * fresh);
+    memcpy(add, &w->words[w->nsorted], sizeof(word *) * fresh);
+    qsort(add, fresh, sizeof(word *), words_order);
+
+    word **sorted = mem_alloc(MEM_BUFFER, sizeof(word *) * w->nwords);
+    int i = 0, j = 0, k = 0;
+    while (i < w->nsorted || j < fresh) {
+        if (j == fresh || (i < w->nsorted && words_order(&w->sorted[i], &add[j]) < 0)) {
+            sorted[k++] = w->sorted[i++];
+        } else {
+            sorted[k++] = add[j++];
+        }
+    }
+
+    mem_free(MEM_BUFFER, add);
+    mem_free(MEM_BUFFER, w->sorted);
+    w->sorted = sorted;
+    w->nsorted = w->nwords;
+}
+
+/* bring the words up to date with the buffer, starting on them if this is the first time. viewed
+ * files have none */
+static words *words_sync(buffer *b) {
+    if (b->index != NULL) {
+        return NULL;
+    }
+
+    if (b->words == NULL) {
+        b->words = mem_calloc(MEM_BUFFER, 1, sizeof(words));
+        words_hash(b->words, 256);
+        bobserve(b, words_observe, b->words);
+    }
+    words *w = b->words;
+
+    // anything else that shrank the buffer went unseen
+    while (w->len > b->len) {
+        words_drop(w, --w->len);
+    }
+
+    for (int i = 0; i < w->stale.n; i++) {
+        if (w->stale.lines[i] < w->len) {
+            words_line(w, b, w->stale.lines[i]);
+        }
+    }
+    w->stale.n = 0;
+
+    if (w->len < b->len) {
+        words_grow(w, b->len);
+        for (int y = w->len; y < b->len; y++) {
+            w->lines[y].ids = NULL;
+            w->lines[y].n = 0;
+            words_line(w, b, y);
+        }
+        w->len = b->len;
+    }
+
+    // words edited away are kept until they are most of them, as they are often typed again
+    if (w->dead > w->nwords / 2) {
+        words_compact(w);
+    }
+    if (w->nsorted < w->nwords) {
+        words_sort(w);
+    }
+    return w;
+}
+
+int words_complete(buffer *b, const char *prefix, int len, const word **out, int max) {
+    words *w = words_sync(b);
+    if (w == NULL) {
+        return 0;
+    }
+
+    // the first word not before the prefix, those after it starting with it being the ones wanted
+    int lo = 0, hi = w->nsorted;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (words_cmp(w->sorted[mid], prefix, len) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    int found = 0;
+    for (int i = lo; i < w->nsorted && w->sorted[i]->len >= len && memcmp(w->sorted[i]->s, prefix, len) == 0; i++) {
+        const word *d = w->sorted[i];
+        if (d->count == 0 || d->len == len) {
+            continue;
+        }
+
+        // the most common so far in out, a word only going ahead of those there are fewer of
+        int shown = found < max ? found : max;
+        int at = shown;
+        while (at > 0 && out[at - 1]->count < d->count) {
+            at--;
+        }
+        if (at < max) {
+            int moved = (shown < max ? shown : max - 1) - at;
+            memmove(&out[at + 1], &out[at], sizeof(word *) * moved);
+            out[at] = d;
+        }
+        found++;
+    }
+    return found;
+}
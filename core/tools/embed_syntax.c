@@ -0,0 +1,50 @@
+/*
+ * embed_syntax.c
+ * Build time tool compiling the bundled rule files into C source for core_lib
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <core/rules.h>
+#include <core/mem.h>
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <syntax dir> <output.c>\n", argv[0]);
+        return 1;
+    }
+
+    size_t size;
+    char *blob = rules_build(argv[1], &size);
+    if (blob == NULL) {
+        fprintf(stderr, "embed_syntax: can't read %s\n", argv[1]);
+        return 1;
+    }
+
+    // built in rules are never checked against their sources, leave out the times so builds are reproducible
+    rules_header *h = (rules_header *)blob;
+    rules_source *sources = (rules_source *)(blob + h->sources);
+    h->mtime = 0;
+    for (uint32_t i = 0; i < h->nsources; i++) {
+        sources[i].mtime = 0;
+    }
+
+    FILE *out = fopen(argv[2], "w");
+    if (out == NULL) {
+        fprintf(stderr, "embed_syntax: can't write %s\n", argv[2]);
+        return 1;
+    }
+
+    fprintf(out, "/* generated from %s by embed_syntax, do not edit */\n\n", argv[1]);
+    fprintf(out, "#include <core/rules.h>\n\n");
+    fprintf(out, "_Alignas(8) const char rules_builtin[] = {");
+    for (size_t i = 0; i < size; i++) {
+        fprintf(out, "%s0x%02x,", i % 16 == 0 ? "\n    " : " ", (unsigned char)blob[i]);
+    }
+    fprintf(out, "\n};\n\nconst size_t rules_builtin_size = sizeof(rules_builtin);\n");
+
+    mem_free(MEM_SYNTAX, blob);
+    return fclose(out) == 0 ? 0 : 1;
+}
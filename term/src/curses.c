@@ -0,0 +1,247 @@
+/*
+ * curses.c
+ * Display backend drawing to the terminal through ncurses
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#include <ncurses.h>
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include <core/utf8.h>
+
+#include "display.h"
+
+struct window {
+    WINDOW *win;
+};
+
+/* the timeout currently set in ncurses, so it is only changed when needed */
+static int curses_timeout = -1;
+
+/*
+ * ncurses writes straight to the terminal's descriptor, bypassing stdio, so
+ * output is counted from the kernel's tally of bytes this process has written
+ * (taken around each doupdate, when nothing else is writing).
+ */
+static int curses_io = -1;
+static long curses_sent = 0;
+
+static long curses_written() {
+    char text[512];
+    ssize_t len;
+
+    if (curses_io == -1 || (len = pread(curses_io, text, sizeof(text) - 1, 0)) <= 0) {
+        return 0;
+    }
+    text[len] = '\0';
+
+    char *wchar = strstr(text, "wchar:");
+    return wchar != NULL ? atol(wchar + 6) : 0;
+}
+
+static void curses_init() {
+    // text is handed over as UTF-8, which the wide character ncurses draws as long as the locale says so
+    setlocale(LC_ALL, "");
+
+    // set up ncurses and enable raw mode so we can get those sweet, sweet keycodes
+    initscr();
+    raw();
+    noecho();
+    nonl();
+    keypad(stdscr, TRUE);
+    define_key("\b", 8);
+    set_tabsize(TABSTOP);
+
+    // setup colors
+    start_color();
+    init_pair(1, COLOR_GREEN, COLOR_BLACK);
+    init_pair(2, COLOR_BLUE, COLOR_BLACK);
+    init_pair(3, COLOR_MAGENTA, COLOR_BLACK);
+    init_pair(4, COLOR_CYAN, COLOR_BLACK);
+
+    curses_io = open("/proc/self/io", O_RDONLY | O_CLOEXEC);
+}
+
+static void curses_end() {
+    endwin();
+    if (curses_io != -1) {
+        close(curses_io);
+        curses_io = -1;
+    }
+}
+
+static void curses_size(int *rows, int *cols) {
+    getmaxyx(stdscr, *rows, *cols);
+}
+
+static window *curses_newwin(int rows, int cols, int y, int x) {
+    window *w = malloc(sizeof(window));
+    w->win = newwin(rows, cols, y, x);
+    return w;
+}
+
+static void curses_delwin(window *w) {
+    delwin(w->win);
+    free(w);
+}
+
+static void curses_place(window *w, int rows, int cols, int y, int x) {
+    wresize(w->win, rows, cols);
+    mvwin(w->win, y, x);
+}
+
+static void curses_erase(window *w) {
+    werase(w->win);
+}
+
+static void curses_inverse(window *w) {
+    wbkgd(w->win, A_STANDOUT);
+}
+
+static void curses_clrtoeol(window *w) {
+    wclrtoeol(w->win);
+}
+
+static void curses_move(window *w, int y, int x) {
+    wmove(w->win, y, x);
+}
+
+static void curses_put(window *w, const char *s, int len) {
+    waddnstr(w->win, s, len);
+}
+
+static void curses_attr(window *w, enum attr_type type, bool enabled) {
+    int curses_attr;
+
+    switch (type) {
+        case COLOR1:
+            curses_attr = COLOR_PAIR(1);
+            break;
+
+        case COLOR2:
+            curses_attr = COLOR_PAIR(2);
+            break;
+
+        case COLOR3:
+            curses_attr = COLOR_PAIR(3);
+            break;
+
+        case COLOR4:
+            curses_attr = COLOR_PAIR(4);
+            break;
+
+        case HIGHLIGHT:
+            curses_attr = A_STANDOUT;
+            break;
+
+        default:
+            curses_attr = A_NORMAL;
+            break;
+    }
+
+    if (enabled) {
+        wattron(w->win, curses_attr);
+    } else {
+        wattroff(w->win, curses_attr);
+    }
+}
+
+static void curses_attrclear(window *w) {
+    wattrset(w->win, A_NORMAL);
+}
+
+static void curses_show(window *w) {
+    // windows overlap (the message bar sits on the status bar), so always copy the whole thing
+    touchwin(w->win);
+    wnoutrefresh(w->win);
+}
+
+static void curses_flush(window *cursor) {
+    wnoutrefresh(cursor->win);
+
+    long before = curses_written();
+    doupdate();
+    curses_sent += curses_written() - before;
+}
+
+static int curses_getkey(int timeout_ms) {
+    if (timeout_ms != curses_timeout) {
+        timeout(timeout_ms);
+        curses_timeout = timeout_ms;
+    }
+
+    int c = getch();
+    switch (c) {
+        case ERR:
+            return K_NONE;
+        case KEY_UP:
+            return K_UP;
+        case KEY_DOWN:
+            return K_DOWN;
+        case KEY_LEFT:
+            return K_LEFT;
+        case KEY_RIGHT:
+            return K_RIGHT;
+        case KEY_PPAGE:
+            return K_PPAGE;
+        case KEY_NPAGE:
+            return K_NPAGE;
+        case KEY_HOME:
+            return K_HOME;
+        case KEY_END:
+            return K_END;
+        case KEY_BACKSPACE:
+            return K_BACKSPACE;
+        case KEY_ENTER:
+            return 13;
+        case KEY_RESIZE:
+            // clear whatever the old layout left behind before the windows are repainted
+            erase();
+            wnoutrefresh(stdscr);
+            return K_RESIZE;
+        default:
+            // drop other function keys rather than letting them alias characters
+            return c > 255 ? K_NONE : c;
+    }
+}
+
+static void curses_resized() {
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1 || ws.ws_row == 0 || ws.ws_col == 0) {
+        return;
+    }
+    resizeterm(ws.ws_row, ws.ws_col);
+    erase();
+    wnoutrefresh(stdscr);
+}
+
+static long curses_sent_bytes() {
+    return curses_sent;
+}
+
+const display curses_display = {
+    "curses",
+    curses_init,
+    curses_end,
+    curses_size,
+    curses_newwin,
+    curses_delwin,
+    curses_place,
+    curses_erase,
+    curses_inverse,
+    curses_clrtoeol,
+    curses_move,
+    curses_put,
+    curses_attr,
+    curses_attrclear,
+    curses_show,
+    curses_flush,
+    curses_getkey,
+    curses_resized,
+    curses_sent_bytes
+};
@@ -0,0 +1,87 @@
+/*
+ * display.h
+ * Drawing and keyboard backends for the terminal front end
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include <core/attribute.h>
+
+/* keys that aren't plain characters, numbered past the byte range so traces don't depend on the backend */
+enum key {
+    K_EOF = -2,
+    K_NONE = -1,
+    K_UP = 0x200,
+    K_DOWN,
+    K_LEFT,
+    K_RIGHT,
+    K_PPAGE,
+    K_NPAGE,
+    K_HOME,
+    K_END,
+    K_BACKSPACE,
+    K_RESIZE
+};
+
+/* a rectangle of the screen, owned by the backend */
+typedef struct window window;
+
+/* the operations the front end draws and reads keys with */
+typedef struct display {
+    const char *name;
+
+    /* take over and release the terminal */
+    void (*init)(void);
+    void (*end)(void);
+
+    /* current size of the whole screen */
+    void (*size)(int *rows, int *cols);
+
+    /* create, destroy and reposition windows */
+    window *(*newwin)(int rows, int cols, int y, int x);
+    void (*delwin)(window *w);
+    void (*place)(window *w, int rows, int cols, int y, int x);
+
+    /* blank a window, or mark the whole of it as reversed (used for the message bar) */
+    void (*erase)(window *w);
+    void (*inverse)(window *w);
+
+    /* blank the rest of the cursor's row, for redrawing single rows */
+    void (*clrtoeol)(window *w);
+
+    /* write text at the cursor with the current attribute, clipped to the window */
+    void (*move)(window *w, int y, int x);
+    void (*put)(window *w, const char *s, int len);
+    void (*attr)(window *w, enum attr_type type, bool enabled);
+    void (*attrclear)(window *w);
+
+    /* queue a window for the next flush, then paint everything queued and leave the cursor in w */
+    void (*show)(window *w);
+    void (*flush)(window *cursor);
+
+    /* wait up to timeout ms (forever if negative) for a key, K_NONE if none came */
+    int (*getkey)(int timeout);
+
+    /* take in the terminal's new size, for a front end that catches SIGWINCH itself rather than
+     * waiting for getkey to report K_RESIZE */
+    void (*resized)(void);
+
+    /* total bytes written to the terminal so far */
+    long (*sent)(void);
+} display;
+
+extern const display curses_display;
+extern const display headless_display;
+
+/* size the headless screen, before or after init */
+void headless_resize(int rows, int cols);
+
+/* print the headless screen as plain text */
+void headless_dump(FILE *out);
+
+#endif
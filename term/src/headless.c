@@ -0,0 +1,235 @@
+/*
+ * headless.c
+ * Display backend drawing into an in-memory grid of cells, for replaying traces without a terminal
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <core/utf8.h>
+
+#include "display.h"
+
+/* set on cells drawn by an inverted window */
+#define CELL_INVERSE 0x80
+
+/* a character, or 0 for the right half of a wide one */
+typedef struct cell {
+    int c;
+    unsigned char attr;
+} cell;
+
+struct window {
+    int rows, cols;
+    int y, x;
+    int cy, cx;
+    unsigned char attr;
+    bool inverse;
+    cell *cells;
+};
+
+/* the composed screen, what a terminal would be showing after the last flush */
+static struct {
+    int rows, cols;
+    int cy, cx;
+    cell *cells;
+
+    // cells that changed, standing in for the bytes a terminal would have been sent
+    long sent;
+} screen = {24, 80, 0, 0, NULL, 0};
+
+static void fill(cell *cells, int n) {
+    for (int i = 0; i < n; i++) {
+        cells[i].c = ' ';
+        cells[i].attr = NONE;
+    }
+}
+
+void headless_resize(int rows, int cols) {
+    screen.rows = rows;
+    screen.cols = cols;
+    if (screen.cells != NULL) {
+        screen.cells = realloc(screen.cells, sizeof(cell) * rows * cols);
+        fill(screen.cells, rows * cols);
+    }
+}
+
+void headless_dump(FILE *out) {
+    for (int y = 0; y < screen.rows; y++) {
+        cell *row = screen.cells + y * screen.cols;
+        int len = screen.cols;
+        while (len > 0 && row[len - 1].c == ' ') {
+            len--;
+        }
+        for (int x = 0; x < len; x++) {
+            char text[4];
+            if (row[x].c != 0) {
+                fwrite(text, 1, utf8_encode(row[x].c, text), out);
+            }
+        }
+        fputc('\n', out);
+    }
+}
+
+static void headless_init() {
+    screen.cells = malloc(sizeof(cell) * screen.rows * screen.cols);
+    fill(screen.cells, screen.rows * screen.cols);
+}
+
+static void headless_end() {
+    // keep the cells around so the final screen can still be dumped
+}
+
+static void headless_size(int *rows, int *cols) {
+    *rows = screen.rows;
+    *cols = screen.cols;
+}
+
+static window *headless_newwin(int rows, int cols, int y, int x) {
+    window *w = calloc(1, sizeof(window));
+    w->rows = rows;
+    w->cols = cols;
+    w->y = y;
+    w->x = x;
+    w->cells = malloc(sizeof(cell) * rows * cols);
+    fill(w->cells, rows * cols);
+    return w;
+}
+
+static void headless_delwin(window *w) {
+    free(w->cells);
+    free(w);
+}
+
+static void headless_place(window *w, int rows, int cols, int y, int x) {
+    w->rows = rows;
+    w->cols = cols;
+    w->y = y;
+    w->x = x;
+    w->cy = w->cx = 0;
+    w->cells = realloc(w->cells, sizeof(cell) * rows * cols);
+    fill(w->cells, rows * cols);
+}
+
+static void headless_erase(window *w) {
+    fill(w->cells, w->rows * w->cols);
+    w->cy = w->cx = 0;
+}
+
+static void headless_inverse(window *w) {
+    w->inverse = true;
+}
+
+static void headless_clrtoeol(window *w) {
+    if (w->cy >= 0 && w->cy < w->rows && w->cx >= 0 && w->cx < w->cols) {
+        fill(w->cells + w->cy * w->cols + w->cx, w->cols - w->cx);
+    }
+}
+
+static void headless_move(window *w, int y, int x) {
+    w->cy = y;
+    w->cx = x;
+}
+
+/* store one cell at the cursor and advance it, dropping anything past the right edge */
+static void headless_addch(window *w, int c) {
+    if (w->cy >= 0 && w->cy < w->rows && w->cx >= 0 && w->cx < w->cols) {
+        cell *at = w->cells + w->cy * w->cols + w->cx;
+        at->c = c;
+        at->attr = w->attr;
+    }
+    w->cx++;
+}
+
+static void headless_put(window *w, const char *s, int len) {
+    // expand tabs and control characters the same way curses does. a cell holds one character, so
+    // combining marks are left out
+    for (int i = 0; i < len;) {
+        int c;
+        i += utf8_decode(&s[i], len - i, &c);
+
+        if (c == '\t') {
+            do {
+                headless_addch(w, ' ');
+            } while (w->cx % TABSTOP != 0);
+        } else if (c < 32 || c == 127) {
+            headless_addch(w, '^');
+            headless_addch(w, c == 127 ? '?' : c + 64);
+        } else if (utf8_width(c, w->cx) == 2) {
+            headless_addch(w, c);
+            headless_addch(w, 0);
+        } else if (utf8_width(c, w->cx) == 1) {
+            headless_addch(w, c);
+        }
+    }
+}
+
+static void headless_attr(window *w, enum attr_type type, bool enabled) {
+    if (enabled) {
+        w->attr = type;
+    } else if (w->attr == type) {
+        w->attr = NONE;
+    }
+}
+
+static void headless_attrclear(window *w) {
+    w->attr = NONE;
+}
+
+static void headless_show(window *w) {
+    for (int y = 0; y < w->rows && y + w->y < screen.rows; y++) {
+        for (int x = 0; x < w->cols && x + w->x < screen.cols; x++) {
+            cell c = w->cells[y * w->cols + x];
+            if (w->inverse) {
+                c.attr |= CELL_INVERSE;
+            }
+            cell *at = screen.cells + (y + w->y) * screen.cols + x + w->x;
+            if (at->c != c.c || at->attr != c.attr) {
+                *at = c;
+                screen.sent++;
+            }
+        }
+    }
+}
+
+static void headless_flush(window *cursor) {
+    headless_show(cursor);
+    screen.cy = cursor->y + cursor->cy;
+    screen.cx = cursor->x + cursor->cx;
+}
+
+static int headless_getkey(int timeout) {
+    // there is no keyboard, keys only come from a trace
+    return K_EOF;
+}
+
+static void headless_resized() {
+    // the size only changes through headless_resize
+}
+
+static long headless_sent() {
+    return screen.sent;
+}
+
+const display headless_display = {
+    "headless",
+    headless_init,
+    headless_end,
+    headless_size,
+    headless_newwin,
+    headless_delwin,
+    headless_place,
+    headless_erase,
+    headless_inverse,
+    headless_clrtoeol,
+    headless_move,
+    headless_put,
+    headless_attr,
+    headless_attrclear,
+    headless_show,
+    headless_flush,
+    headless_getkey,
+    headless_resized,
+    headless_sent
+};
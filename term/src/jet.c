@@ -8,84 +8,245 @@
 #define VERSION_MINOR 0
 #define VERSION_PATCH 0
 
-#include <ncurses.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdarg.h>
 #include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/signalfd.h>
 
 #include <core/jet.h>
 
-#define TABSTOP 4
+#include "display.h"
+#include "loop.h"
+#include "stats.h"
+#include "trace.h"
+#include "view.h"
+
+/* the least time (ms) between frames, about as often as most displays refresh */
+#define FRAME_MS 16
+
+/* how many lines past the bottom of its views a buffer is highlighted ahead while nothing happens,
+ * a step of them at a time, stopping at a line longer than HIGHLIGHT_LONG bytes (which is left for
+ * when it is scrolled to) */
+#define HIGHLIGHT_AHEAD 10000
+#define HIGHLIGHT_STEP 64
+#define HIGHLIGHT_LONG 65536
+
+/* how many words Ctrl-N offers at most */
+#define COMPLETE_MAX 16
 
 #define KEY_CTRL(c) ((c)-96)
 
 struct screen_state {
-    WINDOW *bufferwin;
-    WINDOW *statusbar;
-    WINDOW *messagebox;
-    WINDOW *linenumbers;
-    buffer *b;
+    const display *d;
+    window *messagebox;
     int maxy, maxx;
-    int y, x;
+
+    // every open buffer, each remembering where it was last left
+    buffer **bufs;
+    int nbufs;
+
+    // the views the screen is split into, and the one with focus and its buffer
+    split *layout;
+    view *v;
+    buffer *b;
+
+    // the signalfd SIGWINCH comes on, -1 while the size only comes from getkey as K_RESIZE
+    int winch;
+
+    // whether anything changed since the screen was last drawn, and when that was
+    bool redraw;
+    double frame_at;
+
+    // keys pressed while a filter ran, acted on once it is done, and whether a replay has read all
+    // the keys recorded while the filter ran
+    int pending[64];
+    int npending;
+    bool filtered;
+
+    // keys are written to record and/or read from replay when tracing
+    trace *record;
+    trace *replay;
+    bool dump;
+
+    // timing overlay in the status bar, and where to write the histograms on exit
+    bool overlay;
+    const char *stats;
+
+    // lines highlighted, rows drawn and bytes sent to the terminal by the last update
+    int highlighted, drawn;
+    long sent, frame_sent;
+
+    // what became of a journal found loading a file, told once the screen is up
+    char notice[256];
 };
 struct screen_state s;
 
 void screen_shutdown() {
-    delwin(s.bufferwin);
-    delwin(s.statusbar);
-    delwin(s.messagebox);
-    delwin(s.linenumbers);
-    endwin();
-    syntax_end();
+    delsplit(s.d, s.layout);
+    s.layout = NULL;
+    if (s.messagebox != NULL) {
+        s.d->delwin(s.messagebox);
+    }
+    s.d->end();
     syntax_clearfiles();
+
+    if (s.record != NULL) {
+        trace_close(s.record);
+    }
+    if (s.stats != NULL) {
+        FILE *f = fopen(s.stats, "w");
+        if (f != NULL) {
+            stats_dump(f);
+            fclose(f);
+        }
+    }
+    if (s.replay != NULL) {
+        trace_report(s.replay, stdout);
+        trace_close(s.replay);
+        if (s.dump) {
+            headless_dump(stdout);
+        }
+    }
 }
 
 void die(const char *error, int code) {
+    // whatever was typed since the journals were last written isn't lost
+    for (int i = 0; i < s.nbufs; i++) {
+        journal_flush(s.bufs[i], true);
+    }
     screen_shutdown();
     printf("Error: %s\n", error);
     exit(code);
 }
 
-void screen_pause() {
-    def_prog_mode();
-    endwin();
+/* print formatted text into a window at the given position */
+void screen_print(window *w, int y, int x, const char *format, ...) {
+    char text[1024];
+    va_list args;
+
+    va_start(args, format);
+    int len = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+
+    s.d->move(w, y, x);
+    s.d->put(w, text, len < (int)sizeof(text) ? len : (int)sizeof(text) - 1);
 }
 
-void screen_resume() {
-    reset_prog_mode();
-    refresh();
+void screen_resize();
+
+/* take in the screen's new size if SIGWINCH came, true if it did */
+bool screen_winched() {
+    struct signalfd_siginfo si;
+    bool winched = false;
+    while (s.winch != -1 && read(s.winch, &si, sizeof(si)) == sizeof(si)) {
+        winched = true;
+    }
+    if (winched) {
+        s.d->resized();
+    }
+    return winched;
 }
 
-/* display a message */
-void screen_message(const char *message) {
-    if (s.messagebox != NULL) {
-        delwin(s.messagebox);
+/* read the next key, from the replayed trace if there is one, waiting for it if told to (K_NONE if
+ * not and none has come). the screen changing size comes as K_RESIZE */
+int screen_readkey(bool wait) {
+    int rows, cols;
+    int c;
+
+    // keys kept while a filter ran were recorded when they were read
+    bool queued = s.npending > 0;
+    if (queued) {
+        c = s.pending[0];
+        memmove(s.pending, s.pending + 1, sizeof(int) * --s.npending);
+    } else if (s.replay != NULL) {
+        c = trace_next(s.replay, &rows, &cols);
+        if (c == K_RESIZE) {
+            headless_resize(rows, cols);
+        }
+    } else {
+        c = s.d->getkey(0);
+        if (c == K_NONE && wait) {
+            struct pollfd fds[] = {{STDIN_FILENO, POLLIN, 0}, {s.winch, POLLIN, 0}};
+            poll(fds, s.winch != -1 ? 2 : 1, -1);
+            c = screen_winched() ? K_RESIZE : s.d->getkey(0);
+        }
+    }
+
+    if (c == K_RESIZE) {
+        screen_resize();
+    }
+
+    if (s.record != NULL && !queued && c != K_NONE && c != K_EOF) {
+        trace_record(s.record, c, s.maxy, s.maxx);
     }
-    s.messagebox = newwin(1, s.maxx, s.maxy - 1, 0);
-    wbkgd(s.messagebox, A_STANDOUT);
+    return c;
+}
 
-    mvwprintw(s.messagebox, 0, 0, "%s%*s", message, s.maxx - strlen(message), "Ctrl-X to dismiss");
-    wrefresh(s.messagebox);    wbkgd(s.messagebox, A_STANDOUT);
+/* wait for the next key, for commands that read more than one. only the screen changing size is
+ * seen to meanwhile, everything else waiting for the loop */
+int screen_getkey() {
+    return screen_readkey(true);
 }
 
-/* ask for a line of text from the user with the given prompt string */
-void screen_read_message(char *readto, const char *prompt) {
+/* replace the message box with a new, empty one */
+void screen_new_message() {
     if (s.messagebox != NULL) {
-        delwin(s.messagebox);
-
+        s.d->delwin(s.messagebox);
     }
-    s.messagebox = newwin(1, s.maxx, s.maxy - 1, 0);
-    wbkgd(s.messagebox, A_STANDOUT);
+    s.messagebox = s.d->newwin(1, s.maxx, s.maxy - 1, 0);
+    s.d->inverse(s.messagebox);
+}
+
+/* display a message */
+void screen_message(const char *message) {
+    screen_new_message();
+
+    screen_print(s.messagebox, 0, 0, "%s%*s", message, (int)(s.maxx - strlen(message)), "Ctrl-X to dismiss");
+    s.d->show(s.messagebox);
+}
+
+/* ask for a line of text (at most size - 1 characters) from the user with the given prompt string */
+void screen_read_message(char *readto, int size, const char *prompt) {
+    int len = 0;
+    readto[0] = '\0';
+
+    screen_new_message();
+
+    while (true) {
+        s.d->erase(s.messagebox);
+        screen_print(s.messagebox, 0, 0, "%s%s", prompt, readto);
+        s.d->flush(s.messagebox);
 
-    mvwprintw(s.messagebox, 0, 0, "%s", prompt);
-    wrefresh(s.messagebox);
+        int c = screen_getkey();
+        if (c == 13 || c == '\n' || c == K_EOF) {
+            break;
+        }
 
-    echo();
-    wgetstr(s.messagebox, readto);
+        if (c == K_RESIZE) {
+            screen_new_message();
+        } else if (c == K_BACKSPACE || c == 127 || c == 8) {
+            // a whole character, not just its last byte
+            if (len > 0) {
+                do {
+                    len--;
+                } while (len > 0 && (readto[len] & 0xc0) == 0x80);
+                readto[len] = '\0';
+            }
+        } else if (c >= 32 && c <= 255 && len < size - 1) {
+            readto[len++] = c;
+            readto[len] = '\0';
+        }
+    }
 
-    noecho();
-    //wrefresh(s.bufferwin);
-    delwin(s.messagebox);
+    s.d->delwin(s.messagebox);
     s.messagebox = NULL;
 }
 
@@ -95,20 +256,21 @@ void screen_getfilename() {
     int isnull = s.b->name == NULL;
     sprintf(prompt, "Filename to write%s%s%s: ", isnull ? "" : "(", isnull ? "" : s.b->name, isnull ? "" : ")");
 
-    screen_read_message(newname, prompt);
+    screen_read_message(newname, sizeof(newname), prompt);
 
     if (strlen(newname) > 0) {
         bname(s.b, newname);
     }
 }
 
-bool screen_confirmquit() {
+/* ask a yes or no question, no being the answer unless y is given */
+bool screen_confirm(const char *prompt) {
     char response[80];
     int len;
     bool invalid;
 
     do {
-        screen_read_message(response, "File has not been saved! Really quit? (y/N): ");
+        screen_read_message(response, sizeof(response), prompt);
         len = strlen(response);
 
         invalid = false;
@@ -134,204 +296,921 @@ bool screen_confirmquit() {
     return false;
 }
 
+bool screen_confirmquit() {
+    return screen_confirm(s.nbufs > 1 ? "File has not been saved! Really close? (y/N): "
+            : "File has not been saved! Really quit? (y/N): ");
+}
+
+/* load a buffer, streaming it in if the name refers to a pipe or a device */
+buffer *screen_load(const char *filename) {
+    struct stat st;
+    int fd = -1;
+
+    if (stat(filename, &st) == 0 && !S_ISREG(st.st_mode) && !S_ISDIR(st.st_mode)) {
+        fd = open(filename, O_RDONLY | O_NONBLOCK);
+    }
+
+    if (fd == -1) {
+        double start = stats_clock();
+        buffer *b = readbuf(filename);
+        stats_add(STAT_READ, stats_clock() - start);
+        return b;
+    }
+
+    // input keeps arriving, read as the loop finds it (see screen_listen)
+    return openstream(fd);
+}
+
+/* tell what became of a journal found loading a file */
+void screen_notice() {
+    if (s.notice[0] != '\0') {
+        screen_message(s.notice);
+        s.notice[0] = '\0';
+    }
+}
+
+/* pull in any input that has arrived on streamed buffers, shown or not, for replays (which don't
+ * wait in the loop) */
+void screen_poll() {
+    for (int i = 0; i < s.nbufs; i++) {
+        readstream(s.bufs[i]);
+    }
+}
+
+/* read what has arrived on a streamed buffer, the loop letting go of it once it ends */
+void screen_stream(int events, void *data) {
+    buffer *b = data;
+    int fd = b->fd;
+    readstream(b);
+    if (b->fd != fd) {
+        loop_remove(fd);
+    }
+    s.redraw = true;
+}
+
+/* take in changes something else made to the files of the buffers */
+void screen_watch(int events, void *data) {
+    watch_events(s.bufs, s.nbufs);
+
+    for (int i = 0; i < s.nbufs; i++) {
+        buffer *b = s.bufs[i];
+        bool end = b->y == b->len - 1;
+        int lines;
+        switch (watch_update(b, &lines)) {
+            case WATCH_APPENDED:
+                // a cursor on the last line follows the lines added, like tail -f
+                if (end) {
+                    bmoveto(b, b->len - 1, 0);
+                }
+                break;
+            case WATCH_RELOADED:
+                // written again just as it was
+                if (lines == 0) {
+                    break;
+                }
+                snprintf(s.notice, sizeof(s.notice), "%s changed on disk, %d line%s reloaded.", b->name, lines, lines == 1 ? "" : "s");
+                break;
+            case WATCH_CONFLICT:
+                snprintf(s.notice, sizeof(s.notice), "%s changed on disk! Ctrl-R reloads it, losing unsaved edits.", b->name);
+                break;
+            case WATCH_GONE:
+                snprintf(s.notice, sizeof(s.notice), "%s was removed from disk.", b->name);
+                break;
+            case WATCH_NONE:
+                break;
+        }
+    }
+    screen_notice();
+    s.redraw = true;
+}
+
+/* write the edits due to the journals, having the loop come back in time for the next of them */
+void screen_journal(int events, void *data) {
+    int next = -1;
+    for (int i = 0; i < s.nbufs; i++) {
+        int due = journal_flush(s.bufs[i], false);
+        if (due == JOURNAL_FAILED) {
+            snprintf(s.notice, sizeof(s.notice), "Failed to write the journal of %s, later edits aren't kept until it's saved.", s.bufs[i]->name);
+            screen_notice();
+            s.redraw = true;
+        } else if (due != -1 && (next == -1 || due < next)) {
+            next = due;
+        }
+    }
+    loop_after(next, screen_journal, NULL);
+}
+
+/* save a buffer to its file. replays leave the file alone, the write going to /dev/null instead
+ * (so it's still timed) and the buffer being taken as saved */
+int screen_write(buffer *b) {
+    if (s.replay == NULL) {
+        return writebuf(b);
+    }
+    int written = writebufto(b, "/dev/null");
+    if (written != -1) {
+        digest_save(b);
+    }
+    return written;
+}
+
+/* jump to a line number entered by the user */
+void screen_goto() {
+    char number[80];
+
+    screen_read_message(number, sizeof(number), "Go to line: ");
+
+    // a line folded away is shown rather than landing on its fold
+    int y = atoi(number);
+    if (y > 0) {
+        bensure(s.b, y);
+        fold_reveal(s.b, y - 1);
+        bmoveto(s.b, y - 1, 0);
+    }
+}
+
+/* format a byte count in a short human readable form */
+void screen_format_bytes(char *out, size_t bytes) {
+    const char *units = "BKMGT";
+    double n = bytes;
+    while (n >= 1024 && units[1] != '\0') {
+        n /= 1024;
+        units++;
+    }
+    sprintf(out, n < 10 && *units != 'B' ? "%.1f%c" : "%.0f%c", n, *units);
+}
+
+/* show how much memory each part of the core holds (current/peak and allocator calls) */
+void screen_memstats() {
+    char message[512] = "";
+    int len = 0;
+
+    for (int t = 0; t < MEM_TAGS && len < (int)sizeof(message); t++) {
+        mem_stats st = mem_stat(t);
+        char bytes[16], peak[16];
+
+        screen_format_bytes(bytes, st.bytes);
+        screen_format_bytes(peak, st.peak);
+        len += snprintf(message + len, sizeof(message) - len, "%s %s/%s (%lu)  ", mem_name(t), bytes, peak, st.calls);
+    }
+
+    // room is left for the hint to dismiss it, however wide the screen
+    int width = s.maxx > 20 ? s.maxx - 20 : 0;
+    message[width < (int)sizeof(message) - 1 ? width : (int)sizeof(message) - 1] = '\0';
+
+    screen_message(message);
+}
+
+/* check that the buffer can be changed, telling the user if it can't */
+bool screen_editable() {
+    if (!beditable(s.b)) {
+        screen_message("Buffer is read-only.");
+        return false;
+    }
+    return true;
+}
+
+/* take the cursor and scroll position back from the focused view's buffer */
+void screen_unfocus() {
+    s.v->y = s.b->y;
+    s.v->x = s.b->x;
+    s.v->sy = s.b->sy;
+    s.v->sx = s.b->sx;
+}
+
+/* give a view focus, handing its position to its buffer for editing */
+void screen_focus(view *v) {
+    s.v = v;
+    s.b = v->b;
+    bmoveto(s.b, v->y, v->x);
+    s.b->sy = v->sy;
+    s.b->sx = v->sx;
+}
+
+/* point a view at a buffer, where the buffer was last left */
+void screen_show(view *v, buffer *b) {
+    v->b = b;
+    v->y = b->y;
+    v->x = b->x;
+    v->sy = b->sy;
+    v->sx = b->sx;
+    v->ssub = 0;
+    v->drawn = false;
+    if (v->wrap != NULL) {
+        wrap_clear(v->wrap);
+    }
+}
+
+/* where a buffer is in the list */
+int screen_bufindex(buffer *b) {
+    int i = 0;
+    while (s.bufs[i] != b) {
+        i++;
+    }
+    return i;
+}
+
+/* show another open buffer in the focused view, just where it was left */
+void screen_switch(int i) {
+    char message[128];
+
+    screen_unfocus();
+    screen_show(s.v, s.bufs[i]);
+    screen_focus(s.v);
+
+    snprintf(message, sizeof(message), "Buffer %d/%d: %s", i + 1, s.nbufs, s.b->name != NULL ? s.b->name : "<No File>");
+    screen_message(message);
+}
+
+/* have the loop read a streamed buffer's input as it comes, and changes to any watched file */
+void screen_listen(buffer *b) {
+    if (b->fd != -1) {
+        loop_add(b->fd, screen_stream, b);
+    }
+    if (watch_fd() != -1) {
+        loop_add(watch_fd(), screen_watch, NULL);
+    }
+}
+
+/* add a buffer to the list */
+void screen_addbuf(buffer *b) {
+    // make sure the buffer has at least one line
+    if (b->len == 0) {
+        baddline(b, 0);
+        b->dirty = false;
+    }
+    syntax_init(b);
+    digest_save(b);
+
+    // edits to the file a crash left unsaved are made again. replays keep no journal, so one left
+    // next to the file doesn't change what they do
+    int recovered = s.replay == NULL ? journal_start(b) : 0;
+    if (recovered > 0) {
+        snprintf(s.notice, sizeof(s.notice), "Recovered %d unsaved edits to %s.", recovered, b->name);
+    } else if (recovered == -1) {
+        snprintf(s.notice, sizeof(s.notice), "Unsaved edits to an older %s were kept aside.", b->name);
+    }
+    watch_start(b);
+    screen_listen(b);
+
+    s.bufs = realloc(s.bufs, sizeof(buffer *) * (s.nbufs + 1));
+    s.bufs[s.nbufs++] = b;
+}
+
+/* free buffer i and take it out of the list, moving any views of it to the buffer next to it */
+void screen_dropbuf(int i) {
+    buffer *b = s.bufs[i];
+    s.nbufs--;
+    memmove(s.bufs + i, s.bufs + i + 1, sizeof(buffer *) * (s.nbufs - i));
+
+    if (s.nbufs > 0 && s.layout != NULL) {
+        view *views[MAX_VIEWS];
+        int n = split_views(s.layout, views);
+        for (int j = 0; j < n; j++) {
+            if (views[j]->b == b) {
+                screen_show(views[j], s.bufs[i < s.nbufs ? i : s.nbufs - 1]);
+            }
+        }
+        if (s.b == b) {
+            screen_focus(s.v);
+        }
+    }
+    if (b->fd != -1) {
+        loop_remove(b->fd);
+    }
+    delbuf(b);
+}
+
+/* close the buffer being shown, quitting once there are none left */
+void screen_closebuf() {
+    int i = screen_bufindex(s.b);
+    screen_dropbuf(i);
+
+    if (s.nbufs == 0) {
+        screen_shutdown();
+        exit(0);
+    }
+    screen_switch(i < s.nbufs ? i : s.nbufs - 1);
+}
+
 void screen_open() {
     char filename[80];
 
-    screen_read_message(filename, "Filename to open: ");
+    screen_read_message(filename, sizeof(filename), "Filename to open: ");
 
     if (strlen(filename) > 0) {
-        buffer *b = readbuf(filename);
-        if (b->len == 0) {
-            baddline(b, 0);
-            b->dirty = false;
-        }
-        delbuf(s.b);
-        s.b = b;
-        s.y = s.x = 0;
-        syntax_end();
-        syntax_init(s.b);
-    }
-}
-
-void screen_draw_lines() {
-    for (int y = 0; y < s.maxy - 1; y++) {
-        wmove(s.bufferwin, y, 0);
-        if (y + s.y < s.b->len) {
-            line *l = s.b->lines[y + s.y];
-            int x = 0;
-
-            while (x < s.maxx - 4 && x < l->len - s.x) {
-                if (l->attrs[x + s.x].type != NONE) {
-                    attribute a = l->attrs[x + s.x];
-                    short curses_attr;
-
-                    switch (a.type) {
-                        case COLOR1:
-                            curses_attr = COLOR_PAIR(1);
-                            break;
-
-                        case COLOR2:
-                            curses_attr = COLOR_PAIR(2);
-                            break;
-
-                        case COLOR3:
-                            curses_attr = COLOR_PAIR(3);
-                            break;
-
-                        case COLOR4:
-                            curses_attr = COLOR_PAIR(4);
-                            break;
-
-                        default:
-                            curses_attr = A_NORMAL;
-                            break;
-                    }
+        // a file that is already open is just shown again
+        for (int i = 0; i < s.nbufs; i++) {
+            if (s.bufs[i]->name != NULL && strcmp(s.bufs[i]->name, filename) == 0) {
+                screen_switch(i);
+                return;
+            }
+        }
 
-                    if (a.enabled) {
-                        wattron(s.bufferwin, curses_attr);
-                    } else {
-                        wattroff(s.bufferwin, curses_attr);
-                    }
-                }
+        // the untouched empty buffer jet starts with is replaced rather than kept around
+        buffer *scratch = s.b->name == NULL && !digest_dirty(s.b) && s.b->len == 1 && bline(s.b, 0)->len == 0 ? s.b : NULL;
+
+        screen_addbuf(screen_load(filename));
+        screen_switch(s.nbufs - 1);
+        if (scratch != NULL) {
+            screen_dropbuf(screen_bufindex(scratch));
+        }
+        screen_notice();
+    }
+}
+
+/* split the focused view, the new half taking focus */
+void screen_split(bool vertical) {
+    screen_unfocus();
+
+    view *half = split_view(s.d, s.v, vertical);
+    if (half == NULL) {
+        screen_message("No room to split the view.");
+        return;
+    }
+    screen_focus(half);
+}
+
+/* close the focused view, the view taking its space getting focus */
+void screen_closeview() {
+    view *next = split_close(s.d, s.v);
+    if (next == NULL) {
+        screen_message("Can't close the only view.");
+        return;
+    }
+    screen_focus(next);
+}
+
+/* move focus to the next view */
+void screen_nextview() {
+    view *views[MAX_VIEWS];
+    int n = split_views(s.layout, views);
+    int i = 0;
+    while (views[i] != s.v) {
+        i++;
+    }
+
+    screen_unfocus();
+    screen_focus(views[(i + 1) % n]);
+}
+
+/* move the cursor a screen up or down, paging down also scrolls the cursor to the top */
+void screen_page(bool down) {
+    int rows = s.v->rows - 1;
+    int col = lcolumn(bline(s.b, s.b->y), s.b->x);
+
+    if (s.v->wrap == NULL) {
+        int row = fold_row(s.b, s.b->y) + (down ? rows - 1 : -rows - 1);
+        bmovetocol(s.b, fold_line(s.b, row > 0 ? row : 0), col);
+        if (down && s.b->y < s.b->len - 1) {
+            s.b->sy = s.b->y;
+        }
+        return;
+    }
+
+    // with wrapping, a screen is so many rows rather than lines
+    view_sync(s.v);
+    wrap *w = s.v->wrap;
+    int row = wrap_row(w, s.b->y) + col / w->width + (down ? rows - 1 : -rows);
+    int sub;
+    int y = wrap_line(w, row > 0 ? row : 0, &sub);
+    bmovetocol(s.b, y, sub * w->width + col % w->width);
+    if (down && s.b->y < s.b->len - 1) {
+        s.b->sy = y;
+        s.v->ssub = sub;
+    }
+}
+
+/* fold away the block (or comment) around the cursor, or open the fold it is on */
+void screen_fold() {
+    if (fold_open(s.b, s.b->y)) {
+        return;
+    }
+
+    int start, end;
+    if (!fold_find(s.b, s.b->y, &start, &end) || !fold_close(s.b, start, end)) {
+        screen_message("Nothing to fold here.");
+        return;
+    }
+    if (s.b->y != start) {
+        bmoveto(s.b, start, 0);
+    }
+}
+
+/* jump to the bracket matching the one under the cursor, or to the bracket opening the block the
+ * cursor is in */
+void screen_match() {
+    int y, x, cy, cx;
+    bool on = nest_match(s.b, s.b->y, s.b->x, INT_MAX, &y, &x);
+    if (!on && !nest_around(s.b, s.b->y, s.b->x, INT_MAX, &y, &x, &cy, &cx)) {
+        screen_message("Not inside any brackets.");
+        return;
+    }
+    if (y == -1) {
+        screen_message("No matching bracket.");
+        return;
+    }
+
+    fold_reveal(s.b, y);
+    bmoveto(s.b, y, x);
+}
+
+/* start diffing the buffer against its file, marking the lines that differ, or stop */
+void screen_diff() {
+    if (s.b->diff != NULL) {
+        diff_end(s.b);
+        screen_message("Not diffing against the file.");
+        return;
+    }
+
+    int hunks = diff_start(s.b);
+    char message[64];
+    if (hunks == -1) {
+        screen_message("The file can't be read to diff against.");
+    } else if (hunks == 0) {
+        screen_message("The buffer is the same as the file.");
+    } else {
+        snprintf(message, sizeof(message), "%d hunk%s differ%s from the file.", hunks, hunks > 1 ? "s" : "", hunks > 1 ? "" : "s");
+        screen_message(message);
+    }
+}
+
+/* read the file again, only the lines that differ being changed */
+void screen_reload() {
+    if (!screen_editable()) {
+        return;
+    }
+    if (digest_dirty(s.b) && !screen_confirm("Unsaved edits will be lost! Really reload? (y/N): ")) {
+        return;
+    }
+
+    double start = stats_clock();
+    int changed = diff_reload(s.b);
+    stats_add(STAT_READ, stats_clock() - start);
+
+    char message[64];
+    if (changed == -1) {
+        screen_message("Failed to read file.");
+    } else {
+        snprintf(message, sizeof(message), "Reloaded, %d line%s changed.", changed, changed == 1 ? "" : "s");
+        screen_message(message);
+    }
+}
 
-                waddch(s.bufferwin, (chtype)l->s[x + s.x]);
-                x++;
+/* whether Ctrl-C was pressed to give up on a filter, keys before it being kept for later (those
+ * past what there's room for being dropped). replays read the keys recorded while it ran instead */
+bool screen_stopfilter(void *data) {
+    int max = sizeof(s.pending) / sizeof(int);
+    for (;;) {
+        int c;
+        if (s.replay != NULL) {
+            int rows, cols;
+            c = s.filtered ? TRACE_FILTERED : trace_next(s.replay, &rows, &cols);
+            if (c == TRACE_FILTERED || c == K_EOF) {
+                s.filtered = true;
+                return false;
+            }
+            if (c == K_RESIZE) {
+                headless_resize(rows, cols);
+            }
+        } else {
+            c = s.d->getkey(0);
+            if (c == K_NONE || c == K_EOF) {
+                return false;
+            }
+            if (c != KEY_CTRL('c') && s.npending == max) {
+                continue;
             }
+            if (s.record != NULL) {
+                trace_record(s.record, c, s.maxy, s.maxx);
+            }
+        }
+
+        if (c == KEY_CTRL('c')) {
+            return true;
+        }
+        if (s.npending < max) {
+            s.pending[s.npending++] = c;
         }
-        wattrset(s.bufferwin, A_NORMAL);
     }
 }
 
-void screen_update() {
-    // clear the screen and move cursor to top left
-    werase(s.bufferwin);
-    move(0, 0);
+/* run the fold under the cursor, or else the whole buffer, through a command, putting its output
+ * in their place */
+void screen_filter() {
+    if (!screen_editable()) {
+        return;
+    }
+    char command[256];
+    screen_read_message(command, sizeof(command), "Filter through command: ");
+    if (command[0] == '\0') {
+        screen_message("Filter aborted.");
+        return;
+    }
 
-    // scroll if needed
-    if (s.b->y < s.y) {
-        s.y = s.b->y;
-    } else if (s.b->y >= s.y + s.maxy - 1) {
-        s.y = s.b->y - (s.maxy - 1) + 1;
+    int y = 0, n = s.b->len;
+    int last = fold_last(s.b, s.b->y);
+    if (last > s.b->y) {
+        y = s.b->y;
+        n = last - y + 1;
     }
 
-    if (s.b->x < s.x) {
-        s.x = s.b->x;
-    } else if (s.b->x >= s.x + s.maxx - 4) {
-        s.x = s.b->x - (s.maxx - 4) + 1;
+    char error[128], message[192];
+    screen_new_message();
+    screen_print(s.messagebox, 0, 0, "Filtering through %s, Ctrl-C to stop.", command);
+    s.d->flush(s.messagebox);
+    s.filtered = false;
+    int lines = filter_lines(s.b, y, n, command, screen_stopfilter, NULL, error, sizeof(error));
+
+    // the keys read while it ran end with a mark in traces, which a replay reads up to however
+    // soon its filter finished
+    if (s.record != NULL) {
+        trace_record(s.record, TRACE_FILTERED, s.maxy, s.maxx);
+    }
+    while (s.replay != NULL && !s.filtered) {
+        screen_stopfilter(NULL);
     }
+    if (lines == -1) {
+        snprintf(message, sizeof(message), "Filter failed: %s", error);
+    } else {
+        snprintf(message, sizeof(message), "Filtered %d line%s into %d.", n, n == 1 ? "" : "s", lines);
+    }
+    screen_message(message);
 
-    // draw line numbers
-    werase(s.linenumbers);
-    for (int y = 0; y < s.maxy - 1; y++) {
-        if (y + s.y < s.b->len) {
-            mvwprintw(s.linenumbers, y, 0, "%3d ", y + s.y + 1);
+    // the cursor stays on its line, or goes to the last if there are fewer now
+    bmoveto(s.b, s.b->y < s.b->len ? s.b->y : s.b->len - 1, 0);
+}
+
+void screen_update();
+void screen_input(int c);
+
+/* complete the word before the cursor from the others in the buffer, the most common first. Ctrl-N
+ * again goes on to the next (and after the last, back to what was typed), any other key keeps it */
+void screen_complete() {
+    if (!screen_editable()) {
+        return;
+    }
+    line *l = bline(s.b, s.b->y);
+    int start = words_start(l, s.b->x);
+    int typed = s.b->x - start;
+    if (typed == 0) {
+        screen_message("Nothing to complete.");
+        return;
+    }
+
+    const word *found[COMPLETE_MAX];
+    int n = words_complete(s.b, l->s + start, typed, found, COMPLETE_MAX);
+    if (n == 0) {
+        screen_message("No completions.");
+        return;
+    }
+    n = n < COMPLETE_MAX ? n : COMPLETE_MAX;
+
+    // editing can free the words, so they are kept here
+    char *words[COMPLETE_MAX];
+    for (int i = 0; i < n; i++) {
+        words[i] = strndup(found[i]->s, found[i]->len);
+    }
+
+    int c = KEY_CTRL('n');
+    for (int i = 0; c == KEY_CTRL('n'); i = (i + 1) % (n + 1)) {
+        // what the last one added goes, and the next one's rest takes its place
+        const char *rest = i < n ? words[i] + typed : "";
+        for (int x = start + typed; x < s.b->x;) {
+            bdelch(s.b, s.b->y, x);
+            bmoveto(s.b, s.b->y, s.b->x - 1);
+        }
+        baddstr(s.b, rest, strlen(rest), s.b->y, s.b->x);
+        bmoveto(s.b, s.b->y, s.b->x + strlen(rest));
+        if (i < n) {
+            char message[64];
+            snprintf(message, sizeof(message), "Completion %d of %d.", i + 1, n);
+            screen_message(message);
         } else {
-            mvwaddch(s.linenumbers, y, 0, '~');
+            screen_message("Back to what was typed.");
+        }
+
+        screen_update();
+        while ((c = screen_getkey()) == K_NONE || c == K_RESIZE) {
+            screen_update();
         }
     }
 
-    // generate syntax
-    gen_syntax(s.b);
+    for (int i = 0; i < n; i++) {
+        free(words[i]);
+    }
+    if (c != K_EOF) {
+        screen_input(c);
+    }
+}
+
+/* wrap long lines in the focused view, or stop */
+void screen_wrap() {
+    view_wrap(s.v, s.v->wrap == NULL);
+    s.b->sx = 0;
+    screen_message(s.v->wrap != NULL ? "Wrapping long lines." : "Not wrapping long lines.");
+}
+
+/* read the key after Ctrl-W and act on the views with it */
+void screen_window() {
+    switch (screen_getkey()) {
+        case 's':
+            screen_split(false);
+            break;
+        case 'v':
+            screen_split(true);
+            break;
+        case 'w':
+        case KEY_CTRL('w'):
+            screen_nextview();
+            break;
+        case 'c':
+            screen_closeview();
+            break;
+        default:
+            screen_message("Ctrl-W then s to split, v to split side by side, w for the next view, c to close it");
+    }
+}
+
+/* describe the timings of recent frames for the status bar */
+void screen_overlay(char *out) {
+    char sent[16];
 
-    // draw text
-    screen_draw_lines();
+    screen_format_bytes(sent, s.frame_sent);
+    sprintf(out, "frame %.1f/%.1f/%.1fms  hl %d  rows %d  out %s  | ", stats_last(STAT_FRAME) * 1000,
+            stats_avg(STAT_FRAME) * 1000, stats_p99(STAT_FRAME) * 1000, s.highlighted, s.drawn, sent);
+}
 
-    // draw status bar
-    werase(s.statusbar);
+/* draw the status row of a view, marked when it has focus and there are others */
+void screen_status(view *v, bool marked) {
+    buffer *b = v->b;
+    char left[v->cols + 128];
+    char right[v->cols + 128];
+    char overlay[128] = "";
 
-    char left[s.maxx];
-    char right[s.maxx];
+    if (s.overlay && v == s.v) {
+        screen_overlay(overlay);
+    }
 
-    sprintf(left, " %s%s", s.b->name != NULL ? s.b->name : "<No File>", s.b->dirty ? " [!] " : "");
-    sprintf(right, " %d/%d ", s.b->y + 1, s.b->len);
+    s.d->erase(v->status);
 
-    mvwprintw(s.statusbar, 0, 0, "%.*s%*s", s.maxx - strlen(left), left, s.maxx - strlen(left), right);
+    snprintf(left, sizeof(left), "%c%s%s", marked ? '>' : ' ', b->name != NULL ? b->name : "<No File>", digest_dirty(b) ? " [!] " : "");
+    bool counted = b->index == NULL || b->index->complete;
+    const char *lang = syntax_name(b);
+    snprintf(right, sizeof(right), " %s%s%s%s%d/%d%s ", overlay, lang != NULL ? lang : "", lang != NULL ? " " : "",
+            beditable(b) ? "" : "[RO] ", v->y + 1, b->len, counted ? "" : "+");
 
-    // move cursor back to current location
-    wmove(s.bufferwin, s.b->y - s.y, s.b->x - s.x);
+    screen_print(v->status, 0, 0, "%.*s%*s", (int)(v->cols - strlen(left)), left, (int)(v->cols - strlen(left)), right);
+}
+
+void screen_update() {
+    double start = stats_clock();
+    int rows = s.v->rows - 1;
+
+    // viewed files are counted lazily, make sure everything on screen is known
+    bensure(s.b, s.b->y + rows + 1);
+
+    view *views[MAX_VIEWS];
+    int n = split_views(s.layout, views);
+    for (int i = 0; i < n; i++) {
+        view_sync(views[i]);
+    }
 
-    // refresh windows
-    refresh();
-    wrefresh(s.statusbar);
+    // scroll if needed
+    screen_unfocus();
+    view_scroll(s.v);
+    s.b->sy = s.v->sy;
+    s.b->sx = s.v->sx;
+
+    // generate syntax, once for each buffer however many views show it
+    double step = stats_clock();
+    s.highlighted = 0;
+    for (int i = 0; i < n; i++) {
+        bool seen = false;
+        for (int j = 0; j < i && !seen; j++) {
+            seen = views[j]->b == views[i]->b;
+        }
+        if (seen) {
+            continue;
+        }
+
+        // as far down and along as any of its views reach
+        int lines = 0, cols = 0;
+        for (int j = i; j < n; j++) {
+            view *v = views[j];
+            if (v->b == views[i]->b) {
+                lines = view_bottom(v) > lines ? view_bottom(v) : lines;
+                cols = view_right(v) > cols ? view_right(v) : cols;
+            }
+        }
+        bensure(views[i]->b, lines);
+        s.highlighted += gen_syntax(views[i]->b, lines, cols);
+    }
+
+    // brackets are matched once the lines they are on are highlighted
+    for (int i = 0; i < n; i++) {
+        view_match(views[i], views[i] == s.v);
+    }
+    stats_add(STAT_SYNTAX, stats_clock() - step);
+
+    // draw the rows that changed in every view, then forget what changed
+    step = stats_clock();
+    s.drawn = 0;
+    for (int i = 0; i < n; i++) {
+        s.drawn += view_draw(s.d, views[i]);
+    }
+    for (int i = 0; i < n; i++) {
+        screen_status(views[i], n > 1 && views[i] == s.v);
+    }
+    for (int i = 0; i < s.nbufs; i++) {
+        bclrdamage(s.bufs[i]);
+    }
+    stats_add(STAT_DRAW, stats_clock() - step);
+
+    // move cursor back to current location
+    int row, col;
+    view_cursor(s.v, &row, &col);
+    s.d->move(s.v->text, row, col);
+
+    // refresh windows, the focused text last so the cursor ends up there
+    for (int i = 0; i < n; i++) {
+        s.d->show(views[i]->numbers);
+        s.d->show(views[i]->status);
+        if (views[i] != s.v) {
+            s.d->show(views[i]->text);
+        }
+    }
     if (s.messagebox != NULL) {
-        touchwin(s.messagebox);
-        wrefresh(s.messagebox);
+        s.d->show(s.messagebox);
+    }
+    s.d->flush(s.v->text);
+
+    long sent = s.d->sent();
+    s.frame_sent = sent - s.sent;
+    s.sent = sent;
+    stats_add(STAT_FRAME, stats_clock() - start);
+
+    s.redraw = false;
+    s.frame_at = loop_clock();
+}
+
+/* highlight past the bottom of the views while nothing else is happening, so scrolling down finds
+ * the lines done. a buffer is only highlighted ahead once all it shows is, so nothing it damages
+ * is on screen */
+bool screen_ahead(double until, void *data) {
+    view *views[MAX_VIEWS];
+    int n = split_views(s.layout, views);
+    bool more = false;
+
+    for (int i = 0; i < n; i++) {
+        buffer *b = views[i]->b;
+        if (b->syntax == NULL || b->index != NULL) {
+            continue;
+        }
+
+        int bottom = 0;
+        for (int j = 0; j < n; j++) {
+            if (views[j]->b == b && view_bottom(views[j]) > bottom) {
+                bottom = view_bottom(views[j]);
+            }
+        }
+        int ahead = bottom + HIGHLIGHT_AHEAD < b->len ? bottom + HIGHLIGHT_AHEAD : b->len;
+
+        int dfirst = b->dfirst, dlast = b->dlast;
+        while (b->syntax->clean >= bottom && b->syntax->clean < ahead && !(more = loop_clock() >= until)) {
+            int clean = b->syntax->clean;
+            if (bline(b, clean)->len > HIGHLIGHT_LONG) {
+                break;
+            }
+            gen_syntax(b, clean + HIGHLIGHT_STEP < ahead ? clean + HIGHLIGHT_STEP : ahead, INT_MAX);
+            if (b->syntax->clean == clean) {
+                break;
+            }
+        }
+        b->dfirst = dfirst;
+        b->dlast = dlast;
+    }
+    return more;
+}
+
+/* draw the screen if anything changed, but not within a frame of the last time */
+void screen_draw(int events, void *data) {
+    if (!s.redraw) {
+        return;
+    }
+    double wait = s.frame_at + FRAME_MS / 1000.0 - loop_clock();
+    if (wait > 0) {
+        loop_after((int)(wait * 1000) + 1, screen_draw, NULL);
+        return;
     }
-    wrefresh(s.linenumbers);
-    wrefresh(s.bufferwin);
+    screen_update();
+    loop_idle(screen_ahead, NULL);
 }
 
 int screen_is_printable(int c) {
-    // for now only print between 32 and 255
+    // printable ASCII, and the bytes of UTF-8 characters (anything else is shown as U+FFFD)
     if (c >= 32 && c <= 255) {
-        return TRUE;
+        return true;
     } else {
-        return FALSE;
+        return false;
+    }
+}
+
+void screen_input(int c);
+
+/* insert a typed character, reading the rest of it first if c starts a multibyte one */
+void screen_insert(int c) {
+    char text[4] = { c };
+    int len = 1;
+    int want = c >= 0xf0 ? 4 : c >= 0xe0 ? 3 : c >= 0xc0 ? 2 : 1;
+
+    // the terminal sends the continuation bytes right behind the first, anything else is a key of its own
+    int next = K_NONE;
+    while (len < want) {
+        next = screen_getkey();
+        if (next < 0x80 || next > 0xbf) {
+            break;
+        }
+        text[len++] = next;
+        next = K_NONE;
+    }
+
+    baddstr(s.b, text, len, s.b->y, s.b->x);
+    bmoveto(s.b, s.b->y, s.b->x + len);
+
+    if (next != K_NONE) {
+        screen_input(next);
     }
 }
 
 void screen_resize() {
-    getmaxyx(stdscr, s.maxy, s.maxx);
+    s.d->size(&s.maxy, &s.maxx);
 
     // move and resize windows
-    wresize(s.bufferwin, s.maxy - 1, s.maxx - 4);
-    wresize(s.linenumbers, s.maxy - 1, 4);
-    wresize(s.statusbar, 1, s.maxx);
-    mvwin(s.statusbar, s.maxy - 1, 0);
+    split_layout(s.d, s.layout, 0, 0, s.maxy, s.maxx);
     if (s.messagebox != NULL) {
-        wresize(s.messagebox, 1, s.maxx);
-        mvwin(s.messagebox, s.maxy - 1, 0);
+        s.d->place(s.messagebox, 1, s.maxx, s.maxy - 1, 0);
     }
-    erase();
 }
 
-void screen_input() {
-    int c = getch();
-
+/* act on a key */
+void screen_input(int c) {
     switch (c) {
-        case KEY_RESIZE:
-            screen_resize();
+        case K_NONE:
+        case K_RESIZE:
+            // timed out waiting for a key or the screen changed size, nothing to do
             break;
-        case KEY_UP:
+
+        case K_UP:
             bmove(s.b, UP);
             break;
-        case KEY_DOWN:
+        case K_DOWN:
             bmove(s.b, DOWN);
             break;
-        case KEY_RIGHT:
+        case K_RIGHT:
             bmove(s.b, RIGHT);
             break;
-        case KEY_LEFT:
+        case K_LEFT:
             bmove(s.b, LEFT);
             break;
-        case KEY_PPAGE:
-            bmoveto(s.b, s.b->y - (s.maxy - 1) - 1, s.b->x);
+        case K_PPAGE:
+            screen_page(false);
             break;
-        case KEY_NPAGE:
-            bmoveto(s.b, s.b->y + (s.maxy - 1) - 1, s.b->x);
-            if (s.b->y < s.b->len - 1) {
-                s.y = s.b->y;
-            }
+        case K_NPAGE:
+            screen_page(true);
             break;
-        case KEY_HOME:
+        case K_HOME:
             bmoveto(s.b, s.b->y, 0);
             break;
-        case KEY_END:
-            bmoveto(s.b, s.b->y, s.b->lines[s.b->y]->len);
+        case K_END:
+            bmoveto(s.b, s.b->y, bline(s.b, s.b->y)->len);
             break;
 
         case KEY_CTRL('q'):
-            if (!s.b->dirty || screen_confirmquit()) {
-                screen_shutdown();
-                delbuf(s.b);
-                exit(0);
+            if (!digest_dirty(s.b) || screen_confirmquit()) {
+                screen_closebuf();
             }
             break;
 
         case KEY_CTRL('s'):
             screen_getfilename();
             if (s.b->name != NULL) {
-                if (writebuf(s.b) != -1) {
+                double start = stats_clock();
+                int written = screen_write(s.b);
+                stats_add(STAT_WRITE, stats_clock() - start);
+
+                if (written != -1) {
+                    // a buffer only just named is journaled and watched from now on
+                    if (s.replay == NULL) {
+                        journal_start(s.b);
+                    }
+                    watch_end(s.b);
+                    watch_start(s.b);
+                    screen_listen(s.b);
+
+                    // and what it's diffed against is what was just written
+                    if (s.b->diff != NULL) {
+                        diff_start(s.b);
+                    }
                     screen_message("File successfully written.");
                 } else {
                     screen_message("Failed to write file.");
@@ -345,35 +1224,96 @@ void screen_input() {
             screen_open();
             break;
 
+        case KEY_CTRL('b'):
+            screen_switch((screen_bufindex(s.b) + 1) % s.nbufs);
+            break;
+
+        case KEY_CTRL('w'):
+            screen_window();
+            break;
+
+        case KEY_CTRL('g'):
+            screen_goto();
+            break;
+
+        case KEY_CTRL('l'):
+            screen_wrap();
+            break;
+
+        case KEY_CTRL('f'):
+            screen_fold();
+            break;
+
+        case KEY_CTRL('k'):
+            screen_match();
+            break;
+
+        case KEY_CTRL('n'):
+            screen_complete();
+            break;
+
+        case KEY_CTRL('d'):
+            screen_diff();
+            break;
+
+        case KEY_CTRL('r'):
+            screen_reload();
+            break;
+
+        case KEY_CTRL('p'):
+            screen_filter();
+            break;
+
+        case KEY_CTRL('u'):
+            screen_memstats();
+            break;
+
+        case KEY_CTRL('t'):
+            s.overlay = !s.overlay;
+            break;
+
         case KEY_CTRL('h'):
-            screen_message("Ctrl-S to save buffer, Ctrl-O to open file, Ctrl-Q to quit");
+            screen_message("Ctrl-S to save buffer, Ctrl-O to open file, Ctrl-B to switch buffer, Ctrl-W to split views, Ctrl-G to go to line, Ctrl-L to wrap long lines, Ctrl-F to fold, Ctrl-K to match brackets, Ctrl-N to complete a word, Ctrl-D to diff against the file, Ctrl-R to reload it, Ctrl-P to filter through a command, Ctrl-U for memory usage, Ctrl-T for frame timings, Ctrl-Q to close buffer");
             break;
 
         case KEY_CTRL('x'):
             if (s.messagebox != NULL) {
-                delwin(s.messagebox);
+                s.d->delwin(s.messagebox);
                 s.messagebox = NULL;
             }
             break;
 
-        case KEY_BACKSPACE:
+        case K_BACKSPACE:
         case 127:
+            if (!screen_editable()) {
+                break;
+            }
             if (s.b->x > 0) {
+                int x = s.b->x;
                 bmove(s.b, LEFT);
-                bdelch(s.b, s.b->y, s.b->x);
+                for (int i = s.b->x; i < x; i++) {
+                    bdelch(s.b, s.b->y, s.b->x);
+                }
             } else if (s.b->y > 0) {
-                bmoveto(s.b, s.b->y - 1, s.b->lines[s.b->y - 1]->len);
+                // joining onto the last line of a fold opens it
+                fold_reveal(s.b, s.b->y - 1);
+                bmoveto(s.b, s.b->y - 1, bline(s.b, s.b->y - 1)->len);
                 bdelbreak(s.b, s.b->y + 1);
             }
             break;
 
-        case KEY_ENTER:
         case 13:
+            if (!screen_editable()) {
+                break;
+            }
             baddbreak(s.b, s.b->y, s.b->x);
             bmoveto(s.b, s.b->y + 1, 0);
             break;
 
         case '\t':
+            if (!screen_editable()) {
+                break;
+            }
             for (int i = 0; i < 4; i++) {
                 baddch(s.b, ' ', s.b->y, s.b->x);
                 bmove(s.b, RIGHT);
@@ -381,63 +1321,191 @@ void screen_input() {
             break;
 
         default:
-            if (screen_is_printable(c)) {
-                baddch(s.b, c, s.b->y, s.b->x);
-                bmove(s.b, RIGHT);
+            if (screen_is_printable(c) && screen_editable()) {
+                screen_insert(c);
             }
     }
 }
 
+/* act on every key that has come, the screen being drawn once for all of them */
+void screen_keys(int events, void *data) {
+    int c;
+    while ((c = screen_readkey(false)) != K_NONE) {
+        double start = stats_clock();
+        screen_input(c);
+        stats_add(STAT_INPUT, stats_clock() - start);
+        s.redraw = true;
+    }
+
+    // the terminal went away, what wasn't saved being left in the journals
+    if (events & (POLLHUP | POLLERR)) {
+        die("Lost the terminal", 1);
+    }
+}
+
+/* take in the screen's new size once SIGWINCH comes */
+void screen_winch(int events, void *data) {
+    if (screen_winched()) {
+        screen_resize();
+        if (s.record != NULL) {
+            trace_record(s.record, K_RESIZE, s.maxy, s.maxx);
+        }
+        s.redraw = true;
+    }
+}
+
+void usage(const char *name) {
+    printf("Usage: %s [-v] [--stats file] [--record trace] [--replay trace [--dump]] [file | -]...\n", name);
+    exit(1);
+}
+
 int main(int argc, char *argv[]) {
-    // set up ncurses and enable raw mode so we can get those sweet, sweet keycodes
-    initscr();
-    raw();
-    noecho();
-    nonl();
-    keypad(stdscr, TRUE);
-    define_key("\b", 8);
-
-    // setup colors
-    start_color();
-    init_pair(1, COLOR_GREEN, COLOR_BLACK);
-    init_pair(2, COLOR_BLUE, COLOR_BLACK);
-    init_pair(3, COLOR_MAGENTA, COLOR_BLACK);
-    init_pair(4, COLOR_CYAN, COLOR_BLACK);
-
-    // create buffer
-    if (argc > 1) {
-        s.b = readbuf(argv[1]);
-    } else {
-        s.b = newbuf();
+    // parse arguments, -v opens the files for viewing only
+    const char *files[argc];
+    int nfiles = 0;
+    const char *record = NULL;
+    const char *replay = NULL;
+    bool view = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) {
+            view = true;
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay = argv[++i];
+        } else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+            s.stats = argv[++i];
+        } else if (strcmp(argv[i], "--dump") == 0) {
+            s.dump = true;
+        } else if (argv[i][0] == '-' && argv[i][1] == '-') {
+            usage(argv[0]);
+        } else {
+            files[nfiles++] = argv[i];
+        }
     }
 
-    // make sure the buffer has at least one line
-    if (s.b->len == 0) {
-        baddline(s.b, 0);
-        s.b->dirty = false;
+    // replays draw into memory instead of the terminal, at the size they were recorded at
+    s.d = &curses_display;
+    if (replay != NULL) {
+        s.replay = trace_open(replay);
+        if (s.replay == NULL) {
+            printf("Error: %s\n", "Failed to read trace");
+            return 1;
+        }
+
+        int rows, cols;
+        trace_size(s.replay, &rows, &cols);
+        headless_resize(rows, cols);
+        s.d = &headless_display;
     }
 
-    // set initial screen state
-    set_tabsize(TABSTOP);
-    getmaxyx(stdscr, s.maxy, s.maxx);
-    s.bufferwin = newwin(s.maxy - 1, s.maxx - 4, 0, 4);
-    s.linenumbers = newwin(s.maxy - 1, 4, 0, 0);
-    s.statusbar = newwin(1, s.maxx, s.maxy - 1, 0);
-    s.messagebox = NULL;
-    s.y = s.x = 0;
+    // when reading the file from stdin, keep it and take keyboard input from the terminal instead
+    int stdin_fd = -1;
+    for (int i = 0; i < nfiles && stdin_fd == -1; i++) {
+        if (strcmp(files[i], "-") != 0) {
+            continue;
+        }
+        stdin_fd = dup(STDIN_FILENO);
+        if (s.replay == NULL && freopen("/dev/tty", "r", stdin) == NULL) {
+            printf("Error: %s\n", "Failed to open terminal for input");
+            return 1;
+        }
+    }
+
+    // the size changing is caught here rather than by the display, so it can wake the loop
+    s.winch = s.replay == NULL ? loop_signal(SIGWINCH) : -1;
+    loop_init();
+    s.d->init();
 
     // start syntax
     syntax_readfiles();
-    syntax_init(s.b);
+
+    // create a buffer for each file, standard input only being read once
+    for (int i = 0; i < nfiles; i++) {
+        buffer *b;
+        if (strcmp(files[i], "-") == 0) {
+            if (stdin_fd == -1) {
+                continue;
+            }
+            b = openstream(stdin_fd);
+            stdin_fd = -1;
+        } else {
+            // fall back to loading the file if it can't be mapped for viewing
+            b = view ? viewbuf(files[i]) : NULL;
+            if (b == NULL) {
+                b = screen_load(files[i]);
+            }
+        }
+        screen_addbuf(b);
+    }
+    if (s.nbufs == 0) {
+        screen_addbuf(newbuf());
+    }
+
+    // set initial screen state
+    s.d->size(&s.maxy, &s.maxx);
+    s.layout = newsplit(s.d, s.bufs[0]);
+    split_layout(s.d, s.layout, 0, 0, s.maxy, s.maxx);
+    screen_focus(s.layout->v);
+    s.messagebox = NULL;
+
+    if (record != NULL) {
+        s.record = trace_create(record, s.maxy, s.maxx);
+        if (s.record == NULL) {
+            die("Failed to create trace", 1);
+        }
+    }
 
     // add a friendly welcome message
     char message[80];
     sprintf(message, "Welcome to Jet v%d.%d.%d! Use Ctrl-H to display help.", VERSION_MAJOR, VERSION_MINOR, VERSION_PATCH);
     screen_message(message);
+    screen_notice();
+
+    screen_update();
+    if (s.replay == NULL) {
+        // keys, streams, changed files and resizes all wake the loop, which draws at most once a
+        // frame for whatever came and highlights ahead while nothing does
+        loop_add(STDIN_FILENO, screen_keys, NULL);
+        if (s.winch != -1) {
+            loop_add(s.winch, screen_winch, NULL);
+        }
+        // it only ends by the last buffer being closed, which exits
+        while (true) {
+            loop_once();
+            screen_journal(0, NULL);
+            screen_draw(0, NULL);
+        }
+    }
+
+    // replays go a key at a time, each drawn, so each key's latency is known
+    while (true) {
+        int c = screen_getkey();
+        if (c == K_EOF) {
+            break;
+        }
+        screen_poll();
+        screen_watch(0, NULL);
 
-    while (TRUE) {
+        if (c != K_NONE) {
+            double start = stats_clock();
+            screen_input(c);
+            stats_add(STAT_INPUT, stats_clock() - start);
+        }
         screen_update();
-        screen_input();
+        screen_journal(0, NULL);
+
+        // draw being whatever the update spent outside gen_syntax
+        if (c != K_NONE) {
+            double syntax = stats_last(STAT_SYNTAX);
+            trace_sample(s.replay, stats_last(STAT_INPUT), syntax, stats_last(STAT_FRAME) - syntax);
+        }
     }
-}
 
+    screen_shutdown();
+    while (s.nbufs > 0) {
+        screen_dropbuf(0);
+    }
+    free(s.bufs);
+    return 0;
+}
@@ -0,0 +1,191 @@
+/*
+ * loop.c
+ * Waiting on descriptors, signals and timers with poll, and running idle work in between
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+
+#include "loop.h"
+
+static struct {
+    int fd;
+    loop_fn fn;
+    void *data;
+} sources[LOOP_MAX];
+static int nsources;
+
+static struct {
+    double at;
+    loop_fn fn;
+    void *data;
+} timers[LOOP_MAX];
+static int ntimers;
+
+static struct {
+    loop_idlefn fn;
+    void *data;
+} idle[LOOP_MAX];
+static int nidle;
+
+/* written to by loop_wake, read back by the loop itself */
+static int wakefd = -1;
+
+double loop_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* empty the wakeup descriptor, the wakeup having done its job */
+static void loop_woken(int events, void *data) {
+    (void)events;
+    (void)data;
+    eventfd_t n;
+    eventfd_read(wakefd, &n);
+}
+
+void loop_init(void) {
+    if (wakefd == -1) {
+        wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wakefd != -1) {
+            loop_add(wakefd, loop_woken, NULL);
+        }
+    }
+}
+
+void loop_add(int fd, loop_fn fn, void *data) {
+    int i = 0;
+    while (i < nsources && sources[i].fd != fd) {
+        i++;
+    }
+    if (i == LOOP_MAX) {
+        return;
+    }
+    nsources += i == nsources;
+    sources[i].fd = fd;
+    sources[i].fn = fn;
+    sources[i].data = data;
+}
+
+void loop_remove(int fd) {
+    for (int i = 0; i < nsources; i++) {
+        if (sources[i].fd == fd) {
+            sources[i] = sources[--nsources];
+            return;
+        }
+    }
+}
+
+int loop_signal(int signo) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, signo);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) == -1) {
+        return -1;
+    }
+    return signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+}
+
+void loop_after(int ms, loop_fn fn, void *data) {
+    int i = 0;
+    while (i < ntimers && (timers[i].fn != fn || timers[i].data != data)) {
+        i++;
+    }
+    if (ms < 0) {
+        if (i < ntimers) {
+            timers[i] = timers[--ntimers];
+        }
+        return;
+    }
+    if (i == LOOP_MAX) {
+        return;
+    }
+    ntimers += i == ntimers;
+    timers[i].at = loop_clock() + ms / 1000.0;
+    timers[i].fn = fn;
+    timers[i].data = data;
+}
+
+void loop_idle(loop_idlefn fn, void *data) {
+    for (int i = 0; i < nidle; i++) {
+        if (idle[i].fn == fn && idle[i].data == data) {
+            return;
+        }
+    }
+    if (nidle < LOOP_MAX) {
+        idle[nidle].fn = fn;
+        idle[nidle++].data = data;
+    }
+}
+
+void loop_wake(void) {
+    if (wakefd != -1) {
+        eventfd_write(wakefd, 1);
+    }
+}
+
+void loop_once(void) {
+    // as long as the next timer, rounded up so it is due on waking, or not at all with idle work
+    int timeout = -1;
+    double now = loop_clock();
+    for (int i = 0; i < ntimers; i++) {
+        int ms = timers[i].at > now ? (int)((timers[i].at - now) * 1000) + 1 : 0;
+        timeout = timeout == -1 || ms < timeout ? ms : timeout;
+    }
+    if (nidle > 0) {
+        timeout = 0;
+    }
+
+    struct pollfd fds[LOOP_MAX];
+    int n = nsources;
+    for (int i = 0; i < n; i++) {
+        fds[i].fd = sources[i].fd;
+        fds[i].events = POLLIN;
+        fds[i].revents = 0;
+    }
+    int ready = poll(fds, n, timeout);
+
+    // a callback can add or remove sources, so each is looked up again before it is called
+    for (int i = 0; i < n && ready > 0; i++) {
+        if (fds[i].revents == 0) {
+            continue;
+        }
+        if (fds[i].revents & POLLNVAL) {
+            loop_remove(fds[i].fd);
+            continue;
+        }
+        for (int j = 0; j < nsources; j++) {
+            if (sources[j].fd == fds[i].fd) {
+                sources[j].fn(fds[i].revents, sources[j].data);
+                break;
+            }
+        }
+    }
+
+    // timers go before they are called, so they can set themselves again
+    now = loop_clock();
+    for (int i = 0; i < ntimers; i++) {
+        if (timers[i].at <= now) {
+            loop_fn fn = timers[i].fn;
+            void *data = timers[i].data;
+            timers[i--] = timers[--ntimers];
+            fn(0, data);
+        }
+    }
+
+    // idle work only goes ahead when nothing else was waiting
+    if (ready == 0 && nidle > 0) {
+        double until = loop_clock() + LOOP_SLICE / 1000.0;
+        for (int i = 0; i < nidle; i++) {
+            if (!idle[i].fn(until, idle[i].data)) {
+                idle[i--] = idle[--nidle];
+            }
+        }
+    }
+}
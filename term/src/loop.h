@@ -0,0 +1,53 @@
+/*
+ * loop.h
+ * The event loop the front end waits in, for descriptors, signals, timers and idle work
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#ifndef LOOP_H
+#define LOOP_H
+
+#include <stdbool.h>
+
+/* how long (ms) a slice of idle work may take before the loop looks for anything else to do */
+#define LOOP_SLICE 4
+
+/* most descriptors, timers and idle tasks the loop keeps each */
+#define LOOP_MAX 32
+
+/* called with the poll events that woke a descriptor, or 0 for a timer that is due */
+typedef void (*loop_fn)(int events, void *data);
+
+/* a slice of idle work, to stop once loop_clock() passes until. returns whether there is more */
+typedef bool (*loop_idlefn)(double until, void *data);
+
+/* seconds on a clock that only goes forward */
+double loop_clock(void);
+
+/* set up the loop's wakeup descriptor, before any thread that might wake it starts */
+void loop_init(void);
+
+/* call fn whenever fd can be read (or has hung up), instead of whatever was called before. a
+ * descriptor closed without being removed is dropped once poll says so */
+void loop_add(int fd, loop_fn fn, void *data);
+void loop_remove(int fd);
+
+/* block a signal, returning a descriptor (see signalfd) that can be read once it arrives instead,
+ * -1 if there isn't one. reading a signalfd_siginfo from it clears it */
+int loop_signal(int signo);
+
+/* call fn once, ms from now, in place of the timer fn already had for data. a negative ms cancels it */
+void loop_after(int ms, loop_fn fn, void *data);
+
+/* run fn a slice at a time while nothing else is happening, until it says it is done. adding it
+ * again while it is still running does nothing */
+void loop_idle(loop_idlefn fn, void *data);
+
+/* wake the loop from another thread, so whatever it finished is noticed */
+void loop_wake(void);
+
+/* wait for anything to happen, until the next timer if there is one and not at all if there is
+ * idle work, and call back whatever did. idle work gets a slice once nothing else is waiting */
+void loop_once(void);
+
+#endif
@@ -0,0 +1,109 @@
+/*
+ * stats.c
+ * Timing the hot paths of the editor, kept as histograms for the overlay and for dumping
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+
+/* recent samples kept per probe for the average and percentile */
+#define STATS_RING 256
+
+/* histogram buckets, bucket i counts samples under 2^i microseconds */
+#define STATS_BUCKETS 32
+
+typedef struct probe {
+    double ring[STATS_RING];
+    int len, next;
+    double last;
+
+    long count;
+    double total, max;
+    long buckets[STATS_BUCKETS];
+} probe;
+
+static const char *probe_names[STAT_PROBES] = {"frame", "input", "gen_syntax", "draw_lines", "readbuf", "writebufto"};
+
+static probe probes[STAT_PROBES];
+
+double stats_clock() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void stats_add(enum stat_probe p, double seconds) {
+    probe *pr = &probes[p];
+
+    pr->ring[pr->next] = seconds;
+    pr->next = (pr->next + 1) % STATS_RING;
+    if (pr->len < STATS_RING) {
+        pr->len++;
+    }
+    pr->last = seconds;
+
+    long us = (long)(seconds * 1e6);
+    int bucket = 0;
+    while (bucket < STATS_BUCKETS - 1 && us >= 1L << bucket) {
+        bucket++;
+    }
+    pr->buckets[bucket]++;
+    pr->count++;
+    pr->total += seconds;
+    if (seconds > pr->max) {
+        pr->max = seconds;
+    }
+}
+
+double stats_last(enum stat_probe p) {
+    return probes[p].last;
+}
+
+double stats_avg(enum stat_probe p) {
+    probe *pr = &probes[p];
+    double sum = 0;
+
+    for (int i = 0; i < pr->len; i++) {
+        sum += pr->ring[i];
+    }
+    return pr->len > 0 ? sum / pr->len : 0;
+}
+
+static int compare_samples(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+double stats_p99(enum stat_probe p) {
+    probe *pr = &probes[p];
+    double sorted[STATS_RING];
+
+    if (pr->len == 0) {
+        return 0;
+    }
+    memcpy(sorted, pr->ring, sizeof(double) * pr->len);
+    qsort(sorted, pr->len, sizeof(double), compare_samples);
+    return sorted[(pr->len * 99 + 99) / 100 - 1];
+}
+
+void stats_dump(FILE *out) {
+    for (int p = 0; p < STAT_PROBES; p++) {
+        probe *pr = &probes[p];
+        if (pr->count == 0) {
+            continue;
+        }
+
+        fprintf(out, "%s: %ld runs, avg %.3f ms, max %.3f ms\n", probe_names[p], pr->count,
+                pr->total / pr->count * 1000, pr->max * 1000);
+        for (int i = 0; i < STATS_BUCKETS; i++) {
+            if (pr->buckets[i] > 0) {
+                fprintf(out, "  < %10ld us %10ld\n", 1L << i, pr->buckets[i]);
+            }
+        }
+    }
+}
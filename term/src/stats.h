@@ -0,0 +1,37 @@
+/*
+ * stats.h
+ * Timing the hot paths of the editor, kept as histograms for the overlay and for dumping
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+
+/* the places that are timed */
+enum stat_probe {
+    STAT_FRAME,
+    STAT_INPUT,
+    STAT_SYNTAX,
+    STAT_DRAW,
+    STAT_READ,
+    STAT_WRITE,
+    STAT_PROBES
+};
+
+/* monotonic time in seconds */
+double stats_clock();
+
+/* record how long (in seconds) one run of a probe took */
+void stats_add(enum stat_probe p, double seconds);
+
+/* the latest sample, and the mean and 99th percentile of the recent ones (0 when there are none) */
+double stats_last(enum stat_probe p);
+double stats_avg(enum stat_probe p);
+double stats_p99(enum stat_probe p);
+
+/* write the histogram of every probe that ran */
+void stats_dump(FILE *out);
+
+#endif
@@ -0,0 +1,163 @@
+/*
+ * trace.c
+ * Recording keystroke traces and replaying them to measure per-key latency
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "display.h"
+#include "stats.h"
+#include "trace.h"
+
+#define TRACE_VERSION 1
+
+enum phase {
+    EDIT,
+    SYNTAX,
+    DRAW,
+    TOTAL,
+    PHASES
+};
+
+static const char *phase_names[PHASES] = {"edit", "gen_syntax", "draw", "total"};
+
+struct trace {
+    FILE *f;
+    int rows, cols;
+    double last;
+    int keys;
+
+    // per key timings, one array per phase
+    double *samples[PHASES];
+    int len, cap;
+};
+
+trace *trace_create(const char *filename, int rows, int cols) {
+    FILE *f = fopen(filename, "w");
+    if (f == NULL) {
+        return NULL;
+    }
+    // a line at a time, so a crash still leaves the keys leading up to it
+    setvbuf(f, NULL, _IOLBF, 0);
+    fprintf(f, "jet-trace %d %d %d\n", TRACE_VERSION, rows, cols);
+
+    trace *t = calloc(1, sizeof(trace));
+    t->f = f;
+    t->rows = rows;
+    t->cols = cols;
+    t->last = stats_clock();
+    return t;
+}
+
+void trace_record(trace *t, int key, int rows, int cols) {
+    double now = stats_clock();
+    long ms = (long)((now - t->last) * 1000);
+    t->last = now;
+    t->keys++;
+
+    if (key == K_RESIZE) {
+        fprintf(t->f, "%ld %d %d %d\n", ms, key, rows, cols);
+    } else {
+        fprintf(t->f, "%ld %d\n", ms, key);
+    }
+}
+
+trace *trace_open(const char *filename) {
+    FILE *f = fopen(filename, "r");
+    if (f == NULL) {
+        return NULL;
+    }
+
+    char header[64];
+    int version, rows, cols;
+    if (fgets(header, sizeof(header), f) == NULL
+        || sscanf(header, "jet-trace %d %d %d", &version, &rows, &cols) != 3
+        || version != TRACE_VERSION || rows < 2 || cols < 5) {
+        fclose(f);
+        return NULL;
+    }
+
+    trace *t = calloc(1, sizeof(trace));
+    t->f = f;
+    t->rows = rows;
+    t->cols = cols;
+    return t;
+}
+
+void trace_size(trace *t, int *rows, int *cols) {
+    *rows = t->rows;
+    *cols = t->cols;
+}
+
+int trace_next(trace *t, int *rows, int *cols) {
+    char text[64];
+    long ms;
+    int key;
+
+    // recorded delays are kept for reference only, replay runs as fast as it can
+    if (fgets(text, sizeof(text), t->f) == NULL || sscanf(text, "%ld %d %d %d", &ms, &key, rows, cols) < 2) {
+        return K_EOF;
+    }
+    t->keys += key != TRACE_FILTERED;
+    return key;
+}
+
+void trace_sample(trace *t, double edit, double syntax, double draw) {
+    if (t->len == t->cap) {
+        t->cap = t->cap == 0 ? 1024 : t->cap * 2;
+        for (int p = 0; p < PHASES; p++) {
+            t->samples[p] = realloc(t->samples[p], sizeof(double) * t->cap);
+        }
+    }
+
+    t->samples[EDIT][t->len] = edit;
+    t->samples[SYNTAX][t->len] = syntax;
+    t->samples[DRAW][t->len] = draw;
+    t->samples[TOTAL][t->len] = edit + syntax + draw;
+    t->len++;
+}
+
+static int compare_samples(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* nearest-rank percentile of sorted samples */
+static double percentile(const double *sorted, int len, double p) {
+    int rank = (int)(p * len + 0.999999);
+    if (rank < 1) {
+        rank = 1;
+    }
+    return sorted[rank - 1];
+}
+
+void trace_report(trace *t, FILE *out) {
+    fprintf(out, "%d keys, %d frames at %dx%d\n", t->keys, t->len, t->cols, t->rows);
+    if (t->len == 0) {
+        return;
+    }
+
+    fprintf(out, "%-12s %10s %10s %10s\n", "phase (ms)", "p50", "p99", "max");
+    for (int p = 0; p < PHASES; p++) {
+        double *sorted = malloc(sizeof(double) * t->len);
+        memcpy(sorted, t->samples[p], sizeof(double) * t->len);
+        qsort(sorted, t->len, sizeof(double), compare_samples);
+
+        fprintf(out, "%-12s %10.3f %10.3f %10.3f\n", phase_names[p],
+                percentile(sorted, t->len, 0.5) * 1000,
+                percentile(sorted, t->len, 0.99) * 1000,
+                sorted[t->len - 1] * 1000);
+        free(sorted);
+    }
+}
+
+void trace_close(trace *t) {
+    fclose(t->f);
+    for (int p = 0; p < PHASES; p++) {
+        free(t->samples[p]);
+    }
+    free(t);
+}
@@ -0,0 +1,48 @@
+/*
+ * trace.h
+ * Recording keystroke traces and replaying them to measure per-key latency
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+
+/*
+ * A trace is a text file: a "jet-trace 1 <rows> <cols>" header giving the
+ * screen size, then one "<ms since previous key> <key>" line per key using the
+ * values from display.h. Resizes carry the new size as two extra fields. Keys
+ * pressed while a filter ran are followed by TRACE_FILTERED, so a replay reads
+ * just those while it runs its filter.
+ */
+typedef struct trace trace;
+
+/* where a filter finished, past any key display.h has */
+#define TRACE_FILTERED 0x300
+
+/* start recording keys to a file, NULL if it can't be created */
+trace *trace_create(const char *filename, int rows, int cols);
+
+/* add a key to a recording */
+void trace_record(trace *t, int key, int rows, int cols);
+
+/* open a recording for replay, NULL if it can't be read */
+trace *trace_open(const char *filename);
+
+/* the screen size the trace was recorded at */
+void trace_size(trace *t, int *rows, int *cols);
+
+/* next key of a replay, K_EOF once it runs out, and the new size for resizes */
+int trace_next(trace *t, int *rows, int *cols);
+
+/* time taken (seconds) by each phase of handling the last key */
+void trace_sample(trace *t, double edit, double syntax, double draw);
+
+/* print p50/p99/max of each phase over the samples taken so far */
+void trace_report(trace *t, FILE *out);
+
+/* finish recording or replaying */
+void trace_close(trace *t);
+
+#endif
@@ -0,0 +1,487 @@
+/*
+ * view.c
+ * Laying out views of buffers and drawing the rows of them that changed
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#include <stdlib.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <core/utf8.h>
+#include <core/nest.h>
+#include <core/diff.h>
+
+#include "view.h"
+
+/* a view of the buffer at its last position, its windows are sized once it is laid out */
+static view *newview(const display *d, buffer *b) {
+    view *v = calloc(1, sizeof(view));
+    v->b = b;
+    v->y = b->y;
+    v->x = b->x;
+    v->sy = b->sy;
+    v->sx = b->sx;
+    v->rows = v->cols = 1;
+    v->reflowed = INT_MAX;
+    v->by[0] = v->by[1] = v->drawn_by[0] = v->drawn_by[1] = -1;
+    v->numbers = d->newwin(1, 1, 0, 0);
+    v->text = d->newwin(1, 1, 0, 0);
+    v->status = d->newwin(1, 1, 0, 0);
+    return v;
+}
+
+static void delview(const display *d, view *v) {
+    d->delwin(v->numbers);
+    d->delwin(v->text);
+    d->delwin(v->status);
+    if (v->wrap != NULL) {
+        delwrap(v->wrap);
+    }
+    free(v);
+}
+
+/* a leaf of the layout holding v */
+static split *newleaf(view *v, split *parent) {
+    split *s = calloc(1, sizeof(split));
+    s->v = v;
+    s->parent = parent;
+    v->node = s;
+    return s;
+}
+
+split *newsplit(const display *d, buffer *b) {
+    return newleaf(newview(d, b), NULL);
+}
+
+void delsplit(const display *d, split *s) {
+    if (s->v != NULL) {
+        delview(d, s->v);
+    } else {
+        delsplit(d, s->a);
+        delsplit(d, s->b);
+    }
+    free(s);
+}
+
+void split_layout(const display *d, split *s, int top, int left, int rows, int cols) {
+    s->top = top;
+    s->left = left;
+    s->rows = rows;
+    s->cols = cols;
+
+    if (s->v == NULL) {
+        // the first half gets the smaller share of an odd size
+        if (s->vertical) {
+            split_layout(d, s->a, top, left, rows, cols / 2);
+            split_layout(d, s->b, top, left + cols / 2, rows, cols - cols / 2);
+        } else {
+            split_layout(d, s->a, top, left, rows / 2, cols);
+            split_layout(d, s->b, top + rows / 2, left, rows - rows / 2, cols);
+        }
+        return;
+    }
+
+    view *v = s->v;
+    v->top = top;
+    v->left = left;
+    v->rows = rows;
+    v->cols = cols;
+    d->place(v->numbers, rows - 1, GUTTER, top, left);
+    d->place(v->text, rows - 1, cols - GUTTER, top, left + GUTTER);
+    d->place(v->status, 1, cols, top + rows - 1, left);
+    v->drawn = false;
+}
+
+view *split_view(const display *d, view *v, bool vertical) {
+    // each half needs a row of text and a status row, or a couple of columns of text
+    if (vertical ? v->cols < 2 * (GUTTER + 2) : v->rows < 4) {
+        return NULL;
+    }
+
+    split *root = v->node;
+    while (root->parent != NULL) {
+        root = root->parent;
+    }
+    view *views[MAX_VIEWS];
+    if (split_views(root, views) >= MAX_VIEWS) {
+        return NULL;
+    }
+
+    // the leaf becomes the parent of the old view and the new one
+    split *s = v->node;
+    view *half = newview(d, v->b);
+    half->y = v->y;
+    half->x = v->x;
+    half->sy = v->sy;
+    half->sx = v->sx;
+    half->ssub = v->ssub;
+    view_wrap(half, v->wrap != NULL);
+
+    s->v = NULL;
+    s->vertical = vertical;
+    s->a = newleaf(v, s);
+    s->b = newleaf(half, s);
+
+    split_layout(d, s, s->top, s->left, s->rows, s->cols);
+    return half;
+}
+
+view *split_close(const display *d, view *v) {
+    split *s = v->node;
+    split *parent = s->parent;
+    if (parent == NULL) {
+        return NULL;
+    }
+
+    // the sibling moves up into the parent, which keeps its place in the tree and on screen
+    split *sibling = parent->a == s ? parent->b : parent->a;
+    parent->v = sibling->v;
+    parent->a = sibling->a;
+    parent->b = sibling->b;
+    parent->vertical = sibling->vertical;
+    if (parent->v != NULL) {
+        parent->v->node = parent;
+    } else {
+        parent->a->parent = parent->b->parent = parent;
+    }
+
+    split_layout(d, parent, parent->top, parent->left, parent->rows, parent->cols);
+    free(sibling);
+    free(s);
+    delview(d, v);
+
+    // focus the first view of whatever took the space
+    split *first = parent;
+    while (first->v == NULL) {
+        first = first->a;
+    }
+    return first->v;
+}
+
+int split_views(split *s, view **out) {
+    if (s->v != NULL) {
+        out[0] = s->v;
+        return 1;
+    }
+
+    int n = split_views(s->a, out);
+    return n + split_views(s->b, out + n);
+}
+
+void view_wrap(view *v, bool on) {
+    if (on == (v->wrap != NULL)) {
+        return;
+    }
+
+    if (on) {
+        v->wrap = newwrap();
+        v->sx = 0;
+    } else {
+        delwrap(v->wrap);
+        v->wrap = NULL;
+    }
+    v->ssub = 0;
+    v->drawn = false;
+}
+
+void view_sync(view *v) {
+    // lines folded away since are shown as the first line of their fold
+    v->y = fold_shown(v->b, v->y);
+    v->sy = fold_shown(v->b, v->sy);
+
+    // marks that changed with the hunks are drawn again along with the lines edited
+    int hunks;
+    diff_hunks(v->b, &hunks);
+
+    if (v->wrap == NULL) {
+        return;
+    }
+
+    int changed = wrap_sync(v->wrap, v->b, v->cols - GUTTER);
+    v->reflowed = changed < v->reflowed ? changed : v->reflowed;
+
+    // the top line may have lost rows
+    int height = wrap_height(v->wrap, v->sy);
+    v->ssub = v->ssub < height ? v->ssub : height - 1;
+}
+
+void view_scroll(view *v) {
+    int rows = v->rows - 1;
+    int cols = v->cols - GUTTER;
+    int col = lcolumn(bline(v->b, v->y), v->x);
+
+    if (v->wrap != NULL) {
+        // counting rows of wrapped lines rather than lines
+        int row = wrap_row(v->wrap, v->y) + col / v->wrap->width;
+        int top = wrap_row(v->wrap, v->sy) + v->ssub;
+        if (row < top) {
+            top = row;
+        } else if (row >= top + rows) {
+            top = row - rows + 1;
+        }
+        v->sy = wrap_line(v->wrap, top, &v->ssub);
+        v->sx = 0;
+        return;
+    }
+
+    // a row for every line, but for those folded away
+    int row = fold_row(v->b, v->y);
+    int top = fold_row(v->b, v->sy);
+    if (row < top) {
+        top = row;
+    } else if (row >= top + rows) {
+        top = row - rows + 1;
+    }
+    v->sy = fold_line(v->b, top);
+
+    if (col < v->sx) {
+        v->sx = col;
+    } else if (col >= v->sx + cols) {
+        v->sx = col - cols + 1;
+    }
+}
+
+void view_cursor(view *v, int *row, int *col) {
+    int x = lcolumn(bline(v->b, v->y), v->x);
+    if (v->wrap != NULL) {
+        int width = v->wrap->width;
+        *row = wrap_row(v->wrap, v->y) + x / width - wrap_row(v->wrap, v->sy) - v->ssub;
+        *col = x % width;
+    } else {
+        *row = fold_row(v->b, v->y) - fold_row(v->b, v->sy);
+        *col = x - v->sx;
+    }
+}
+
+int view_bottom(view *v) {
+    int rows = v->rows - 1;
+    if (v->wrap != NULL) {
+        // rows past the end of the index take a line each
+        int row = wrap_row(v->wrap, v->sy) + v->ssub + rows - 1;
+        int end = wrap_row(v->wrap, v->wrap->len);
+        if (row >= end) {
+            return v->wrap->len + row - end + 1;
+        }
+        int sub;
+        return fold_last(v->b, wrap_line(v->wrap, row, &sub)) + 1;
+    }
+    return fold_last(v->b, fold_line(v->b, fold_row(v->b, v->sy) + rows - 1)) + 1;
+}
+
+int view_right(view *v) {
+    int cols = v->cols - GUTTER;
+    return v->wrap != NULL ? (v->ssub + v->rows - 1) * cols : v->sx + cols;
+}
+
+void view_match(view *v, bool focused) {
+    buffer *b = v->b;
+    v->by[0] = v->by[1] = -1;
+
+    // viewed files could be read to the end looking for a match, so theirs aren't shown
+    if (!focused || b->index != NULL) {
+        return;
+    }
+
+    // a match that isn't on screen doesn't need finding
+    int limit = view_bottom(v);
+    if (nest_match(b, v->y, v->x, limit, &v->by[1], &v->bx[1])) {
+        v->by[0] = v->y;
+        v->bx[0] = v->x;
+    } else if (!nest_around(b, v->y, v->x, limit, &v->by[0], &v->bx[0], &v->by[1], &v->bx[1])) {
+        v->by[0] = -1;
+    }
+
+    // so an unmatched bracket compares the same from one draw to the next
+    for (int i = 0; i < 2; i++) {
+        v->bx[i] = v->by[i] != -1 ? v->bx[i] : 0;
+    }
+}
+
+/* whether line ly has a bracket shown matched on it, or had one last time */
+static bool view_bracketed(view *v, int ly) {
+    return ly == v->by[0] || ly == v->by[1] || ly == v->drawn_by[0] || ly == v->drawn_by[1];
+}
+
+/*
+ * draw line l from byte x, which is at column col, up to column to. what the
+ * terminal can't be handed as it is gets spelled out: tabs as spaces, control
+ * characters as ^X and anything that isn't UTF-8 as U+FFFD. a tab or wide
+ * character cut by either edge shows as spaces
+ */
+static void view_text(const display *d, view *v, line *l, int x, int col, int from, int to) {
+    char out[256];
+    int len = 0;
+
+    while (x < l->len) {
+        int c;
+        int n = utf8_decode(&l->s[x], l->len - x, &c);
+        int w = utf8_width(c, col);
+        if (col >= to && w > 0) {
+            break;
+        }
+
+        // attributes switched anywhere within a character take effect before it
+        if (l->attrs != NULL) {
+            for (int i = x; i < x + n; i++) {
+                if (l->attrs[i].type != NONE) {
+                    d->put(v->text, out, len);
+                    len = 0;
+                    d->attr(v->text, l->attrs[i].type, l->attrs[i].enabled);
+                }
+            }
+        }
+        if (len > (int)sizeof(out) - TABSTOP - 4) {
+            d->put(v->text, out, len);
+            len = 0;
+        }
+
+        if (c == '\t' || col < from || col + w > to) {
+            for (int i = col > from ? col : from; i < col + w && i < to; i++) {
+                out[len++] = ' ';
+            }
+        } else if (c < 32 || c == 127) {
+            out[len++] = '^';
+            out[len++] = c == 127 ? '?' : c + 64;
+        } else if (c == UTF8_INVALID || (c >= 0x80 && c < 0xa0)) {
+            len += utf8_encode(UTF8_INVALID, &out[len]);
+        } else {
+            memcpy(&out[len], &l->s[x], n);
+            len += n;
+        }
+
+        x += n;
+        col += w;
+    }
+    d->put(v->text, out, len);
+}
+
+/* draw row y of a view: columns from..to-1 of line ly, numbered if it is the line's first row */
+static void view_row(const display *d, view *v, int y, int ly, int from, int to, bool number) {
+    buffer *b = v->b;
+
+    d->move(v->numbers, y, 0);
+    d->clrtoeol(v->numbers);
+    d->move(v->text, y, 0);
+    d->clrtoeol(v->text);
+
+    if (ly >= b->len) {
+        d->put(v->numbers, "~", 1);
+        return;
+    }
+
+    // the first line of a fold is marked in place of the space after its number, as are lines that
+    // differ from the file while it's being diffed
+    if (number) {
+        static const char marks[] = {' ', '~', '>', '<'};
+        char mark = marks[diff_mark(b, ly)];
+        char number[16];
+        int len = snprintf(number, sizeof(number), "%3d%c", ly + 1, mark == ' ' && fold_last(b, ly) > ly ? '+' : mark);
+        d->put(v->numbers, number, len);
+    }
+
+    line *l = bline(b, ly);
+    int x = lbyte(l, from);
+
+    // anything switched on further left carries on into view
+    if (l->attrs != NULL && x < l->len) {
+        attribute a = lattrat(l, x);
+        if (a.type != NONE && a.enabled) {
+            d->attr(v->text, a.type, true);
+        }
+    }
+
+    if (!lplain(l)) {
+        view_text(d, v, l, x, lcolumn(l, x), from, to);
+        d->attrclear(v->text);
+    } else {
+        // every byte of a plain line is a column, so the backend is handed runs of text between attribute changes
+        int end = l->len < to ? l->len : to;
+        while (x < end) {
+            int run = end;
+            if (l->attrs != NULL) {
+                if (l->attrs[x].type != NONE) {
+                    d->attr(v->text, l->attrs[x].type, l->attrs[x].enabled);
+                }
+                run = x + 1;
+                while (run < end && l->attrs[run].type == NONE) {
+                    run++;
+                }
+            }
+
+            d->put(v->text, l->s + x, run - x);
+            x = run;
+        }
+        d->attrclear(v->text);
+    }
+
+    // brackets shown matched are drawn again over the text, highlighted
+    for (int i = 0; i < 2; i++) {
+        int col = v->by[i] == ly ? lcolumn(l, v->bx[i]) : -1;
+        if (col >= from && col < to) {
+            d->move(v->text, y, col - from);
+            d->attr(v->text, HIGHLIGHT, true);
+            d->put(v->text, &l->s[v->bx[i]], 1);
+            d->attrclear(v->text);
+        }
+    }
+}
+
+int view_draw(const display *d, view *v) {
+    buffer *b = v->b;
+    int first = b->dfirst;
+    int last = b->dlast;
+    int cols = v->cols - GUTTER;
+    int drawn = 0;
+
+    // lines counted or loaded since the last draw appear where the ~ rows were
+    if (v->drawn_len != b->len) {
+        int from = v->drawn_len < b->len ? v->drawn_len : b->len;
+        first = from < first ? from : first;
+        last = INT_MAX;
+    }
+
+    // a line that now wraps onto more or fewer rows moves everything below it
+    if (v->reflowed != INT_MAX) {
+        first = v->reflowed < first ? v->reflowed : first;
+        last = INT_MAX;
+    }
+
+    // a view that moved or was just laid out has nothing worth keeping
+    if (!v->drawn || v->sy != v->drawn_sy || v->sx != v->drawn_sx || v->ssub != v->drawn_ssub) {
+        first = 0;
+        last = INT_MAX;
+    }
+
+    // the lines of brackets shown matched or no longer shown, if they changed
+    bool matched = memcmp(v->by, v->drawn_by, sizeof(v->by)) != 0 || memcmp(v->bx, v->drawn_bx, sizeof(v->bx)) != 0;
+
+    int ly = v->sy;
+    int sub = v->ssub;
+    for (int y = 0; y < v->rows - 1; y++) {
+        if ((ly >= first && ly <= last) || (matched && view_bracketed(v, ly))) {
+            if (v->wrap != NULL) {
+                view_row(d, v, y, ly, sub * cols, (sub + 1) * cols, sub == 0);
+            } else {
+                view_row(d, v, y, ly, v->sx, v->sx + cols, true);
+            }
+            drawn++;
+        }
+
+        if (v->wrap == NULL || ++sub >= wrap_height(v->wrap, ly)) {
+            ly = fold_last(b, ly) + 1;
+            sub = 0;
+        }
+    }
+
+    v->drawn = true;
+    v->drawn_sy = v->sy;
+    v->drawn_sx = v->sx;
+    v->drawn_ssub = v->ssub;
+    v->drawn_len = b->len;
+    memcpy(v->drawn_by, v->by, sizeof(v->by));
+    memcpy(v->drawn_bx, v->bx, sizeof(v->bx));
+    v->reflowed = INT_MAX;
+    return drawn;
+}
@@ -0,0 +1,109 @@
+/*
+ * view.h
+ * Views of buffers, laid out on the screen as a tree of splits
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#ifndef VIEW_H
+#define VIEW_H
+
+#include <stdbool.h>
+
+#include <core/buffer.h>
+
+#include "display.h"
+#include "wrap.h"
+
+/* width of the line number column on the left of each view */
+#define GUTTER 4
+
+/* most views the screen can be split into */
+#define MAX_VIEWS 64
+
+struct split;
+
+/* part of the screen showing a buffer, with its own cursor and scroll position */
+typedef struct view {
+    buffer *b;
+
+    // while the view has focus its position lives in the buffer, which the editing functions move
+    int y, x;
+    int sy, sx;
+
+    // when long lines are wrapped, the rows of them and how many rows of line sy are scrolled past
+    wrap *wrap;
+    int ssub;
+
+    // where the view is on screen, its status row included
+    int top, left, rows, cols;
+    window *numbers, *text, *status;
+    struct split *node;
+
+    // what was on screen after the last draw, so unchanged rows can be left alone
+    bool drawn;
+    int drawn_sy, drawn_sx, drawn_ssub, drawn_len;
+
+    // the first line whose wrapped rows changed since the last draw, moving everything below it
+    int reflowed;
+
+    // the pair of brackets shown matched (a line of -1 for neither), and those drawn last time
+    int by[2], bx[2];
+    int drawn_by[2], drawn_bx[2];
+} view;
+
+/* a node of the layout, either a view or two halves stacked (or side by side if vertical) */
+typedef struct split {
+    view *v;
+    struct split *a, *b;
+    struct split *parent;
+    bool vertical;
+
+    // the part of the screen the node was last laid out in
+    int top, left, rows, cols;
+} split;
+
+/* create a view of a buffer at its last position, as the whole of a new layout */
+split *newsplit(const display *d, buffer *b);
+
+/* free a layout and all of its views */
+void delsplit(const display *d, split *s);
+
+/* place every view of a layout within the given part of the screen */
+void split_layout(const display *d, split *s, int top, int left, int rows, int cols);
+
+/* split a view in two, the new half (below or to the right) showing the same place. NULL if there is no room */
+view *split_view(const display *d, view *v, bool vertical);
+
+/* remove a view, its sibling taking the space. returns the view to focus, NULL if v was the only one */
+view *split_close(const display *d, view *v);
+
+/* fill out with the views of a layout from top left to bottom right, returns how many there are */
+int split_views(split *s, view **out);
+
+/* wrap long lines of a view, or stop */
+void view_wrap(view *v, bool on);
+
+/* catch the view's wrapped rows up with changes to its buffer, before it is scrolled or drawn */
+void view_sync(view *v);
+
+/* scroll the view so its cursor is on screen */
+void view_scroll(view *v);
+
+/* where the cursor is within the text of the view */
+void view_cursor(view *v, int *row, int *col);
+
+/* the line just past the last the view shows, lines folded away included, for gen_syntax */
+int view_bottom(view *v);
+
+/* how far along its lines the view shows, for gen_syntax */
+int view_right(view *v);
+
+/* pick the brackets to show matched: the one at the cursor and its match, otherwise the pair
+ * around the cursor. only the focused view shows them */
+void view_match(view *v, bool focused);
+
+/* draw the line numbers and text of a view, returns how many rows were drawn. rows are only drawn
+ * again if the buffer damaged them or the view moved */
+int view_draw(const display *d, view *v);
+
+#endif
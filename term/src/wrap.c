@@ -0,0 +1,218 @@
+/*
+ * wrap.c
+ * Keeping count of the rows wrapped lines take, in a Fenwick tree
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "wrap.h"
+
+wrap *newwrap() {
+    wrap *w = calloc(1, sizeof(wrap));
+    w->moved = INT_MAX;
+    return w;
+}
+
+void delwrap(wrap *w) {
+    wrap_clear(w);
+    free(w->widths);
+    free(w->tree);
+    bstale_free(&w->stale);
+    free(w);
+}
+
+static void wrap_observe(buffer *b, int y, int n, void *data);
+
+void wrap_clear(wrap *w) {
+    if (w->b != NULL) {
+        bunobserve(w->b, wrap_observe, w);
+    }
+    w->b = NULL;
+    w->len = 0;
+    w->stale.n = 0;
+    w->moved = INT_MAX;
+}
+
+/* rows line y takes, none if it is folded away */
+static int rows(wrap *w, int y) {
+    return fold_shown(w->b, y) == y ? w->widths[y] / w->width + 1 : 0;
+}
+
+/* make room for len lines */
+static void wrap_grow(wrap *w, int len) {
+    if (len <= w->cap) {
+        return;
+    }
+
+    int cap = w->cap > 0 ? w->cap : 256;
+    while (cap < len) {
+        cap *= 2;
+    }
+    w->widths = realloc(w->widths, sizeof(int) * cap);
+    w->tree = realloc(w->tree, sizeof(int) * (cap + 1));
+    w->cap = cap;
+}
+
+/* sum every node of the tree from the widths, in one pass */
+static void wrap_build(wrap *w) {
+    for (int i = 1; i <= w->len; i++) {
+        w->tree[i] = rows(w, i - 1);
+    }
+    for (int i = 1; i <= w->len; i++) {
+        int parent = i + (i & -i);
+        if (parent <= w->len) {
+            w->tree[parent] += w->tree[i];
+        }
+    }
+}
+
+/* add the node for line y at the end of the tree, summing the nodes below it */
+static void wrap_append(wrap *w, int y) {
+    int i = y + 1;
+    w->tree[i] = rows(w, y);
+    for (int k = 1; k < (i & -i); k <<= 1) {
+        w->tree[i] += w->tree[i - k];
+    }
+}
+
+/* keep the widths in step with lines being added and removed, the tree is rebuilt on the next sync */
+static void wrap_observe(buffer *b, int y, int n, void *data) {
+    wrap *w = data;
+    (void)b;
+
+    n = bstale_note(&w->stale, y, n, w->len);
+    if (n == 0) {
+        return;
+    }
+    if (n > 0) {
+        wrap_grow(w, w->len + n);
+        memmove(&w->widths[y + n], &w->widths[y], sizeof(int) * (w->len - y));
+        memset(&w->widths[y], 0, sizeof(int) * n);
+    } else {
+        memmove(&w->widths[y], &w->widths[y - n], sizeof(int) * (w->len - y + n));
+    }
+    w->len += n;
+    w->moved = y < w->moved ? y : w->moved;
+}
+
+int wrap_sync(wrap *w, buffer *b, int width) {
+    int changed = INT_MAX;
+    bool rebuild = false;
+
+    if (w->b != b) {
+        wrap_clear(w);
+        w->b = b;
+        bobserve(b, wrap_observe, w);
+        changed = 0;
+    }
+
+    // line widths stay good across a new wrapping width, or lines being folded
+    if (w->width != width || w->folded != fold_version(b)) {
+        w->width = width > 0 ? width : 1;
+        w->folded = fold_version(b);
+        rebuild = true;
+        changed = 0;
+    }
+
+    // lines added or removed move everything after them, so the tree is summed again. that is no
+    // worse than the buffer moving its lines was
+    if (w->moved != INT_MAX) {
+        rebuild = true;
+        changed = w->moved < changed ? w->moved : changed;
+        w->moved = INT_MAX;
+    }
+
+    // anything else that shrank the buffer went unseen
+    if (w->len > b->len) {
+        w->len = b->len;
+        rebuild = true;
+        changed = b->len < changed ? b->len : changed;
+    }
+
+    for (int i = 0; i < w->stale.n; i++) {
+        int y = w->stale.lines[i];
+        if (y >= w->len) {
+            continue;
+        }
+        int old = rows(w, y);
+        w->widths[y] = lwidth(bline(b, y));
+        int d = rows(w, y) - old;
+        if (d != 0 && !rebuild) {
+            for (int j = y + 1; j <= w->len; j += j & -j) {
+                w->tree[j] += d;
+            }
+            changed = y < changed ? y : changed;
+        }
+    }
+    w->stale.n = 0;
+
+    if (rebuild) {
+        wrap_build(w);
+    }
+
+    // lines counted or streamed in since, a lot of them at once are quicker summed in one pass
+    if (w->len < b->len) {
+        int from = w->len;
+        wrap_grow(w, b->len);
+        for (int y = from; y < b->len; y++) {
+            w->widths[y] = lwidth(bline(b, y));
+        }
+        w->len = b->len;
+
+        if (w->len - from > from) {
+            wrap_build(w);
+        } else {
+            for (int y = from; y < w->len; y++) {
+                wrap_append(w, y);
+            }
+        }
+        changed = from < changed ? from : changed;
+    }
+    return changed;
+}
+
+int wrap_height(wrap *w, int y) {
+    return y < w->len ? rows(w, y) : 1;
+}
+
+int wrap_row(wrap *w, int y) {
+    int row = 0;
+    if (y > w->len) {
+        row = y - w->len;
+        y = w->len;
+    }
+    for (int i = y; i > 0; i -= i & -i) {
+        row += w->tree[i];
+    }
+    return row;
+}
+
+int wrap_line(wrap *w, int row, int *sub) {
+    if (w->len == 0) {
+        *sub = 0;
+        return 0;
+    }
+
+    // walk down the tree, taking every node that still ends at or before row
+    int y = 0;
+    int step = 1;
+    while (step * 2 <= w->len) {
+        step *= 2;
+    }
+    for (; step > 0; step /= 2) {
+        if (y + step <= w->len && w->tree[y + step] <= row) {
+            y += step;
+            row -= w->tree[y];
+        }
+    }
+
+    if (y == w->len) {
+        y = fold_shown(w->b, w->len - 1);
+        row = rows(w, y) - 1;
+    }
+    *sub = row;
+    return y;
+}
@@ -0,0 +1,63 @@
+/*
+ * wrap.h
+ * Rows of the screen each line of a buffer takes when long lines are wrapped
+ * Copyright (c) 2018 Ethan Martin
+ */
+
+#ifndef WRAP_H
+#define WRAP_H
+
+#include <stdbool.h>
+
+#include <core/buffer.h>
+#include <core/fold.h>
+
+/*
+ * A line cols columns wide takes cols / width + 1 rows, leaving the cursor room
+ * after the last character, and a line folded away none. The rows are summed in a Fenwick tree so a line's
+ * first row, and the line at a given row, are found in O(log lines). Widths of
+ * lines are kept as well, so a new width doesn't need the text looked at again, and
+ * the buffer tells the index which lines changed or moved (see bobserve).
+ */
+typedef struct wrap {
+    buffer *b;
+    int width;
+
+    // lines indexed so far, and room for them
+    int len, cap;
+    int *widths;
+
+    // tree[i] sums the rows of lines i - (i & -i) to i - 1
+    int *tree;
+
+    // lines whose text changed since the last sync, and the first line added or removed (INT_MAX if none)
+    bstale stale;
+    int moved;
+
+    // the buffer's folds the rows were counted with, see fold_version
+    int folded;
+} wrap;
+
+wrap *newwrap();
+void delwrap(wrap *w);
+
+/* stop watching the buffer and forget every line indexed, for when the view shows another */
+void wrap_clear(wrap *w);
+
+/*
+ * bring the index up to date with edits to the buffer, lines counted since and
+ * the width, starting to watch the buffer if it is a new one. returns the first
+ * line whose rows changed, INT_MAX if none did
+ */
+int wrap_sync(wrap *w, buffer *b, int width);
+
+/* rows taken by line y */
+int wrap_height(wrap *w, int y);
+
+/* the first row of line y. lines past the end of the index take a row each */
+int wrap_row(wrap *w, int y);
+
+/* the line at a row, with the row within it in sub. rows past the end give the last line */
+int wrap_line(wrap *w, int row, int *sub);
+
+#endif